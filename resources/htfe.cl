@@ -1,519 +1,1201 @@
-constant sampler_t normalizedClampedNearestSampler = CLK_NORMALIZED_COORDS_TRUE |
-CLK_ADDRESS_CLAMP |
-CLK_FILTER_NEAREST;
-
-constant sampler_t normalizedClampedToEdgeNearestSampler = CLK_NORMALIZED_COORDS_TRUE |
-CLK_ADDRESS_CLAMP_TO_EDGE |
-CLK_FILTER_NEAREST;
-
-constant sampler_t unnormalizedClampedNearestSampler = CLK_NORMALIZED_COORDS_FALSE |
-CLK_ADDRESS_CLAMP |
-CLK_FILTER_NEAREST;
-
-constant sampler_t defaultNormalizedSampler = CLK_NORMALIZED_COORDS_TRUE |
-CLK_ADDRESS_CLAMP_TO_EDGE |
-CLK_FILTER_NEAREST;
-
-constant sampler_t defaultUnnormalizedSampler = CLK_NORMALIZED_COORDS_FALSE |
-CLK_ADDRESS_CLAMP_TO_EDGE |
-CLK_FILTER_NEAREST;
-
-float randFloat(uint2* state) {
-	const float invMaxInt = 1.0f / 4294967296.0f;
-	uint x = (*state).x * 17 + (*state).y * 13123;
-	(*state).x = (x << 13) ^ x;
-	(*state).y ^= (x << 7);
-
-	uint tmp = x * (x * x * 15731 + 74323) + 871483;
-
-	return convert_float(tmp) * invMaxInt;
-}
-
-float sigmoid(float x) {
-	return 1.0f / (1.0f + exp(-x));
-}
-
-float boostFunction(float trace, float threshold) {
-	return fmin(1.0f, fmax(0.0f, threshold - trace) / threshold);
-}
-
-void kernel initializeLayerHidden(write_only image2d_t hiddenFeedForwardActivations,
-	write_only image2d_t hiddenFeedBackActivations,
-	write_only image2d_t hiddenStates,
-	write_only image3d_t feedForwardWeights,
-	write_only image2d_t hiddenBiases,
-	write_only image3d_t lateralWeights,
-	write_only image3d_t feedBackWeights,
-	int feedForwardSize, int lateralSize, int feedBackSize,
-	uint2 seed, float sparsity, float lateralScalar, float feedBackScalar, float minWeight, float maxWeight)
-{
-	uint2 seedValue = seed + (uint2)(get_global_id(0) * 29 + 12, get_global_id(1) * 16 + 23) * 36;
-
-	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
-
-	write_imagef(hiddenFeedForwardActivations, hiddenPosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
-	write_imagef(hiddenFeedBackActivations, hiddenPosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
-	write_imagef(hiddenStates, hiddenPosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
-
-	float hiddenBias = randFloat(&seedValue) * (maxWeight - minWeight) + minWeight;
-
-	write_imagef(hiddenBiases, hiddenPosition, (float4)(hiddenBias, 0.0f, 0.0f, 0.0f));
-
-	for (int wi = 0; wi < feedForwardSize; wi++) {
-		int4 weightPosition = (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0);
-
-		float feedForwardWeight = randFloat(&seedValue) * (maxWeight - minWeight) + minWeight;
-
-		write_imagef(feedForwardWeights, weightPosition, (float4)(feedForwardWeight, 0.0f, 0.0f, 0.0f));
-	}
-
-	for (int wi = 0; wi < lateralSize; wi++) {
-		int4 weightPosition = (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0);
-
-		float lateralWeight = lateralScalar * (randFloat(&seedValue) * (maxWeight - minWeight) + minWeight);
-
-		write_imagef(lateralWeights, weightPosition, (float4)(lateralWeight, 0.0f, 0.0f, 0.0f));
-	}
-
-	for (int wi = 0; wi < feedBackSize; wi++) {
-		int4 weightPosition = (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0);
-
-		float feedBackWeight = feedBackScalar * (randFloat(&seedValue) * (maxWeight - minWeight) + minWeight);
-
-		write_imagef(feedBackWeights, weightPosition, (float4)(feedBackWeight, 0.0f, 0.0f, 0.0f));
-	}
-}
-
-void kernel initializeLayerVisible(write_only image2d_t visibleBiases, write_only image2d_t visibleReconstruction, write_only image3d_t reconstructionWeights,
-	int reconstructionSize, uint2 seed, float minWeight, float maxWeight)
-{
-	uint2 seedValue = seed + (uint2)(get_global_id(0) * 64 + 11, get_global_id(1) * 16 + 4) * 2;
-
-	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
-
-	float bias = randFloat(&seedValue) * (maxWeight - minWeight) + minWeight;
-
-	write_imagef(visibleBiases, visiblePosition, (float4)(bias, 0.0f, 0.0f, 0.0f));
-
-	for (int wi = 0; wi < reconstructionSize; wi++) {
-		float weight = randFloat(&seedValue) * (maxWeight - minWeight) + minWeight;
-
-		write_imagef(reconstructionWeights, (int4)(visiblePosition.x, visiblePosition.y, wi, 0), (float4)(weight, 0.0f, 0.0f, 0.0f));
-	}
-
-	write_imagef(visibleReconstruction, visiblePosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
-}
-
-void kernel layerHiddenFeedForwardActivate(read_only image2d_t inputs, read_only image2d_t hiddenStatesPrev, read_only image3d_t feedForwardWeights, read_only image3d_t lateralWeights, read_only image2d_t hiddenBiases, write_only image2d_t hiddenFeedForwardActivations,
-	int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius)
-{
-	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
-
-	float2 inputCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
-	int2 inputCenterPosition = (int2)(inputCenterPositionNormalized.x * inputSizeMinusOne.x, inputCenterPositionNormalized.y * inputSizeMinusOne.y);
-
-	float sum = 0.0f;
-
-	int wi = 0;
-
-	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
-		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
-			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
-
-			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
-				float input = read_imagef(inputs, inputPosition).x;
-
-				float weight = read_imagef(feedForwardWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				sum += weight * input;
-			}
-
-			wi++;
-		}
-
-	wi = 0;
-
-	for (int dx = -lateralConnectionRadius; dx <= lateralConnectionRadius; dx++)
-		for (int dy = -lateralConnectionRadius; dy <= lateralConnectionRadius; dy++) {
-			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
-
-			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
-				float state = read_imagef(hiddenStatesPrev, layerPosition).x;
-
-				float weight = read_imagef(lateralWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				sum += weight * state;
-			}
-
-			wi++;
-		}
-
-	// Bias
-	float bias = read_imagef(hiddenBiases, hiddenPosition).x;
-
-	sum += bias;
-
-	write_imagef(hiddenFeedForwardActivations, hiddenPosition, (float4)(sigmoid(sum), sum, 0.0f, 0.0f));
-}
-
-void kernel layerHiddenFeedBackActivate(read_only image2d_t hiddenFeedForwardActivations, read_only image2d_t nextLayerHiddenStates, read_only image3d_t feedBackWeights, write_only image2d_t hiddenFeedBackActivations,
-	int2 layerSize, float2 layerSizeMinusOneInv, int2 nextSize, int2 nextSizeMinusOne, int feedBackRadius)
-{
-	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
-
-	float2 nextCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
-	int2 nextCenterPosition = (int2)(nextCenterPositionNormalized.x * nextSizeMinusOne.x, nextCenterPositionNormalized.y * nextSizeMinusOne.y);
-
-	float feedForwardActivation = read_imagef(hiddenFeedForwardActivations, hiddenPosition).y;
-
-	float sum = feedForwardActivation;
-
-	int wi = 0;
-
-	for (int dx = -feedBackRadius; dx <= feedBackRadius; dx++)
-		for (int dy = -feedBackRadius; dy <= feedBackRadius; dy++) {
-			int2 nextPosition = (int2)(nextCenterPosition.x + dx, nextCenterPosition.y + dy);
-
-			if (nextPosition.x >= 0 && nextPosition.x < nextSize.x && nextPosition.y >= 0 && nextPosition.y < nextSize.y) {
-				float next = read_imagef(nextLayerHiddenStates, nextPosition).x;
-
-				float weight = read_imagef(feedBackWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				sum += weight * next;
-			}
-
-			wi++;
-		}
-
-	write_imagef(hiddenFeedBackActivations, hiddenPosition, (float4)(sigmoid(sum), 0.0f, 0.0f, 0.0f));
-}
-
-void kernel layerHiddenInhibit(read_only image2d_t hiddenActivations, read_only image2d_t hiddenStatesPrev, write_only image2d_t hiddenStates,
-	int2 layerSize, int inhibitionRadius, float localActivity)
-{
-	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
-
-	float thisActivation = read_imagef(hiddenActivations, hiddenPosition).x;
-
-	float numHigher = 0.0f;
-
-	for (int dx = -inhibitionRadius; dx <= inhibitionRadius; dx++)
-		for (int dy = -inhibitionRadius; dy <= inhibitionRadius; dy++) {
-			if (dx == 0 && dy == 0)
-				continue;
-
-			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
-
-			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
-				float activation = read_imagef(hiddenActivations, layerPosition).x;
-
-				numHigher += activation >= thisActivation ? 1.0f : 0.0f;
-			}
-		}
-
-	float newState = numHigher < localActivity ? 1.0f : 0.0f;
-
-	write_imagef(hiddenStates, hiddenPosition, (float4)(newState, 0.0f, 0.0f, 0.0f));
-}
-
-void kernel layerVisibleReconstruct(read_only image2d_t hiddenStates, read_only image3d_t reconstructionWeights, read_only image2d_t visibleBiases, write_only image2d_t visibleReconstruction,
-	int reconstructionReceptiveRadius, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv)
-{
-	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
-	float2 layerPositionNormalized = (float2)(visiblePosition.x * inputSizeMinusOneInv.x, visiblePosition.y * inputSizeMinusOneInv.y);
-	int2 layerPositionCenter = (int2)(layerPositionNormalized.x * layerSizeMinusOne.x, layerPositionNormalized.y * layerSizeMinusOne.y);
-
-	float sum = 0.0f;
-
-	int wi = 0;
-
-	for (int dx = -reconstructionReceptiveRadius; dx <= reconstructionReceptiveRadius; dx++)
-		for (int dy = -reconstructionReceptiveRadius; dy <= reconstructionReceptiveRadius; dy++) {
-			int2 layerPosition = (int2)(layerPositionCenter.x + dx, layerPositionCenter.y + dy);
-
-			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
-				float source = read_imagef(hiddenStates, layerPosition).x;
-
-				float weight = read_imagef(reconstructionWeights, (int4)(visiblePosition.x, visiblePosition.y, wi, 0)).x;
-
-				sum += source * weight;
-			}
-
-			wi++;
-		}
-
-	//float bias = read_imagef(visibleBiases, visiblePosition).x;
-
-	//sum += bias;
-
-	write_imagef(visibleReconstruction, visiblePosition, (float4)(sum, 0.0f, 0.0f, 0.0f));
-}
-
-void kernel layerHiddenWeightUpdate(read_only image2d_t visibleReconstruction, read_only image2d_t inputs, read_only image2d_t inputsPrev, read_only image2d_t feedBackActivationsPrev, read_only image2d_t hiddenStatesPrev, read_only image2d_t hiddenStatesPrevPrev, read_only image2d_t nextLayerHiddenStatesPrev,
-	read_only image3d_t reconstructionWeightsPrev, read_only image3d_t feedForwardWeightsPrev, read_only image3d_t lateralWeightsPrev, read_only image2d_t hiddenBiasesPrev, read_only image3d_t feedBackWeightsPrev,
-	write_only image3d_t feedForwardWeights, write_only image3d_t lateralWeights, write_only image2d_t hiddenBiases, write_only image3d_t feedBackWeights,
-	int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int2 nextSize, int2 nextSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius, int feedBackRadius, int reconstructionReceptiveRadius, float sparsity, float4 alpha, float weightDecay)
-{
-	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
-
-	float2 inputCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
-	int2 inputCenterPosition = (int2)(inputCenterPositionNormalized.x * inputSizeMinusOne.x, inputCenterPositionNormalized.y * inputSizeMinusOne.y);
-
-	int2 nextCenterPosition = (int2)(inputCenterPositionNormalized.x * nextSizeMinusOne.x, inputCenterPositionNormalized.y * nextSizeMinusOne.y);
-
-	float thisHiddenStatePrev = read_imagef(hiddenStatesPrev, hiddenPosition).x;
-	float thisHiddenStatePrevPrev = read_imagef(hiddenStatesPrevPrev, hiddenPosition).x;
-	float thisActivation = read_imagef(feedBackActivationsPrev, hiddenPosition).x;
-
-	// --------------------------------- Collect Error -------------------------------------
-
-	float sum = 0.0f;
-
-	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
-		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
-			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
-
-			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
-				// Next layer node's receptive field
-				int2 fieldCenter = (int2)(inputPosition.x * inputSizeMinusOneInv.x * layerSizeMinusOne.x, inputPosition.y * inputSizeMinusOneInv.y * layerSizeMinusOne.y);
-
-				int2 fieldLowerBounds = fieldCenter - (int2)(reconstructionReceptiveRadius);
-				int2 fieldUpperBounds = fieldCenter + (int2)(reconstructionReceptiveRadius);
-
-				// Check for containment
-				if (hiddenPosition.x >= fieldLowerBounds.x && hiddenPosition.x <= fieldUpperBounds.x && hiddenPosition.y >= fieldLowerBounds.y && hiddenPosition.y <= fieldUpperBounds.y) {
-					int rdx = hiddenPosition.x - fieldLowerBounds.x;
-					int rdy = hiddenPosition.y - fieldLowerBounds.y;
-
-					float input = read_imagef(inputs, inputPosition).x;
-					float recon = read_imagef(visibleReconstruction, inputPosition).x;
-
-					int weightIndex = rdy + rdx * (reconstructionReceptiveRadius * 2 + 1);
-
-					float weight = read_imagef(reconstructionWeightsPrev, (int4)(inputPosition.x, inputPosition.y, weightIndex, 0)).x;
-
-					sum += (input - recon) * weight;
-				}
-			}
-		}
-
-	float learn = thisHiddenStatePrev * (1.0f - thisHiddenStatePrevPrev);
-	float error = learn * thisActivation * (1.0f - thisActivation) * sum;
-
-	// --------------------------------- Update on Error ---------------------------------
-
-	int wi = 0;
-
-	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
-		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
-			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
-
-			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
-				float input = read_imagef(inputsPrev, inputPosition).x;
-
-				float eligibility = error * input;
-
-				float prevWeight = read_imagef(feedForwardWeightsPrev, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.x * eligibility;
-
-				write_imagef(feedForwardWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0), (float4)(newWeight, 0.0f, 0.0f, 0.0f));
-			}
-
-			wi++;
-		}
-
-	wi = 0;
-
-	for (int dx = -lateralConnectionRadius; dx <= lateralConnectionRadius; dx++)
-		for (int dy = -lateralConnectionRadius; dy <= lateralConnectionRadius; dy++) {
-			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
-
-			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
-				float input = read_imagef(hiddenStatesPrevPrev, layerPosition).x;
-
-				float eligibility = error * input;
-
-				float prevWeight = read_imagef(lateralWeightsPrev, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.y * eligibility;
-
-				write_imagef(lateralWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0), (float4)(newWeight, 0.0f, 0.0f, 0.0f));
-			}
-
-			wi++;
-		}
-
-	wi = 0;
-
-	for (int dx = -feedBackRadius; dx <= feedBackRadius; dx++)
-		for (int dy = -feedBackRadius; dy <= feedBackRadius; dy++) {
-			int2 nextPosition = (int2)(nextCenterPosition.x + dx, nextCenterPosition.y + dy);
-
-			if (nextPosition.x >= 0 && nextPosition.x < nextSize.x && nextPosition.y >= 0 && nextPosition.y < nextSize.y) {
-				float next = read_imagef(nextLayerHiddenStatesPrev, nextPosition).x;
-
-				float eligibility = error * next;
-
-				float prevWeight = read_imagef(feedBackWeightsPrev, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.z * eligibility;
-
-				write_imagef(feedBackWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0), (float4)(newWeight, 0.0f, 0.0f, 0.0f));
-			}
-
-			wi++;
-		}
-
-	float eligibility = error;
-
-	float prevBias = read_imagef(hiddenBiasesPrev, hiddenPosition).x;
-
-	float newBias = (1.0f - weightDecay * thisHiddenStatePrev) * prevBias + alpha.w * eligibility;
-
-	write_imagef(hiddenBiases, hiddenPosition, (float4)(newBias, 0.0f, 0.0f, 0.0f));
-}
-
-void kernel layerHiddenWeightUpdateLast(read_only image2d_t visibleReconstruction, read_only image2d_t inputs, read_only image2d_t inputsPrev, read_only image2d_t feedBackActivationsPrev, read_only image2d_t hiddenStatesPrev, read_only image2d_t hiddenStatesPrevPrev,
-	read_only image3d_t reconstructionWeightsPrev, read_only image3d_t feedForwardWeightsPrev, read_only image3d_t lateralWeightsPrev, read_only image2d_t hiddenBiasesPrev,
-	write_only image3d_t feedForwardWeights, write_only image3d_t lateralWeights, write_only image2d_t hiddenBiases,
-	int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int receptiveFieldRadius, int lateralConnectionRadius, int reconstructionReceptiveRadius, float sparsity, float4 alpha, float weightDecay)
-{
-	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
-
-	float2 inputCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
-	int2 inputCenterPosition = (int2)(inputCenterPositionNormalized.x * inputSizeMinusOne.x, inputCenterPositionNormalized.y * inputSizeMinusOne.y);
-
-	float thisHiddenStatePrev = read_imagef(hiddenStatesPrev, hiddenPosition).x;
-	float thisHiddenStatePrevPrev = read_imagef(hiddenStatesPrevPrev, hiddenPosition).x;
-	float thisActivation = read_imagef(feedBackActivationsPrev, hiddenPosition).x;
-
-	// --------------------------------- Collect Error -------------------------------------
-
-	float sum = 0.0f;
-
-	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
-		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
-			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
-
-			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
-				// Next layer node's receptive field
-				int2 fieldCenter = (int2)(inputPosition.x * inputSizeMinusOneInv.x * layerSizeMinusOne.x, inputPosition.y * inputSizeMinusOneInv.y * layerSizeMinusOne.y);
-
-				int2 fieldLowerBounds = fieldCenter - (int2)(reconstructionReceptiveRadius);
-				int2 fieldUpperBounds = fieldCenter + (int2)(reconstructionReceptiveRadius);
-
-				// Check for containment
-				if (hiddenPosition.x >= fieldLowerBounds.x && hiddenPosition.x <= fieldUpperBounds.x && hiddenPosition.y >= fieldLowerBounds.y && hiddenPosition.y <= fieldUpperBounds.y) {
-					int rdx = hiddenPosition.x - fieldLowerBounds.x;
-					int rdy = hiddenPosition.y - fieldLowerBounds.y;
-
-					float input = read_imagef(inputs, inputPosition).x;
-					float recon = read_imagef(visibleReconstruction, inputPosition).x;
-
-					int weightIndex = rdy + rdx * (reconstructionReceptiveRadius * 2 + 1);
-
-					float weight = read_imagef(reconstructionWeightsPrev, (int4)(inputPosition.x, inputPosition.y, weightIndex, 0)).x;
-
-					sum += (input - recon) * weight;
-				}
-			}
-		}
-
-	float learn = thisHiddenStatePrev * (1.0f - thisHiddenStatePrevPrev);
-	float error = learn * thisActivation * (1.0f - thisActivation) * sum;
-
-	// --------------------------------- Update on Error ---------------------------------
-
-	int wi = 0;
-
-	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
-		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
-			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
-
-			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
-				float input = read_imagef(inputsPrev, inputPosition).x;
-
-				float eligibility = error * input;
-
-				float prevWeight = read_imagef(feedForwardWeightsPrev, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.x * eligibility;
-
-				write_imagef(feedForwardWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0), (float4)(newWeight, 0.0f, 0.0f, 0.0f));
-			}
-
-			wi++;
-		}
-
-	wi = 0;
-
-	for (int dx = -lateralConnectionRadius; dx <= lateralConnectionRadius; dx++)
-		for (int dy = -lateralConnectionRadius; dy <= lateralConnectionRadius; dy++) {
-			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
-
-			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
-				float input = read_imagef(hiddenStatesPrevPrev, layerPosition).x;
-
-				float eligibility = error * input;
-
-				float prevWeight = read_imagef(lateralWeightsPrev, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0)).x;
-
-				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.y * eligibility;
-
-				write_imagef(lateralWeights, (int4)(hiddenPosition.x, hiddenPosition.y, wi, 0), (float4)(newWeight, 0.0f, 0.0f, 0.0f));
-			}
-
-			wi++;
-		}
-
-	float eligibility = error;
-
-	float prevBias = read_imagef(hiddenBiasesPrev, hiddenPosition).x;
-
-	float newBias = (1.0f - weightDecay * thisHiddenStatePrev) * prevBias + alpha.w * eligibility;
-
-	write_imagef(hiddenBiases, hiddenPosition, (float4)(newBias, 0.0f, 0.0f, 0.0f));
-}
-
-void kernel layerVisibleWeightUpdate(read_only image2d_t visibleReconstruction, read_only image2d_t inputs, read_only image2d_t hiddenStatesPrev, read_only image3d_t reconstructionWeightsPrev, read_only image2d_t visibleBiasesPrev, write_only image3d_t reconstructionWeights, write_only image2d_t visibleBiases,
-	int reconstructionReceptiveRadius, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv, float alpha)
-{
-	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
-	float2 layerPositionNormalized = (float2)(visiblePosition.x * inputSizeMinusOneInv.x, visiblePosition.y * inputSizeMinusOneInv.y);
-	int2 layerPositionCenter = (int2)(layerPositionNormalized.x * layerSizeMinusOne.x, layerPositionNormalized.y * layerSizeMinusOne.y);
-
-	float input = read_imagef(inputs, visiblePosition).x;
-	float recon = read_imagef(visibleReconstruction, visiblePosition).x;
-
-	float error = input - recon;
-
-	int wi = 0;
-
-	for (int dx = -reconstructionReceptiveRadius; dx <= reconstructionReceptiveRadius; dx++)
-		for (int dy = -reconstructionReceptiveRadius; dy <= reconstructionReceptiveRadius; dy++) {
-			int2 layerPosition = (int2)(layerPositionCenter.x + dx, layerPositionCenter.y + dy);
-
-			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
-				float source = read_imagef(hiddenStatesPrev, layerPosition).x;
-
-				float eligibility = error * source;
-
-				float prevWeight = read_imagef(reconstructionWeightsPrev, (int4)(visiblePosition.x, visiblePosition.y, wi, 0)).x;
-
-				float newWeight = prevWeight + alpha * eligibility;
-
-				write_imagef(reconstructionWeights, (int4)(visiblePosition.x, visiblePosition.y, wi, 0), (float4)(newWeight, 0.0f, 0.0f, 0.0f));
-			}
-
-			wi++;
-		}
-
-	float eligibility = error;
-
-	float prevBias = read_imagef(visibleBiasesPrev, visiblePosition).x;
-
-	float newBias = prevBias + alpha * eligibility;
-
-	write_imagef(visibleBiases, visiblePosition, (float4)(newBias, 0.0f, 0.0f, 0.0f));
-}
\ No newline at end of file
+constant sampler_t normalizedClampedNearestSampler = CLK_NORMALIZED_COORDS_TRUE |
+CLK_ADDRESS_CLAMP |
+CLK_FILTER_NEAREST;
+
+constant sampler_t normalizedClampedToEdgeNearestSampler = CLK_NORMALIZED_COORDS_TRUE |
+CLK_ADDRESS_CLAMP_TO_EDGE |
+CLK_FILTER_NEAREST;
+
+constant sampler_t unnormalizedClampedNearestSampler = CLK_NORMALIZED_COORDS_FALSE |
+CLK_ADDRESS_CLAMP |
+CLK_FILTER_NEAREST;
+
+constant sampler_t defaultNormalizedSampler = CLK_NORMALIZED_COORDS_TRUE |
+CLK_ADDRESS_CLAMP_TO_EDGE |
+CLK_FILTER_NEAREST;
+
+constant sampler_t defaultUnnormalizedSampler = CLK_NORMALIZED_COORDS_FALSE |
+CLK_ADDRESS_CLAMP_TO_EDGE |
+CLK_FILTER_NEAREST;
+
+// Philox2x32-10 (Salmon et al., Random123), a counter based generator. Every (counter, key) pair gives an independent random pair,
+// so each value draws from its own index without carried state, and the same seed gives the same values in any launch order
+uint2 philox2x32(uint2 counter, uint key) {
+	for (int r = 0; r < 10; r++) {
+		uint hi = mul_hi(0xd256d193u, counter.x);
+		uint lo = 0xd256d193u * counter.x;
+
+		counter = (uint2)(hi ^ key ^ counter.y, lo);
+		key += 0x9e3779b9u;
+	}
+
+	return counter;
+}
+
+// Uniform in [0, 1) for element index of the stream, streams separate the tensors initialized from one seed
+float philoxFloat(uint index, uint stream, uint seed) {
+	return convert_float(philox2x32((uint2)(index, stream), seed).x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Weights are stored in planes of one weight index each, so neighbouring work items read neighbouring addresses
+int weightAddress(int2 position, int wi, int2 size) {
+	return (wi * size.y + position.y) * size.x + position.x;
+}
+
+int unitAddress(int2 position, int2 size) {
+	return position.x + position.y * size.x;
+}
+
+// Weight storage type, chosen with the build options of the program (see WeightType.h). Sums are always accumulated in fp32 and biases stay fp32
+#if defined(HTFE_WEIGHTS_HALF)
+typedef half weight;
+#elif defined(HTFE_WEIGHTS_INT8)
+typedef char weight;
+#else
+typedef float weight;
+#endif
+
+// scale is the per tensor quantization step of int8 weights, other types ignore it
+float loadWeight(global const weight* weights, int address, float scale) {
+#if defined(HTFE_WEIGHTS_HALF)
+	return vload_half(address, weights);
+#elif defined(HTFE_WEIGHTS_INT8)
+	return convert_float(weights[address]) * scale;
+#else
+	return weights[address];
+#endif
+}
+
+// Conversion of fp32 weights to the weight type of this program, scaleInv is 1 unless the weights are int8
+void kernel convertWeights(global const float* source, global weight* destination, float scaleInv) {
+	int i = get_global_id(0);
+
+#if defined(HTFE_WEIGHTS_HALF)
+	vstore_half_rte(source[i], i, destination);
+#elif defined(HTFE_WEIGHTS_INT8)
+	destination[i] = convert_char_sat_rte(source[i] * scaleInv);
+#else
+	destination[i] = source[i];
+#endif
+}
+
+// int8 weights are inference only, so nothing below that writes weights is built for them
+#ifndef HTFE_WEIGHTS_INT8
+void storeWeight(global weight* weights, int address, float value) {
+#if defined(HTFE_WEIGHTS_HALF)
+	vstore_half_rte(value, address, weights);
+#else
+	weights[address] = value;
+#endif
+}
+#endif
+
+float sigmoid(float x) {
+	return 1.0f / (1.0f + exp(-x));
+}
+
+float boostFunction(float trace, float threshold) {
+	return fmin(1.0f, fmax(0.0f, threshold - trace) / threshold);
+}
+
+#ifndef HTFE_WEIGHTS_INT8
+// Runs over (x, y, weight index) of a weight tensor, one work item per weight
+void kernel initializeWeights(global weight* weights, uint seed, uint stream, float scalar, float minWeight, float maxWeight) {
+	int2 position = (int2)(get_global_id(0), get_global_id(1));
+	int2 size = (int2)(get_global_size(0), get_global_size(1));
+	int wi = get_global_id(2);
+
+	int address = weightAddress(position, wi, size);
+
+	storeWeight(weights, address, scalar * (philoxFloat(address, stream, seed) * (maxWeight - minWeight) + minWeight));
+}
+
+void kernel initializeLayerHidden(write_only image2d_t hiddenFeedForwardActivations,
+	write_only image2d_t hiddenFeedBackActivations,
+	write_only image2d_t hiddenStates,
+	global float* hiddenBiases,
+	uint seed, uint stream, float minWeight, float maxWeight)
+{
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+	int2 layerSize = (int2)(get_global_size(0), get_global_size(1));
+
+	write_imagef(hiddenFeedForwardActivations, hiddenPosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
+	write_imagef(hiddenFeedBackActivations, hiddenPosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
+	write_imagef(hiddenStates, hiddenPosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
+
+	int address = unitAddress(hiddenPosition, layerSize);
+
+	hiddenBiases[address] = philoxFloat(address, stream, seed) * (maxWeight - minWeight) + minWeight;
+}
+
+void kernel initializeLayerVisible(global float* visibleBiases, write_only image2d_t visibleReconstruction,
+	uint seed, uint stream, float minWeight, float maxWeight)
+{
+	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
+	int2 visibleSize = (int2)(get_global_size(0), get_global_size(1));
+
+	int address = unitAddress(visiblePosition, visibleSize);
+
+	visibleBiases[address] = philoxFloat(address, stream, seed) * (maxWeight - minWeight) + minWeight;
+
+	write_imagef(visibleReconstruction, visiblePosition, (float4)(0.0f, 0.0f, 0.0f, 0.0f));
+}
+#endif
+
+// Next input of a rollout from the last prediction. mode 0 feeds the prediction back as is, 1 thresholds it,
+// 2 samples every unit as on with the prediction as probability, drawing from stream of seed
+void kernel rolloutFeedBack(read_only image2d_t prediction, write_only image2d_t input, int mode, float threshold, uint seed, uint stream) {
+	int2 position = (int2)(get_global_id(0), get_global_id(1));
+	int2 size = (int2)(get_global_size(0), get_global_size(1));
+
+	float value = read_imagef(prediction, position).x;
+
+	if (mode == 1)
+		value = value > threshold ? 1.0f : 0.0f;
+	else if (mode == 2)
+		value = philoxFloat(unitAddress(position, size), stream, seed) < value ? 1.0f : 0.0f;
+
+	write_imagef(input, position, (float4)(value, 0.0f, 0.0f, 0.0f));
+}
+
+// Programs specialized for a single layer (see HTFE::setSpecializeLayers) define its radii and sizes. The SPECIALIZE_* lines at the top of the kernels
+// replace the matching arguments with these constants, so window loops get fixed trip counts the compiler can unroll. Without the defines they do nothing
+#ifdef HTFE_RECEPTIVE_FIELD_RADIUS
+#define SPECIALIZE_RECEPTIVE_FIELD_RADIUS(radius) radius = HTFE_RECEPTIVE_FIELD_RADIUS
+#else
+#define SPECIALIZE_RECEPTIVE_FIELD_RADIUS(radius)
+#endif
+
+#ifdef HTFE_RECONSTRUCTION_RADIUS
+#define SPECIALIZE_RECONSTRUCTION_RADIUS(radius) radius = HTFE_RECONSTRUCTION_RADIUS
+#else
+#define SPECIALIZE_RECONSTRUCTION_RADIUS(radius)
+#endif
+
+#ifdef HTFE_LATERAL_CONNECTION_RADIUS
+#define SPECIALIZE_LATERAL_CONNECTION_RADIUS(radius) radius = HTFE_LATERAL_CONNECTION_RADIUS
+#else
+#define SPECIALIZE_LATERAL_CONNECTION_RADIUS(radius)
+#endif
+
+#ifdef HTFE_INHIBITION_RADIUS
+#define SPECIALIZE_INHIBITION_RADIUS(radius) radius = HTFE_INHIBITION_RADIUS
+#else
+#define SPECIALIZE_INHIBITION_RADIUS(radius)
+#endif
+
+#ifdef HTFE_FEED_BACK_CONNECTION_RADIUS
+#define SPECIALIZE_FEED_BACK_CONNECTION_RADIUS(radius) radius = HTFE_FEED_BACK_CONNECTION_RADIUS
+#else
+#define SPECIALIZE_FEED_BACK_CONNECTION_RADIUS(radius)
+#endif
+
+#ifdef HTFE_LAYER_WIDTH
+#define SPECIALIZE_LAYER_SIZE(size) size = (int2)(HTFE_LAYER_WIDTH, HTFE_LAYER_HEIGHT)
+#define SPECIALIZE_LAYER_SIZE_MINUS_ONE(sizeMinusOne) sizeMinusOne = (int2)(HTFE_LAYER_WIDTH - 1, HTFE_LAYER_HEIGHT - 1)
+#else
+#define SPECIALIZE_LAYER_SIZE(size)
+#define SPECIALIZE_LAYER_SIZE_MINUS_ONE(sizeMinusOne)
+#endif
+
+#ifdef HTFE_INPUT_WIDTH
+#define SPECIALIZE_INPUT_SIZE(size) size = (int2)(HTFE_INPUT_WIDTH, HTFE_INPUT_HEIGHT)
+#define SPECIALIZE_INPUT_SIZE_MINUS_ONE(sizeMinusOne) sizeMinusOne = (int2)(HTFE_INPUT_WIDTH - 1, HTFE_INPUT_HEIGHT - 1)
+#else
+#define SPECIALIZE_INPUT_SIZE(size)
+#define SPECIALIZE_INPUT_SIZE_MINUS_ONE(sizeMinusOne)
+#endif
+
+#ifdef HTFE_NEXT_WIDTH
+#define SPECIALIZE_NEXT_SIZE(size) size = (int2)(HTFE_NEXT_WIDTH, HTFE_NEXT_HEIGHT)
+#define SPECIALIZE_NEXT_SIZE_MINUS_ONE(sizeMinusOne) sizeMinusOne = (int2)(HTFE_NEXT_WIDTH - 1, HTFE_NEXT_HEIGHT - 1)
+#else
+#define SPECIALIZE_NEXT_SIZE(size)
+#define SPECIALIZE_NEXT_SIZE_MINUS_ONE(sizeMinusOne)
+#endif
+
+// Weighted sum of the radius window of image around center, added to sum in the dx major weight order.
+// Windows inside the image take a path without bounds checks, border windows clamp the loop bounds to the image instead of testing every texel.
+// Both skip exactly the texels outside the image, so the result does not depend on the path
+float windowSum(float sum, read_only image2d_t image, int2 imageSize, int2 center, int radius,
+	global const weight* weights, int2 weightPosition, int2 weightSize, float weightScale)
+{
+	if (center.x >= radius && center.y >= radius && center.x + radius < imageSize.x && center.y + radius < imageSize.y) {
+		int wi = 0;
+
+		for (int dx = -radius; dx <= radius; dx++)
+			for (int dy = -radius; dy <= radius; dy++) {
+				float source = read_imagef(image, center + (int2)(dx, dy)).x;
+
+				float weight = loadWeight(weights, weightAddress(weightPosition, wi, weightSize), weightScale);
+
+				sum += weight * source;
+
+				wi++;
+			}
+	}
+	else {
+		int diameter = 2 * radius + 1;
+
+		int2 lower = max((int2)(-radius), -center);
+		int2 upper = min((int2)(radius), imageSize - (int2)(1) - center);
+
+		for (int dx = lower.x; dx <= upper.x; dx++)
+			for (int dy = lower.y; dy <= upper.y; dy++) {
+				float source = read_imagef(image, center + (int2)(dx, dy)).x;
+
+				float weight = loadWeight(weights, weightAddress(weightPosition, (dy + radius) + (dx + radius) * diameter, weightSize), weightScale);
+
+				sum += weight * source;
+			}
+	}
+
+	return sum;
+}
+
+float hiddenFeedForwardSum(read_only image2d_t inputs, read_only image2d_t hiddenStatesPrev, global const weight* feedForwardWeights, global const weight* lateralWeights, global const float* hiddenBiases,
+	int2 hiddenPosition, int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius, float4 weightScales)
+{
+	float2 inputCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
+	int2 inputCenterPosition = (int2)(inputCenterPositionNormalized.x * inputSizeMinusOne.x, inputCenterPositionNormalized.y * inputSizeMinusOne.y);
+
+	float sum = 0.0f;
+
+	sum = windowSum(sum, inputs, inputSize, inputCenterPosition, receptiveFieldRadius, feedForwardWeights, hiddenPosition, layerSize, weightScales.x);
+	sum = windowSum(sum, hiddenStatesPrev, layerSize, hiddenPosition, lateralConnectionRadius, lateralWeights, hiddenPosition, layerSize, weightScales.y);
+
+	// Bias
+	float bias = hiddenBiases[unitAddress(hiddenPosition, layerSize)];
+
+	sum += bias;
+
+	return sum;
+}
+
+float hiddenFeedBackSum(read_only image2d_t hiddenFeedForwardActivations, read_only image2d_t nextLayerHiddenStates, global const weight* feedBackWeights,
+	int2 hiddenPosition, int2 layerSize, float2 layerSizeMinusOneInv, int2 nextSize, int2 nextSizeMinusOne, int feedBackRadius, float4 weightScales)
+{
+	float2 nextCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
+	int2 nextCenterPosition = (int2)(nextCenterPositionNormalized.x * nextSizeMinusOne.x, nextCenterPositionNormalized.y * nextSizeMinusOne.y);
+
+	float feedForwardActivation = read_imagef(hiddenFeedForwardActivations, hiddenPosition).y;
+
+	float sum = feedForwardActivation;
+
+	sum = windowSum(sum, nextLayerHiddenStates, nextSize, nextCenterPosition, feedBackRadius, feedBackWeights, hiddenPosition, layerSize, weightScales.z);
+
+	return sum;
+}
+
+// Position of the unit a layer position maps to in a layer of targetSizeMinusOne + 1, same rounding as the per texel kernels
+int2 projectPosition(int2 position, float2 sizeMinusOneInv, int2 targetSizeMinusOne) {
+	float2 positionNormalized = (float2)(position.x * sizeMinusOneInv.x, position.y * sizeMinusOneInv.y);
+
+	return (int2)(positionNormalized.x * targetSizeMinusOne.x, positionNormalized.y * targetSizeMinusOne.y);
+}
+
+// Cooperative copy of an image window into local memory. Texels outside the image are stored as 0, so gathers from the patch need no bounds checks
+// and add exactly what the skipped texels of the per texel kernels add. Callers need a barrier before reading the patch
+void loadPatch(read_only image2d_t image, int2 imageSize, int2 patchOrigin, int2 patchSize, local float* patch) {
+	for (int py = get_local_id(1); py < patchSize.y; py += get_local_size(1))
+		for (int px = get_local_id(0); px < patchSize.x; px += get_local_size(0)) {
+			int2 position = patchOrigin + (int2)(px, py);
+
+			float value = 0.0f;
+
+			if (position.x >= 0 && position.x < imageSize.x && position.y >= 0 && position.y < imageSize.y)
+				value = read_imagef(image, position).x;
+
+			patch[px + py * patchSize.x] = value;
+		}
+}
+
+// Work group size limit of the tiled kernels (16 x 16 tiles), the size of their compactPatch counts
+#define HTFE_MAX_GROUP_SIZE 256
+
+// Lists the nonzero entries of a loaded patch as x | y << 16 in dx major order, the order of the dense window loops, so sparse binary states
+// can be gathered without reading the weights of inactive units. Every work item lists a contiguous run of that order at the offset a scan
+// of the run counts gives it, so the list is the same on every run. counts holds an int per work item.
+// Contains barriers: every work item calls it after the barrier that follows loadPatch, and needs another barrier before reading the list
+void compactPatch(local const float* patch, int2 patchSize, local int* active, local int* counts, local int* numActive) {
+	int item = get_local_id(0) + get_local_id(1) * get_local_size(0);
+	int numItems = get_local_size(0) * get_local_size(1);
+
+	int area = patchSize.x * patchSize.y;
+	int runSize = (area + numItems - 1) / numItems;
+	int runStart = min(item * runSize, area);
+	int runEnd = min(runStart + runSize, area);
+
+	int count = 0;
+
+	for (int i = runStart; i < runEnd; i++) {
+		int px = i / patchSize.y;
+		int py = i - px * patchSize.y;
+
+		if (patch[px + py * patchSize.x] != 0.0f)
+			count++;
+	}
+
+	counts[item] = count;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// Exclusive scan of at most HTFE_MAX_GROUP_SIZE counts, short enough for one work item
+	if (item == 0) {
+		int total = 0;
+
+		for (int j = 0; j < numItems; j++) {
+			int runCount = counts[j];
+
+			counts[j] = total;
+			total += runCount;
+		}
+
+		*numActive = total;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int a = counts[item];
+
+	for (int i = runStart; i < runEnd; i++) {
+		int px = i / patchSize.y;
+		int py = i - px * patchSize.y;
+
+		if (patch[px + py * patchSize.x] != 0.0f)
+			active[a++] = px | (py << 16);
+	}
+}
+
+// Weighted sum over the listed patch entries inside the radius window around center, wi follows the dx major order of the dense window gather.
+// The list is in that same order and only leaves out zero states, whose products add nothing, so for finite weights the sum equals the dense gather bit for bit
+float sparsePatchSum(local const float* patch, int2 patchSize, local const int* active, int numActive, int2 center, int radius,
+	global const weight* weights, int2 weightPosition, int2 weightSize, float weightScale)
+{
+	int diameter = 2 * radius + 1;
+
+	float sum = 0.0f;
+
+	for (int a = 0; a < numActive; a++) {
+		int2 position = (int2)(active[a] & 0xffff, active[a] >> 16);
+		int2 offset = position - center + (int2)(radius);
+
+		if (offset.x >= 0 && offset.x < diameter && offset.y >= 0 && offset.y < diameter) {
+			float weight = loadWeight(weights, weightAddress(weightPosition, offset.y + offset.x * diameter, weightSize), weightScale);
+
+			sum += weight * patch[position.x + position.y * patchSize.x];
+		}
+	}
+
+	return sum;
+}
+
+float hiddenFeedForwardSumTiled(local const float* inputPatch, int2 inputPatchOrigin, int2 inputPatchSize, local const float* statesPatch, local const int* statesActive, int numStatesActive, int2 statesPatchOrigin, int2 statesPatchSize,
+	global const weight* feedForwardWeights, global const weight* lateralWeights, global const float* hiddenBiases,
+	int2 hiddenPosition, int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius, float4 weightScales)
+{
+	int2 inputCenter = projectPosition(hiddenPosition, layerSizeMinusOneInv, inputSizeMinusOne) - inputPatchOrigin;
+
+	float sum = 0.0f;
+
+	int wi = 0;
+
+	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
+		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
+			float input = inputPatch[(inputCenter.x + dx) + (inputCenter.y + dy) * inputPatchSize.x];
+
+			float weight = loadWeight(feedForwardWeights, weightAddress(hiddenPosition, wi, layerSize), weightScales.x);
+
+			sum += weight * input;
+
+			wi++;
+		}
+
+	int2 layerCenter = hiddenPosition - statesPatchOrigin;
+
+	// The count is the same for the whole work group, so this branch does not diverge
+	if (numStatesActive < (2 * lateralConnectionRadius + 1) * (2 * lateralConnectionRadius + 1))
+		sum += sparsePatchSum(statesPatch, statesPatchSize, statesActive, numStatesActive, layerCenter, lateralConnectionRadius, lateralWeights, hiddenPosition, layerSize, weightScales.y);
+	else {
+		wi = 0;
+
+		for (int dx = -lateralConnectionRadius; dx <= lateralConnectionRadius; dx++)
+			for (int dy = -lateralConnectionRadius; dy <= lateralConnectionRadius; dy++) {
+				float state = statesPatch[(layerCenter.x + dx) + (layerCenter.y + dy) * statesPatchSize.x];
+
+				float weight = loadWeight(lateralWeights, weightAddress(hiddenPosition, wi, layerSize), weightScales.y);
+
+				sum += weight * state;
+
+				wi++;
+			}
+	}
+
+	// Bias
+	float bias = hiddenBiases[unitAddress(hiddenPosition, layerSize)];
+
+	sum += bias;
+
+	return sum;
+}
+
+float hiddenFeedBackSumTiled(read_only image2d_t hiddenFeedForwardActivations, local const float* nextPatch, int2 nextPatchOrigin, int2 nextPatchSize, global const weight* feedBackWeights,
+	int2 hiddenPosition, int2 layerSize, float2 layerSizeMinusOneInv, int2 nextSizeMinusOne, int feedBackRadius, float4 weightScales)
+{
+	int2 nextCenter = projectPosition(hiddenPosition, layerSizeMinusOneInv, nextSizeMinusOne) - nextPatchOrigin;
+
+	float feedForwardActivation = read_imagef(hiddenFeedForwardActivations, hiddenPosition).y;
+
+	float sum = feedForwardActivation;
+
+	int wi = 0;
+
+	for (int dx = -feedBackRadius; dx <= feedBackRadius; dx++)
+		for (int dy = -feedBackRadius; dy <= feedBackRadius; dy++) {
+			float next = nextPatch[(nextCenter.x + dx) + (nextCenter.y + dy) * nextPatchSize.x];
+
+			float weight = loadWeight(feedBackWeights, weightAddress(hiddenPosition, wi, layerSize), weightScales.z);
+
+			sum += weight * next;
+
+			wi++;
+		}
+
+	return sum;
+}
+
+// Inhibition of the work item's own unit against the activations of a work group tile with an inhibitionRadius halo.
+// Units outside the layer are stored as -1, so they never count as higher
+float tileInhibit(local const float* tileActivations, int2 tilePosition, int tileWidth, int inhibitionRadius, float localActivity) {
+	float thisActivation = tileActivations[tilePosition.x + tilePosition.y * tileWidth];
+
+	float numHigher = 0.0f;
+
+	for (int dx = -inhibitionRadius; dx <= inhibitionRadius; dx++)
+		for (int dy = -inhibitionRadius; dy <= inhibitionRadius; dy++) {
+			if (dx == 0 && dy == 0)
+				continue;
+
+			float activation = tileActivations[(tilePosition.x + dx) + (tilePosition.y + dy) * tileWidth];
+
+			numHigher += activation >= thisActivation ? 1.0f : 0.0f;
+		}
+
+	return numHigher < localActivity ? 1.0f : 0.0f;
+}
+
+void kernel layerHiddenFeedForwardActivate(read_only image2d_t inputs, read_only image2d_t hiddenStatesPrev, global const weight* feedForwardWeights, global const weight* lateralWeights, global const float* hiddenBiases, write_only image2d_t hiddenFeedForwardActivations,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius, float4 weightScales)
+{
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_INPUT_SIZE(inputSize);
+	SPECIALIZE_INPUT_SIZE_MINUS_ONE(inputSizeMinusOne);
+	SPECIALIZE_RECEPTIVE_FIELD_RADIUS(receptiveFieldRadius);
+	SPECIALIZE_LATERAL_CONNECTION_RADIUS(lateralConnectionRadius);
+
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+
+	float sum = hiddenFeedForwardSum(inputs, hiddenStatesPrev, feedForwardWeights, lateralWeights, hiddenBiases,
+		hiddenPosition, layerSize, layerSizeMinusOneInv, inputSize, inputSizeMinusOne, receptiveFieldRadius, lateralConnectionRadius, weightScales);
+
+	write_imagef(hiddenFeedForwardActivations, hiddenPosition, (float4)(sigmoid(sum), sum, 0.0f, 0.0f));
+}
+
+void kernel layerHiddenFeedBackActivate(read_only image2d_t hiddenFeedForwardActivations, read_only image2d_t nextLayerHiddenStates, global const weight* feedBackWeights, write_only image2d_t hiddenFeedBackActivations,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 nextSize, int2 nextSizeMinusOne, int feedBackRadius, float4 weightScales)
+{
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_NEXT_SIZE(nextSize);
+	SPECIALIZE_NEXT_SIZE_MINUS_ONE(nextSizeMinusOne);
+	SPECIALIZE_FEED_BACK_CONNECTION_RADIUS(feedBackRadius);
+
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+
+	float sum = hiddenFeedBackSum(hiddenFeedForwardActivations, nextLayerHiddenStates, feedBackWeights,
+		hiddenPosition, layerSize, layerSizeMinusOneInv, nextSize, nextSizeMinusOne, feedBackRadius, weightScales);
+
+	write_imagef(hiddenFeedBackActivations, hiddenPosition, (float4)(sigmoid(sum), 0.0f, 0.0f, 0.0f));
+}
+
+void kernel layerHiddenInhibit(read_only image2d_t hiddenActivations, read_only image2d_t hiddenStatesPrev, write_only image2d_t hiddenStates,
+	int2 layerSize, int inhibitionRadius, float localActivity)
+{
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_INHIBITION_RADIUS(inhibitionRadius);
+
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+
+	float thisActivation = read_imagef(hiddenActivations, hiddenPosition).x;
+
+	float numHigher = 0.0f;
+
+	// Bounds clamped to the layer, inside it they are the full window
+	int2 lower = max((int2)(-inhibitionRadius), -hiddenPosition);
+	int2 upper = min((int2)(inhibitionRadius), layerSize - (int2)(1) - hiddenPosition);
+
+	for (int dx = lower.x; dx <= upper.x; dx++)
+		for (int dy = lower.y; dy <= upper.y; dy++) {
+			if (dx == 0 && dy == 0)
+				continue;
+
+			float activation = read_imagef(hiddenActivations, hiddenPosition + (int2)(dx, dy)).x;
+
+			numHigher += activation >= thisActivation ? 1.0f : 0.0f;
+		}
+
+	float newState = numHigher < localActivity ? 1.0f : 0.0f;
+
+	write_imagef(hiddenStates, hiddenPosition, (float4)(newState, 0.0f, 0.0f, 0.0f));
+}
+
+// Fused activate + inhibit. Each work group computes the activations of its tile and an inhibitionRadius halo into local memory,
+// so the states are produced without a second launch. Halo units are computed by every group that borders them.
+// The input and recurrent windows of all those units are first loaded cooperatively into local memory, patch sizes come from the host.
+// The global size is rounded up to whole work groups, tileActivations holds (local size + 2 * inhibitionRadius)^2 floats.
+// The recurrent states are binary and sparse, statesActive lists the active ones (as many ints as statesPatch has floats) for the lateral gather
+void kernel layerHiddenFeedForwardActivateInhibit(read_only image2d_t inputs, read_only image2d_t hiddenStatesPrev, global const weight* feedForwardWeights, global const weight* lateralWeights, global const float* hiddenBiases,
+	write_only image2d_t hiddenFeedForwardActivations, write_only image2d_t hiddenStates, local float* tileActivations, local float* inputPatch, local float* statesPatch, local int* statesActive, int2 inputPatchSize, int2 statesPatchSize,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius, int inhibitionRadius, float localActivity, float4 weightScales)
+{
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_INPUT_SIZE(inputSize);
+	SPECIALIZE_INPUT_SIZE_MINUS_ONE(inputSizeMinusOne);
+	SPECIALIZE_RECEPTIVE_FIELD_RADIUS(receptiveFieldRadius);
+	SPECIALIZE_LATERAL_CONNECTION_RADIUS(lateralConnectionRadius);
+	SPECIALIZE_INHIBITION_RADIUS(inhibitionRadius);
+
+	int2 localPosition = (int2)(get_local_id(0), get_local_id(1));
+	int2 localSize = (int2)(get_local_size(0), get_local_size(1));
+	int2 tileSize = localSize + (int2)(2 * inhibitionRadius);
+	int2 tileOrigin = (int2)(get_group_id(0) * localSize.x, get_group_id(1) * localSize.y) - (int2)(inhibitionRadius);
+
+	int2 inputPatchOrigin = projectPosition(max(tileOrigin, (int2)(0)), layerSizeMinusOneInv, inputSizeMinusOne) - (int2)(receptiveFieldRadius);
+	int2 statesPatchOrigin = tileOrigin - (int2)(lateralConnectionRadius);
+
+	local int numStatesActive;
+	local int statesActiveCounts[HTFE_MAX_GROUP_SIZE];
+
+	loadPatch(inputs, inputSize, inputPatchOrigin, inputPatchSize, inputPatch);
+	loadPatch(hiddenStatesPrev, layerSize, statesPatchOrigin, statesPatchSize, statesPatch);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	compactPatch(statesPatch, statesPatchSize, statesActive, statesActiveCounts, &numStatesActive);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int ty = localPosition.y; ty < tileSize.y; ty += localSize.y)
+		for (int tx = localPosition.x; tx < tileSize.x; tx += localSize.x) {
+			int2 hiddenPosition = tileOrigin + (int2)(tx, ty);
+
+			float activation = -1.0f;
+
+			if (hiddenPosition.x >= 0 && hiddenPosition.x < layerSize.x && hiddenPosition.y >= 0 && hiddenPosition.y < layerSize.y) {
+				float sum = hiddenFeedForwardSumTiled(inputPatch, inputPatchOrigin, inputPatchSize, statesPatch, statesActive, numStatesActive, statesPatchOrigin, statesPatchSize, feedForwardWeights, lateralWeights, hiddenBiases,
+					hiddenPosition, layerSize, layerSizeMinusOneInv, inputSizeMinusOne, receptiveFieldRadius, lateralConnectionRadius, weightScales);
+
+				activation = sigmoid(sum);
+
+				// Only the tile interior is written, halo units belong to neighbouring groups
+				if (tx >= inhibitionRadius && tx < inhibitionRadius + localSize.x && ty >= inhibitionRadius && ty < inhibitionRadius + localSize.y)
+					write_imagef(hiddenFeedForwardActivations, hiddenPosition, (float4)(activation, sum, 0.0f, 0.0f));
+			}
+
+			tileActivations[tx + ty * tileSize.x] = activation;
+		}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+
+	if (hiddenPosition.x < layerSize.x && hiddenPosition.y < layerSize.y) {
+		float newState = tileInhibit(tileActivations, localPosition + (int2)(inhibitionRadius), tileSize.x, inhibitionRadius, localActivity);
+
+		write_imagef(hiddenStates, hiddenPosition, (float4)(newState, 0.0f, 0.0f, 0.0f));
+	}
+}
+
+void kernel layerHiddenFeedBackActivateInhibit(read_only image2d_t hiddenFeedForwardActivations, read_only image2d_t nextLayerHiddenStates, global const weight* feedBackWeights,
+	write_only image2d_t hiddenFeedBackActivations, write_only image2d_t hiddenStates, local float* tileActivations, local float* nextPatch, int2 nextPatchSize,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 nextSize, int2 nextSizeMinusOne, int feedBackRadius, int inhibitionRadius, float localActivity, float4 weightScales)
+{
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_NEXT_SIZE(nextSize);
+	SPECIALIZE_NEXT_SIZE_MINUS_ONE(nextSizeMinusOne);
+	SPECIALIZE_FEED_BACK_CONNECTION_RADIUS(feedBackRadius);
+	SPECIALIZE_INHIBITION_RADIUS(inhibitionRadius);
+
+	int2 localPosition = (int2)(get_local_id(0), get_local_id(1));
+	int2 localSize = (int2)(get_local_size(0), get_local_size(1));
+	int2 tileSize = localSize + (int2)(2 * inhibitionRadius);
+	int2 tileOrigin = (int2)(get_group_id(0) * localSize.x, get_group_id(1) * localSize.y) - (int2)(inhibitionRadius);
+
+	int2 nextPatchOrigin = projectPosition(max(tileOrigin, (int2)(0)), layerSizeMinusOneInv, nextSizeMinusOne) - (int2)(feedBackRadius);
+
+	loadPatch(nextLayerHiddenStates, nextSize, nextPatchOrigin, nextPatchSize, nextPatch);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int ty = localPosition.y; ty < tileSize.y; ty += localSize.y)
+		for (int tx = localPosition.x; tx < tileSize.x; tx += localSize.x) {
+			int2 hiddenPosition = tileOrigin + (int2)(tx, ty);
+
+			float activation = -1.0f;
+
+			if (hiddenPosition.x >= 0 && hiddenPosition.x < layerSize.x && hiddenPosition.y >= 0 && hiddenPosition.y < layerSize.y) {
+				float sum = hiddenFeedBackSumTiled(hiddenFeedForwardActivations, nextPatch, nextPatchOrigin, nextPatchSize, feedBackWeights,
+					hiddenPosition, layerSize, layerSizeMinusOneInv, nextSizeMinusOne, feedBackRadius, weightScales);
+
+				activation = sigmoid(sum);
+
+				if (tx >= inhibitionRadius && tx < inhibitionRadius + localSize.x && ty >= inhibitionRadius && ty < inhibitionRadius + localSize.y)
+					write_imagef(hiddenFeedBackActivations, hiddenPosition, (float4)(activation, 0.0f, 0.0f, 0.0f));
+			}
+
+			tileActivations[tx + ty * tileSize.x] = activation;
+		}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+
+	if (hiddenPosition.x < layerSize.x && hiddenPosition.y < layerSize.y) {
+		float newState = tileInhibit(tileActivations, localPosition + (int2)(inhibitionRadius), tileSize.x, inhibitionRadius, localActivity);
+
+		write_imagef(hiddenStates, hiddenPosition, (float4)(newState, 0.0f, 0.0f, 0.0f));
+	}
+}
+
+void kernel layerVisibleReconstruct(read_only image2d_t hiddenStates, global const weight* reconstructionWeights, global const float* visibleBiases, write_only image2d_t visibleReconstruction,
+	int reconstructionReceptiveRadius, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv, float4 weightScales)
+{
+	SPECIALIZE_INPUT_SIZE_MINUS_ONE(inputSizeMinusOne);
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_LAYER_SIZE_MINUS_ONE(layerSizeMinusOne);
+	SPECIALIZE_RECONSTRUCTION_RADIUS(reconstructionReceptiveRadius);
+
+	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
+	float2 layerPositionNormalized = (float2)(visiblePosition.x * inputSizeMinusOneInv.x, visiblePosition.y * inputSizeMinusOneInv.y);
+	int2 layerPositionCenter = (int2)(layerPositionNormalized.x * layerSizeMinusOne.x, layerPositionNormalized.y * layerSizeMinusOne.y);
+
+	int2 visibleSize = inputSizeMinusOne + (int2)(1);
+
+	float sum = 0.0f;
+
+	sum = windowSum(sum, hiddenStates, layerSize, layerPositionCenter, reconstructionReceptiveRadius, reconstructionWeights, visiblePosition, visibleSize, weightScales.w);
+
+	//float bias = visibleBiases[unitAddress(visiblePosition, visibleSize)];
+
+	//sum += bias;
+
+	write_imagef(visibleReconstruction, visiblePosition, (float4)(sum, 0.0f, 0.0f, 0.0f));
+}
+
+// Reconstruction from a local copy of the hidden states window of the work group, global size rounded up to whole work groups.
+// hiddenActive lists the active states of the window (as many ints as hiddenPatch has floats), sparse windows only read the weights of those
+void kernel layerVisibleReconstructTiled(read_only image2d_t hiddenStates, global const weight* reconstructionWeights, global const float* visibleBiases, write_only image2d_t visibleReconstruction,
+	local float* hiddenPatch, local int* hiddenActive, int2 hiddenPatchSize,
+	int reconstructionReceptiveRadius, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv, float4 weightScales)
+{
+	SPECIALIZE_INPUT_SIZE_MINUS_ONE(inputSizeMinusOne);
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_LAYER_SIZE_MINUS_ONE(layerSizeMinusOne);
+	SPECIALIZE_RECONSTRUCTION_RADIUS(reconstructionReceptiveRadius);
+
+	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
+	int2 groupOrigin = (int2)(get_group_id(0) * get_local_size(0), get_group_id(1) * get_local_size(1));
+
+	int2 visibleSize = inputSizeMinusOne + (int2)(1);
+
+	int2 hiddenPatchOrigin = projectPosition(groupOrigin, inputSizeMinusOneInv, layerSizeMinusOne) - (int2)(reconstructionReceptiveRadius);
+
+	local int numHiddenActive;
+	local int hiddenActiveCounts[HTFE_MAX_GROUP_SIZE];
+
+	loadPatch(hiddenStates, layerSize, hiddenPatchOrigin, hiddenPatchSize, hiddenPatch);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	compactPatch(hiddenPatch, hiddenPatchSize, hiddenActive, hiddenActiveCounts, &numHiddenActive);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (visiblePosition.x >= visibleSize.x || visiblePosition.y >= visibleSize.y)
+		return;
+
+	int2 layerCenter = projectPosition(visiblePosition, inputSizeMinusOneInv, layerSizeMinusOne) - hiddenPatchOrigin;
+
+	float sum = 0.0f;
+
+	if (numHiddenActive < (2 * reconstructionReceptiveRadius + 1) * (2 * reconstructionReceptiveRadius + 1))
+		sum = sparsePatchSum(hiddenPatch, hiddenPatchSize, hiddenActive, numHiddenActive, layerCenter, reconstructionReceptiveRadius, reconstructionWeights, visiblePosition, visibleSize, weightScales.w);
+	else {
+		int wi = 0;
+
+		for (int dx = -reconstructionReceptiveRadius; dx <= reconstructionReceptiveRadius; dx++)
+			for (int dy = -reconstructionReceptiveRadius; dy <= reconstructionReceptiveRadius; dy++) {
+				float source = hiddenPatch[(layerCenter.x + dx) + (layerCenter.y + dy) * hiddenPatchSize.x];
+
+				float weight = loadWeight(reconstructionWeights, weightAddress(visiblePosition, wi, visibleSize), weightScales.w);
+
+				sum += source * weight;
+
+				wi++;
+			}
+	}
+
+	write_imagef(visibleReconstruction, visiblePosition, (float4)(sum, 0.0f, 0.0f, 0.0f));
+}
+
+#ifndef HTFE_WEIGHTS_INT8
+// Reconstruction error backpropagated to a hidden unit. The host lists, per hidden unit and in receptive field order, every visible unit inside
+// its feed forward receptive field whose reconstruction field contains it, packed as (x | y << 16, reconstruction weight address)
+float reconstructionErrorSum(read_only image2d_t visibleReconstruction, read_only image2d_t inputs, global const weight* reconstructionWeights,
+	global const int* reconstructionErrorOffsets, global const int2* reconstructionErrorEntries, int2 hiddenPosition, int2 layerSize)
+{
+	int unit = unitAddress(hiddenPosition, layerSize);
+
+	int entriesEnd = reconstructionErrorOffsets[unit + 1];
+
+	float sum = 0.0f;
+
+	for (int e = reconstructionErrorOffsets[unit]; e < entriesEnd; e++) {
+		int2 entry = reconstructionErrorEntries[e];
+
+		int2 inputPosition = (int2)(entry.x & 0xffff, entry.x >> 16);
+
+		float input = read_imagef(inputs, inputPosition).x;
+		float recon = read_imagef(visibleReconstruction, inputPosition).x;
+
+		float weight = loadWeight(reconstructionWeights, entry.y, 1.0f);
+
+		sum += (input - recon) * weight;
+	}
+
+	return sum;
+}
+
+// Worklist of the units with an active previous state, packed as x | y << 16. Units with an inactive previous state have no learning signal
+// and no decay, so the hidden weight update would write their weights back unchanged and only runs over this list. numActiveUnits must be zeroed first
+void kernel layerListActiveUnits(read_only image2d_t hiddenStatesPrev, global int* activeUnits, global int* numActiveUnits) {
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+
+	if (read_imagef(hiddenStatesPrev, hiddenPosition).x != 0.0f)
+		activeUnits[atomic_inc(numActiveUnits)] = hiddenPosition.x | (hiddenPosition.y << 16);
+}
+
+void kernel layerHiddenWeightUpdate(read_only image2d_t visibleReconstruction, read_only image2d_t inputs, read_only image2d_t inputsPrev, read_only image2d_t feedBackActivationsPrev, read_only image2d_t hiddenStatesPrev, read_only image2d_t hiddenStatesPrevPrev, read_only image2d_t nextLayerHiddenStatesPrev,
+	global const int* activeUnits, global const int* numActiveUnits, global const weight* reconstructionWeights, global const int* reconstructionErrorOffsets, global const int2* reconstructionErrorEntries, global weight* feedForwardWeights, global weight* lateralWeights, global float* hiddenBiases, global weight* feedBackWeights,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, int2 nextSize, int2 nextSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius, int feedBackRadius, float sparsity, float4 alpha, float weightDecay)
+{
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_INPUT_SIZE(inputSize);
+	SPECIALIZE_INPUT_SIZE_MINUS_ONE(inputSizeMinusOne);
+	SPECIALIZE_NEXT_SIZE(nextSize);
+	SPECIALIZE_NEXT_SIZE_MINUS_ONE(nextSizeMinusOne);
+	SPECIALIZE_RECEPTIVE_FIELD_RADIUS(receptiveFieldRadius);
+	SPECIALIZE_LATERAL_CONNECTION_RADIUS(lateralConnectionRadius);
+	SPECIALIZE_FEED_BACK_CONNECTION_RADIUS(feedBackRadius);
+
+	// Launched over the layer area, work items past the end of the worklist return right away so the count is never read back
+	if (get_global_id(0) >= *numActiveUnits)
+		return;
+
+	int activeUnit = activeUnits[get_global_id(0)];
+
+	int2 hiddenPosition = (int2)(activeUnit & 0xffff, activeUnit >> 16);
+
+	float2 inputCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
+	int2 inputCenterPosition = (int2)(inputCenterPositionNormalized.x * inputSizeMinusOne.x, inputCenterPositionNormalized.y * inputSizeMinusOne.y);
+
+	int2 nextCenterPosition = (int2)(inputCenterPositionNormalized.x * nextSizeMinusOne.x, inputCenterPositionNormalized.y * nextSizeMinusOne.y);
+
+	float thisHiddenStatePrev = read_imagef(hiddenStatesPrev, hiddenPosition).x;
+	float thisHiddenStatePrevPrev = read_imagef(hiddenStatesPrevPrev, hiddenPosition).x;
+	float thisActivation = read_imagef(feedBackActivationsPrev, hiddenPosition).x;
+
+	// --------------------------------- Collect Error -------------------------------------
+
+	float sum = reconstructionErrorSum(visibleReconstruction, inputs, reconstructionWeights, reconstructionErrorOffsets, reconstructionErrorEntries, hiddenPosition, layerSize);
+
+	float learn = thisHiddenStatePrev * (1.0f - thisHiddenStatePrevPrev);
+	float error = learn * thisActivation * (1.0f - thisActivation) * sum;
+
+	// --------------------------------- Update on Error ---------------------------------
+
+	int wi = 0;
+
+	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
+		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
+			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
+
+			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
+				float input = read_imagef(inputsPrev, inputPosition).x;
+
+				float eligibility = error * input;
+
+				int address = weightAddress(hiddenPosition, wi, layerSize);
+
+				float prevWeight = loadWeight(feedForwardWeights, address, 1.0f);
+
+				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.x * eligibility;
+
+				storeWeight(feedForwardWeights, address, newWeight);
+			}
+
+			wi++;
+		}
+
+	wi = 0;
+
+	for (int dx = -lateralConnectionRadius; dx <= lateralConnectionRadius; dx++)
+		for (int dy = -lateralConnectionRadius; dy <= lateralConnectionRadius; dy++) {
+			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
+
+			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
+				float input = read_imagef(hiddenStatesPrevPrev, layerPosition).x;
+
+				float eligibility = error * input;
+
+				int address = weightAddress(hiddenPosition, wi, layerSize);
+
+				float prevWeight = loadWeight(lateralWeights, address, 1.0f);
+
+				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.y * eligibility;
+
+				storeWeight(lateralWeights, address, newWeight);
+			}
+
+			wi++;
+		}
+
+	wi = 0;
+
+	for (int dx = -feedBackRadius; dx <= feedBackRadius; dx++)
+		for (int dy = -feedBackRadius; dy <= feedBackRadius; dy++) {
+			int2 nextPosition = (int2)(nextCenterPosition.x + dx, nextCenterPosition.y + dy);
+
+			if (nextPosition.x >= 0 && nextPosition.x < nextSize.x && nextPosition.y >= 0 && nextPosition.y < nextSize.y) {
+				float next = read_imagef(nextLayerHiddenStatesPrev, nextPosition).x;
+
+				float eligibility = error * next;
+
+				int address = weightAddress(hiddenPosition, wi, layerSize);
+
+				float prevWeight = loadWeight(feedBackWeights, address, 1.0f);
+
+				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.z * eligibility;
+
+				storeWeight(feedBackWeights, address, newWeight);
+			}
+
+			wi++;
+		}
+
+	float eligibility = error;
+
+	float prevBias = hiddenBiases[unitAddress(hiddenPosition, layerSize)];
+
+	float newBias = (1.0f - weightDecay * thisHiddenStatePrev) * prevBias + alpha.w * eligibility;
+
+	hiddenBiases[unitAddress(hiddenPosition, layerSize)] = newBias;
+}
+
+void kernel layerHiddenWeightUpdateLast(read_only image2d_t visibleReconstruction, read_only image2d_t inputs, read_only image2d_t inputsPrev, read_only image2d_t feedBackActivationsPrev, read_only image2d_t hiddenStatesPrev, read_only image2d_t hiddenStatesPrevPrev,
+	global const int* activeUnits, global const int* numActiveUnits, global const weight* reconstructionWeights, global const int* reconstructionErrorOffsets, global const int2* reconstructionErrorEntries, global weight* feedForwardWeights, global weight* lateralWeights, global float* hiddenBiases,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius, float sparsity, float4 alpha, float weightDecay)
+{
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_INPUT_SIZE(inputSize);
+	SPECIALIZE_INPUT_SIZE_MINUS_ONE(inputSizeMinusOne);
+	SPECIALIZE_RECEPTIVE_FIELD_RADIUS(receptiveFieldRadius);
+	SPECIALIZE_LATERAL_CONNECTION_RADIUS(lateralConnectionRadius);
+
+	// Launched over the layer area, work items past the end of the worklist return right away so the count is never read back
+	if (get_global_id(0) >= *numActiveUnits)
+		return;
+
+	int activeUnit = activeUnits[get_global_id(0)];
+
+	int2 hiddenPosition = (int2)(activeUnit & 0xffff, activeUnit >> 16);
+
+	float2 inputCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
+	int2 inputCenterPosition = (int2)(inputCenterPositionNormalized.x * inputSizeMinusOne.x, inputCenterPositionNormalized.y * inputSizeMinusOne.y);
+
+	float thisHiddenStatePrev = read_imagef(hiddenStatesPrev, hiddenPosition).x;
+	float thisHiddenStatePrevPrev = read_imagef(hiddenStatesPrevPrev, hiddenPosition).x;
+	float thisActivation = read_imagef(feedBackActivationsPrev, hiddenPosition).x;
+
+	// --------------------------------- Collect Error -------------------------------------
+
+	float sum = reconstructionErrorSum(visibleReconstruction, inputs, reconstructionWeights, reconstructionErrorOffsets, reconstructionErrorEntries, hiddenPosition, layerSize);
+
+	float learn = thisHiddenStatePrev * (1.0f - thisHiddenStatePrevPrev);
+	float error = learn * thisActivation * (1.0f - thisActivation) * sum;
+
+	// --------------------------------- Update on Error ---------------------------------
+
+	int wi = 0;
+
+	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
+		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
+			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
+
+			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
+				float input = read_imagef(inputsPrev, inputPosition).x;
+
+				float eligibility = error * input;
+
+				int address = weightAddress(hiddenPosition, wi, layerSize);
+
+				float prevWeight = loadWeight(feedForwardWeights, address, 1.0f);
+
+				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.x * eligibility;
+
+				storeWeight(feedForwardWeights, address, newWeight);
+			}
+
+			wi++;
+		}
+
+	wi = 0;
+
+	for (int dx = -lateralConnectionRadius; dx <= lateralConnectionRadius; dx++)
+		for (int dy = -lateralConnectionRadius; dy <= lateralConnectionRadius; dy++) {
+			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
+
+			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
+				float input = read_imagef(hiddenStatesPrevPrev, layerPosition).x;
+
+				float eligibility = error * input;
+
+				int address = weightAddress(hiddenPosition, wi, layerSize);
+
+				float prevWeight = loadWeight(lateralWeights, address, 1.0f);
+
+				float newWeight = (1.0f - weightDecay * thisHiddenStatePrev) * prevWeight + alpha.y * eligibility;
+
+				storeWeight(lateralWeights, address, newWeight);
+			}
+
+			wi++;
+		}
+
+	float eligibility = error;
+
+	float prevBias = hiddenBiases[unitAddress(hiddenPosition, layerSize)];
+
+	float newBias = (1.0f - weightDecay * thisHiddenStatePrev) * prevBias + alpha.w * eligibility;
+
+	hiddenBiases[unitAddress(hiddenPosition, layerSize)] = newBias;
+}
+
+void kernel layerVisibleWeightUpdate(read_only image2d_t visibleReconstruction, read_only image2d_t inputs, read_only image2d_t hiddenStatesPrev, global weight* reconstructionWeights, global float* visibleBiases,
+	int reconstructionReceptiveRadius, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv, float alpha)
+{
+	SPECIALIZE_INPUT_SIZE_MINUS_ONE(inputSizeMinusOne);
+	SPECIALIZE_LAYER_SIZE(layerSize);
+	SPECIALIZE_LAYER_SIZE_MINUS_ONE(layerSizeMinusOne);
+	SPECIALIZE_RECONSTRUCTION_RADIUS(reconstructionReceptiveRadius);
+
+	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
+	float2 layerPositionNormalized = (float2)(visiblePosition.x * inputSizeMinusOneInv.x, visiblePosition.y * inputSizeMinusOneInv.y);
+	int2 layerPositionCenter = (int2)(layerPositionNormalized.x * layerSizeMinusOne.x, layerPositionNormalized.y * layerSizeMinusOne.y);
+
+	int2 visibleSize = inputSizeMinusOne + (int2)(1);
+
+	float input = read_imagef(inputs, visiblePosition).x;
+	float recon = read_imagef(visibleReconstruction, visiblePosition).x;
+
+	float error = input - recon;
+
+	int wi = 0;
+
+	for (int dx = -reconstructionReceptiveRadius; dx <= reconstructionReceptiveRadius; dx++)
+		for (int dy = -reconstructionReceptiveRadius; dy <= reconstructionReceptiveRadius; dy++) {
+			int2 layerPosition = (int2)(layerPositionCenter.x + dx, layerPositionCenter.y + dy);
+
+			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
+				float source = read_imagef(hiddenStatesPrev, layerPosition).x;
+
+				// Inactive sources leave their weight unchanged, skip the read and write back
+				if (source != 0.0f) {
+					float eligibility = error * source;
+
+					int address = weightAddress(visiblePosition, wi, visibleSize);
+
+					float prevWeight = loadWeight(reconstructionWeights, address, 1.0f);
+
+					float newWeight = prevWeight + alpha * eligibility;
+
+					storeWeight(reconstructionWeights, address, newWeight);
+				}
+			}
+
+			wi++;
+		}
+
+	float eligibility = error;
+
+	float prevBias = visibleBiases[unitAddress(visiblePosition, visibleSize)];
+
+	float newBias = prevBias + alpha * eligibility;
+
+	visibleBiases[unitAddress(visiblePosition, visibleSize)] = newBias;
+}
+
+// ------------------------------------------------------------------------------
+// -------------------- Batched (shared weights, per-stream state) --------------
+// ------------------------------------------------------------------------------
+
+// Per-stream images are image3d_t with the stream index as z, so each kernel launches once over (width, height, batchSize)
+// Batches share the weights of a learning HTFE, so they are not built for int8 weights either
+
+void kernel layerHiddenFeedForwardActivateBatch(read_only image3d_t inputs, read_only image3d_t hiddenStatesPrev, global const weight* feedForwardWeights, global const weight* lateralWeights, global const float* hiddenBiases, write_only image3d_t hiddenFeedForwardActivations,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 inputSize, int2 inputSizeMinusOne, int receptiveFieldRadius, int lateralConnectionRadius)
+{
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+	int stream = get_global_id(2);
+
+	float2 inputCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
+	int2 inputCenterPosition = (int2)(inputCenterPositionNormalized.x * inputSizeMinusOne.x, inputCenterPositionNormalized.y * inputSizeMinusOne.y);
+
+	float sum = 0.0f;
+
+	int wi = 0;
+
+	for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
+		for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
+			int2 inputPosition = (int2)(inputCenterPosition.x + dx, inputCenterPosition.y + dy);
+
+			if (inputPosition.x >= 0 && inputPosition.x < inputSize.x && inputPosition.y >= 0 && inputPosition.y < inputSize.y) {
+				float input = read_imagef(inputs, (int4)(inputPosition.x, inputPosition.y, stream, 0)).x;
+
+				float weight = loadWeight(feedForwardWeights, weightAddress(hiddenPosition, wi, layerSize), 1.0f);
+
+				sum += weight * input;
+			}
+
+			wi++;
+		}
+
+	wi = 0;
+
+	for (int dx = -lateralConnectionRadius; dx <= lateralConnectionRadius; dx++)
+		for (int dy = -lateralConnectionRadius; dy <= lateralConnectionRadius; dy++) {
+			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
+
+			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
+				float state = read_imagef(hiddenStatesPrev, (int4)(layerPosition.x, layerPosition.y, stream, 0)).x;
+
+				float weight = loadWeight(lateralWeights, weightAddress(hiddenPosition, wi, layerSize), 1.0f);
+
+				sum += weight * state;
+			}
+
+			wi++;
+		}
+
+	// Bias
+	float bias = hiddenBiases[unitAddress(hiddenPosition, layerSize)];
+
+	sum += bias;
+
+	write_imagef(hiddenFeedForwardActivations, (int4)(hiddenPosition.x, hiddenPosition.y, stream, 0), (float4)(sigmoid(sum), sum, 0.0f, 0.0f));
+}
+
+void kernel layerHiddenFeedBackActivateBatch(read_only image3d_t hiddenFeedForwardActivations, read_only image3d_t nextLayerHiddenStates, global const weight* feedBackWeights, write_only image3d_t hiddenFeedBackActivations,
+	int2 layerSize, float2 layerSizeMinusOneInv, int2 nextSize, int2 nextSizeMinusOne, int feedBackRadius)
+{
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+	int stream = get_global_id(2);
+
+	float2 nextCenterPositionNormalized = (float2)(hiddenPosition.x * layerSizeMinusOneInv.x, hiddenPosition.y * layerSizeMinusOneInv.y);
+	int2 nextCenterPosition = (int2)(nextCenterPositionNormalized.x * nextSizeMinusOne.x, nextCenterPositionNormalized.y * nextSizeMinusOne.y);
+
+	float feedForwardActivation = read_imagef(hiddenFeedForwardActivations, (int4)(hiddenPosition.x, hiddenPosition.y, stream, 0)).y;
+
+	float sum = feedForwardActivation;
+
+	int wi = 0;
+
+	for (int dx = -feedBackRadius; dx <= feedBackRadius; dx++)
+		for (int dy = -feedBackRadius; dy <= feedBackRadius; dy++) {
+			int2 nextPosition = (int2)(nextCenterPosition.x + dx, nextCenterPosition.y + dy);
+
+			if (nextPosition.x >= 0 && nextPosition.x < nextSize.x && nextPosition.y >= 0 && nextPosition.y < nextSize.y) {
+				float next = read_imagef(nextLayerHiddenStates, (int4)(nextPosition.x, nextPosition.y, stream, 0)).x;
+
+				float weight = loadWeight(feedBackWeights, weightAddress(hiddenPosition, wi, layerSize), 1.0f);
+
+				sum += weight * next;
+			}
+
+			wi++;
+		}
+
+	write_imagef(hiddenFeedBackActivations, (int4)(hiddenPosition.x, hiddenPosition.y, stream, 0), (float4)(sigmoid(sum), 0.0f, 0.0f, 0.0f));
+}
+
+void kernel layerHiddenInhibitBatch(read_only image3d_t hiddenActivations, write_only image3d_t hiddenStates,
+	int2 layerSize, int inhibitionRadius, float localActivity)
+{
+	int2 hiddenPosition = (int2)(get_global_id(0), get_global_id(1));
+	int stream = get_global_id(2);
+
+	float thisActivation = read_imagef(hiddenActivations, (int4)(hiddenPosition.x, hiddenPosition.y, stream, 0)).x;
+
+	float numHigher = 0.0f;
+
+	for (int dx = -inhibitionRadius; dx <= inhibitionRadius; dx++)
+		for (int dy = -inhibitionRadius; dy <= inhibitionRadius; dy++) {
+			if (dx == 0 && dy == 0)
+				continue;
+
+			int2 layerPosition = (int2)(hiddenPosition.x + dx, hiddenPosition.y + dy);
+
+			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
+				float activation = read_imagef(hiddenActivations, (int4)(layerPosition.x, layerPosition.y, stream, 0)).x;
+
+				numHigher += activation >= thisActivation ? 1.0f : 0.0f;
+			}
+		}
+
+	float newState = numHigher < localActivity ? 1.0f : 0.0f;
+
+	write_imagef(hiddenStates, (int4)(hiddenPosition.x, hiddenPosition.y, stream, 0), (float4)(newState, 0.0f, 0.0f, 0.0f));
+}
+
+void kernel layerVisibleReconstructBatch(read_only image3d_t hiddenStates, global const weight* reconstructionWeights, write_only image3d_t visibleReconstruction,
+	int reconstructionReceptiveRadius, int2 inputSizeMinusOne, float2 inputSizeMinusOneInv, int2 layerSize, int2 layerSizeMinusOne, float2 layerSizeMinusOneInv)
+{
+	int2 visiblePosition = (int2)(get_global_id(0), get_global_id(1));
+	int stream = get_global_id(2);
+
+	float2 layerPositionNormalized = (float2)(visiblePosition.x * inputSizeMinusOneInv.x, visiblePosition.y * inputSizeMinusOneInv.y);
+	int2 layerPositionCenter = (int2)(layerPositionNormalized.x * layerSizeMinusOne.x, layerPositionNormalized.y * layerSizeMinusOne.y);
+
+	int2 visibleSize = inputSizeMinusOne + (int2)(1);
+
+	float sum = 0.0f;
+
+	int wi = 0;
+
+	for (int dx = -reconstructionReceptiveRadius; dx <= reconstructionReceptiveRadius; dx++)
+		for (int dy = -reconstructionReceptiveRadius; dy <= reconstructionReceptiveRadius; dy++) {
+			int2 layerPosition = (int2)(layerPositionCenter.x + dx, layerPositionCenter.y + dy);
+
+			if (layerPosition.x >= 0 && layerPosition.x < layerSize.x && layerPosition.y >= 0 && layerPosition.y < layerSize.y) {
+				float source = read_imagef(hiddenStates, (int4)(layerPosition.x, layerPosition.y, stream, 0)).x;
+
+				float weight = loadWeight(reconstructionWeights, weightAddress(visiblePosition, wi, visibleSize), 1.0f);
+
+				sum += source * weight;
+			}
+
+			wi++;
+		}
+
+	write_imagef(visibleReconstruction, (int4)(visiblePosition.x, visiblePosition.y, stream, 0), (float4)(sum, 0.0f, 0.0f, 0.0f));
+}
+#endif
\ No newline at end of file
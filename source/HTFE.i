@@ -1,20 +1,311 @@
-%begin %{
-#include <cmath>
-#include <iostream>
-%}
-%module htfe
-
-%{
-#include "htfe/HTFE.h"
-%}
-
-%include "std_string.i"
-%include "std_vector.i"
-
-namespace std {
-   %template(vectorld) vector<htfe::LayerDesc>;
-};
-
-%include "htfe/HTFE.h"
-%include "system/ComputeSystem.h"
-%include "system/ComputeProgram.h"
\ No newline at end of file
+%begin %{
+#include <cmath>
+#include <iostream>
+%}
+%module htfe
+
+%{
+#include "htfe/WeightType.h"
+#include "htfe/HTFE.h"
+#include "htfe/HTFECPU.h"
+#include "htfe/HTFEBatch.h"
+#include "htfe/HTFEFrozen.h"
+#include "system/Profiler.h"
+
+#include <cstring>
+
+namespace {
+	// Borrows the memory of a C contiguous float32 buffer protocol object (numpy array, array.array('f'), memoryview, ...) of at least minSize values.
+	// Sets a Python exception and returns false otherwise, on success the view is released with PyBuffer_Release
+	bool getFloatBuffer(PyObject* object, Py_buffer* pView, bool writable, Py_ssize_t minSize) {
+		if (PyObject_GetBuffer(object, pView, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0)) != 0)
+			return false;
+
+		size_t formatLength = pView->format != nullptr ? std::strlen(pView->format) : 0;
+
+		// Native or little endian float, "f", "@f", "=f" or "<f"
+		if (pView->itemsize != sizeof(float) || formatLength == 0 || pView->format[formatLength - 1] != 'f' || pView->format[0] == '>' || pView->format[0] == '!') {
+			PyBuffer_Release(pView);
+			PyErr_SetString(PyExc_TypeError, "expected a C contiguous float32 buffer");
+
+			return false;
+		}
+
+		if (pView->len < minSize * static_cast<Py_ssize_t>(sizeof(float))) {
+			PyBuffer_Release(pView);
+			PyErr_Format(PyExc_ValueError, "buffer holds %zd values, expected at least %zd", pView->len / static_cast<Py_ssize_t>(sizeof(float)), minSize);
+
+			return false;
+		}
+
+		return true;
+	}
+
+	PyObject* copyFromBuffer(PyObject* object, float* pDestination, int size) {
+		Py_buffer view;
+
+		if (!getFloatBuffer(object, &view, false, size))
+			return nullptr;
+
+		std::memcpy(pDestination, view.buf, size * sizeof(float));
+
+		PyBuffer_Release(&view);
+
+		Py_RETURN_NONE;
+	}
+
+	PyObject* copyToBuffer(PyObject* object, const float* pSource, int size) {
+		Py_buffer view;
+
+		if (!getFloatBuffer(object, &view, true, size))
+			return nullptr;
+
+		std::memcpy(view.buf, pSource, size * sizeof(float));
+
+		PyBuffer_Release(&view);
+
+		Py_RETURN_NONE;
+	}
+
+	// Exports float32 memory owned by a model through the buffer protocol and holds a reference to the model's Python object,
+	// so views onto it keep the model alive
+	struct FloatExporter {
+		PyObject_HEAD
+		PyObject* _owner;
+		float* _pData;
+		Py_ssize_t _size;
+		Py_ssize_t _itemSize;
+		bool _writable;
+	};
+
+	int floatExporterGetBuffer(PyObject* object, Py_buffer* pView, int flags) {
+		FloatExporter* pExporter = reinterpret_cast<FloatExporter*>(object);
+
+		if ((flags & PyBUF_WRITABLE) != 0 && !pExporter->_writable) {
+			PyErr_SetString(PyExc_BufferError, "view is read only");
+			pView->obj = nullptr;
+
+			return -1;
+		}
+
+		pView->obj = object;
+		pView->buf = pExporter->_pData;
+		pView->len = pExporter->_size * pExporter->_itemSize;
+		pView->readonly = pExporter->_writable ? 0 : 1;
+		pView->itemsize = pExporter->_itemSize;
+		pView->format = (flags & PyBUF_FORMAT) != 0 ? const_cast<char*>("f") : nullptr;
+		pView->ndim = 1;
+		pView->shape = (flags & PyBUF_ND) != 0 ? &pExporter->_size : nullptr;
+		pView->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &pExporter->_itemSize : nullptr;
+		pView->suboffsets = nullptr;
+		pView->internal = nullptr;
+
+		Py_INCREF(object);
+
+		return 0;
+	}
+
+	void floatExporterDealloc(PyObject* object) {
+		Py_XDECREF(reinterpret_cast<FloatExporter*>(object)->_owner);
+
+		PyObject_Del(object);
+	}
+
+	PyBufferProcs floatExporterBufferProcs = { floatExporterGetBuffer, nullptr };
+
+	PyTypeObject floatExporterType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+	// float32 memoryview onto memory owned by the model whose Python object is owner
+	PyObject* floatView(PyObject* owner, float* pData, int size, bool writable) {
+		if (floatExporterType.tp_name == nullptr) {
+			floatExporterType.tp_name = "htfe.FloatExporter";
+			floatExporterType.tp_basicsize = sizeof(FloatExporter);
+			floatExporterType.tp_flags = Py_TPFLAGS_DEFAULT;
+			floatExporterType.tp_dealloc = floatExporterDealloc;
+			floatExporterType.tp_as_buffer = &floatExporterBufferProcs;
+
+			if (PyType_Ready(&floatExporterType) != 0) {
+				floatExporterType.tp_name = nullptr;
+
+				return nullptr;
+			}
+		}
+
+		FloatExporter* pExporter = PyObject_New(FloatExporter, &floatExporterType);
+
+		if (pExporter == nullptr)
+			return nullptr;
+
+		Py_INCREF(owner);
+
+		pExporter->_owner = owner;
+		pExporter->_pData = pData;
+		pExporter->_size = size;
+		pExporter->_itemSize = sizeof(float);
+		pExporter->_writable = writable;
+
+		PyObject* view = PyMemoryView_FromObject(reinterpret_cast<PyObject*>(pExporter));
+
+		Py_DECREF(pExporter);
+
+		return view;
+	}
+
+	// Hands both buffers to trainSequence or predictSequence in place, predictions may be None when learning
+	PyObject* runSequenceBuffers(htfe::HTFE &h, sys::ComputeSystem &cs, PyObject* inputs, PyObject* predictions, bool learning) {
+		Py_buffer inputView;
+
+		if (!getFloatBuffer(inputs, &inputView, false, 0))
+			return nullptr;
+
+		int numSteps = inputView.len / sizeof(float) / h.getInputSize();
+
+		if (inputView.len / sizeof(float) % h.getInputSize() != 0) {
+			PyBuffer_Release(&inputView);
+			PyErr_SetString(PyExc_ValueError, "inputs is not a whole number of frames");
+
+			return nullptr;
+		}
+
+		Py_buffer predictionView;
+
+		bool hasPredictions = predictions != Py_None;
+
+		if (!hasPredictions && !learning) {
+			PyBuffer_Release(&inputView);
+			PyErr_SetString(PyExc_ValueError, "predictSequence needs a predictions buffer");
+
+			return nullptr;
+		}
+
+		if (hasPredictions && !getFloatBuffer(predictions, &predictionView, true, static_cast<Py_ssize_t>(numSteps) * h.getInputSize())) {
+			PyBuffer_Release(&inputView);
+
+			return nullptr;
+		}
+
+		float* pPredictions = hasPredictions ? static_cast<float*>(predictionView.buf) : nullptr;
+
+		// The views keep both buffers alive, other Python threads may run meanwhile
+		Py_BEGIN_ALLOW_THREADS
+
+		if (learning)
+			h.trainSequence(cs, static_cast<const float*>(inputView.buf), numSteps, pPredictions);
+		else
+			h.predictSequence(cs, static_cast<const float*>(inputView.buf), numSteps, pPredictions);
+
+		Py_END_ALLOW_THREADS
+
+		if (hasPredictions)
+			PyBuffer_Release(&predictionView);
+
+		PyBuffer_Release(&inputView);
+
+		Py_RETURN_NONE;
+	}
+
+	// Hands predictions to rollout in place, it must hold numSteps frames
+	PyObject* rolloutBuffer(htfe::HTFE &h, sys::ComputeSystem &cs, int numSteps, PyObject* predictions, htfe::RolloutMode mode, float threshold, unsigned int seed) {
+		Py_buffer predictionView;
+
+		if (!getFloatBuffer(predictions, &predictionView, true, static_cast<Py_ssize_t>(numSteps) * h.getInputSize()))
+			return nullptr;
+
+		Py_BEGIN_ALLOW_THREADS
+
+		h.rollout(cs, numSteps, static_cast<float*>(predictionView.buf), mode, threshold, seed);
+
+		Py_END_ALLOW_THREADS
+
+		PyBuffer_Release(&predictionView);
+
+		Py_RETURN_NONE;
+	}
+}
+%}
+
+%include "std_string.i"
+%include "std_vector.i"
+
+namespace std {
+   %template(vectorld) vector<htfe::LayerDesc>;
+   %template(vectori) vector<int>;
+   %template(vectorf) vector<float>;
+   %template(vectorps) vector<sys::ProfilerStats>;
+   %template(vectorpe) vector<sys::ProfilerEntry>;
+};
+
+// Replaced by the buffer versions below
+%ignore htfe::HTFE::trainSequence;
+%ignore htfe::HTFE::predictSequence;
+%ignore htfe::HTFE::rollout;
+%ignore getInputData;
+%ignore getPredictionData;
+
+%rename(trainSequence) htfe::HTFE::trainSequenceBuffers;
+%rename(predictSequence) htfe::HTFE::predictSequenceBuffers;
+%rename(rollout) htfe::HTFE::rolloutBuffers;
+
+%include "htfe/LayerDesc.h"
+%include "htfe/WeightType.h"
+%include "htfe/HTFE.h"
+%include "htfe/HTFECPU.h"
+%include "htfe/HTFEBatch.h"
+%include "htfe/HTFEFrozen.h"
+%include "system/ComputeSystem.h"
+%include "system/ComputeProgram.h"
+%include "system/Profiler.h"
+
+// Bulk input and prediction access through the buffer protocol, sizes are getInputSize() float32 values
+%define HTFE_BUFFER_METHODS(Class)
+%extend Class {
+	// Copies a float32 buffer into the input
+	PyObject* setInputs(PyObject* inputs) {
+		return copyFromBuffer(inputs, $self->getInputData(), $self->getInputSize());
+	}
+
+	// Copies the prediction into a writable float32 buffer
+	PyObject* getPredictions(PyObject* predictions) {
+		return copyToBuffer(predictions, $self->getPredictionData(), $self->getInputSize());
+	}
+
+	// Writable view of the input and read only view of the prediction without copying, called with the Python object of the model
+	// by getInputView and getPredictionView. The views keep the model alive and are valid as long as getInputData and getPredictionData
+	PyObject* _inputView(PyObject* owner) {
+		return floatView(owner, $self->getInputData(), $self->getInputSize(), true);
+	}
+
+	PyObject* _predictionView(PyObject* owner) {
+		return floatView(owner, const_cast<float*>($self->getPredictionData()), $self->getInputSize(), false);
+	}
+
+	%pythoncode %{
+	def getInputView(self):
+		return self._inputView(self)
+
+	def getPredictionView(self):
+		return self._predictionView(self)
+	%}
+}
+%enddef
+
+HTFE_BUFFER_METHODS(htfe::HTFE)
+HTFE_BUFFER_METHODS(htfe::HTFECPU)
+HTFE_BUFFER_METHODS(htfe::HTFEBatch)
+HTFE_BUFFER_METHODS(htfe::HTFEFrozen)
+
+%extend htfe::HTFE {
+	// inputs holds whole frames, predictions is a writable buffer of the same size. Both are used in place without copies
+	PyObject* trainSequenceBuffers(sys::ComputeSystem &cs, PyObject* inputs, PyObject* predictions = Py_None) {
+		return runSequenceBuffers(*$self, cs, inputs, predictions, true);
+	}
+
+	PyObject* predictSequenceBuffers(sys::ComputeSystem &cs, PyObject* inputs, PyObject* predictions) {
+		return runSequenceBuffers(*$self, cs, inputs, predictions, false);
+	}
+
+	// predictions is a writable buffer of at least numSteps frames, such as a (numSteps, inputSize) float32 array
+	PyObject* rolloutBuffers(sys::ComputeSystem &cs, int numSteps, PyObject* predictions, htfe::RolloutMode mode = htfe::_feedPrediction, float threshold = 0.5f, unsigned int seed = 0) {
+		return rolloutBuffer(*$self, cs, numSteps, predictions, mode, threshold, seed);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,503 @@
+// Speed benchmark of HTFE on synthetic or replayed sequences, prints a JSON report.
+// Runs on any OpenCL device, --device cpu selects a CPU runtime such as pocl. See the README for building it
+
+#include "htfe/HTFE.h"
+#include "htfe/HTFECPU.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+namespace {
+	// small is example.py, piano is benchmark1.py, large is the 5 layer hierarchy of about 400000 hidden units from the README
+	bool getPreset(const std::string &name, int &inputWidth, int &inputHeight, std::vector<htfe::LayerDesc> &layerDescs) {
+		std::vector<int> sizes;
+
+		if (name == "small") {
+			inputWidth = inputHeight = 4;
+
+			sizes.push_back(16);
+			sizes.push_back(12);
+			sizes.push_back(8);
+		}
+		else if (name == "piano") {
+			inputWidth = inputHeight = 10;
+
+			sizes.push_back(64);
+			sizes.push_back(44);
+			sizes.push_back(32);
+			sizes.push_back(22);
+		}
+		else if (name == "large") {
+			inputWidth = inputHeight = 128;
+
+			sizes.push_back(512);
+			sizes.push_back(288);
+			sizes.push_back(192);
+			sizes.push_back(128);
+			sizes.push_back(64);
+		}
+		else
+			return false;
+
+		layerDescs.resize(sizes.size());
+
+		for (int l = 0; l < sizes.size(); l++)
+			layerDescs[l]._width = layerDescs[l]._height = sizes[l];
+
+		return true;
+	}
+
+	// A repeating sequence of sparse random frames, learnable so the hierarchy settles into realistic activity
+	void syntheticFrames(int inputSize, int numFrames, int period, float density, std::vector<float> &frames) {
+		std::mt19937 generator(1234);
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+		std::vector<float> pattern(period * inputSize);
+
+		for (int i = 0; i < pattern.size(); i++)
+			pattern[i] = dist(generator) < density ? 1.0f : 0.0f;
+
+		frames.resize(numFrames * inputSize);
+
+		for (int f = 0; f < numFrames; f++)
+			std::copy(pattern.begin() + (f % period) * inputSize, pattern.begin() + (f % period + 1) * inputSize, frames.begin() + f * inputSize);
+	}
+
+	// Raw float32 file of whole frames, repeated up to numFrames
+	bool replayFrames(const std::string &name, int inputSize, int numFrames, std::vector<float> &frames) {
+		std::ifstream fromFile(name, std::ios::binary);
+
+		if (!fromFile.is_open()) {
+			std::cerr << "Could not open file " << name << "!" << std::endl;
+
+			return false;
+		}
+
+		std::vector<float> recorded;
+
+		float value;
+
+		while (fromFile.read(reinterpret_cast<char*>(&value), sizeof(float)))
+			recorded.push_back(value);
+
+		int numRecorded = recorded.size() / inputSize;
+
+		if (numRecorded == 0) {
+			std::cerr << name << " holds no whole frame of " << inputSize << " values!" << std::endl;
+
+			return false;
+		}
+
+		frames.resize(numFrames * inputSize);
+
+		for (int f = 0; f < numFrames; f++)
+			std::copy(recorded.begin() + (f % numRecorded) * inputSize, recorded.begin() + (f % numRecorded + 1) * inputSize, frames.begin() + f * inputSize);
+
+		return true;
+	}
+
+	double elapsedMs(const std::chrono::steady_clock::time_point &start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double mean(const std::vector<double> &values) {
+		double sum = 0.0;
+
+		for (int i = 0; i < values.size(); i++)
+			sum += values[i];
+
+		return values.empty() ? 0.0 : sum / values.size();
+	}
+
+	double percentile(std::vector<double> values, int p) {
+		if (values.empty())
+			return 0.0;
+
+		std::sort(values.begin(), values.end());
+
+		return values[(values.size() - 1) * p / 100];
+	}
+
+	// Blocking steps, one latency per step. With learn, activate and learn are timed separately and learn is followed by a finish
+	void runSteps(htfe::HTFE &h, sys::ComputeSystem &cs, const std::vector<float> &frames, int inputSize, int firstFrame, int numSteps, bool learn,
+		std::vector<double> &stepMs, std::vector<double> &activateMs, std::vector<double> &learnMs)
+	{
+		int numFrames = frames.size() / inputSize;
+
+		for (int s = 0; s < numSteps; s++) {
+			int frame = (firstFrame + s) % numFrames;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			std::copy(frames.begin() + frame * inputSize, frames.begin() + (frame + 1) * inputSize, h.getInputData());
+
+			h.activate(cs);
+
+			double activated = elapsedMs(start);
+
+			if (learn) {
+				h.learn(cs);
+
+				cs.finish();
+			}
+
+			h.stepEnd();
+
+			double total = elapsedMs(start);
+
+			stepMs.push_back(total);
+			activateMs.push_back(activated);
+			learnMs.push_back(total - activated);
+		}
+	}
+
+	// Runs the same learning steps on an HTFE and an HTFECPU created from one seed and finds the largest difference of their predictions.
+	// Needs a float32 program, other weight types round the weights the CPU backend keeps in fp32
+	bool compareCPU(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<htfe::LayerDesc> &layerDescs,
+		unsigned int seed, const std::vector<float> &frames, int numSteps, float &maxError)
+	{
+		if (htfe::getWeightType(program) != htfe::_float32) {
+			std::cerr << "The CPU comparison needs a float32 program!" << std::endl;
+
+			return false;
+		}
+
+		htfe::HTFE h;
+
+		if (!h.createRandom(cs, program, inputWidth, inputHeight, layerDescs, -0.1f, 0.1f, seed)) {
+			std::cerr << "Could not create the hierarchy!" << std::endl;
+
+			return false;
+		}
+
+		htfe::HTFECPU c;
+
+		c.createRandom(inputWidth, inputHeight, layerDescs, -0.1f, 0.1f, 0, seed);
+
+		int inputSize = inputWidth * inputHeight;
+		int numFrames = frames.size() / inputSize;
+
+		maxError = 0.0f;
+
+		for (int s = 0; s < numSteps; s++) {
+			int frame = s % numFrames;
+
+			std::copy(frames.begin() + frame * inputSize, frames.begin() + (frame + 1) * inputSize, h.getInputData());
+			std::copy(frames.begin() + frame * inputSize, frames.begin() + (frame + 1) * inputSize, c.getInputData());
+
+			h.activate(cs);
+			c.activate();
+
+			for (int i = 0; i < inputSize; i++)
+				maxError = std::max(maxError, std::abs(h.getPrediction(i) - c.getPrediction(i)));
+
+			h.learn(cs);
+			c.learn();
+
+			h.stepEnd();
+			c.stepEnd();
+		}
+
+		cs.finish();
+
+		return true;
+	}
+
+	void writeTiming(std::ostream &os, const std::vector<double> &stepMs, const std::vector<double> &activateMs, const std::vector<double> &learnMs, bool learn) {
+		double totalMs = 0.0;
+
+		for (int i = 0; i < stepMs.size(); i++)
+			totalMs += stepMs[i];
+
+		os << "{\"stepsPerSecond\": " << (totalMs > 0.0 ? stepMs.size() * 1000.0 / totalMs : 0.0)
+			<< ", \"meanMs\": " << mean(stepMs) << ", \"p50Ms\": " << percentile(stepMs, 50) << ", \"p99Ms\": " << percentile(stepMs, 99)
+			<< ", \"activateMeanMs\": " << mean(activateMs);
+
+		if (learn)
+			os << ", \"learnMeanMs\": " << mean(learnMs);
+
+		os << "}";
+	}
+
+	std::string escapeJson(const std::string &s) {
+		std::string escaped;
+
+		for (int i = 0; i < s.size(); i++) {
+			if (s[i] == '"' || s[i] == '\\')
+				escaped += '\\';
+
+			if (static_cast<unsigned char>(s[i]) >= 0x20)
+				escaped += s[i];
+		}
+
+		return escaped;
+	}
+
+	// Number at a dotted path such as "train.p99Ms" in a report, fallback if missing. Each part is the first matching key after the previous one,
+	// which is enough for the keys of the report's objects
+	double readJsonNumber(const std::string &json, const std::string &path, double fallback) {
+		size_t position = 0;
+		size_t partStart = 0;
+
+		while (true) {
+			size_t partEnd = path.find('.', partStart);
+
+			std::string key = "\"" + path.substr(partStart, partEnd == std::string::npos ? std::string::npos : partEnd - partStart) + "\":";
+
+			position = json.find(key, position);
+
+			if (position == std::string::npos)
+				return fallback;
+
+			position += key.size();
+
+			if (partEnd == std::string::npos)
+				break;
+
+			partStart = partEnd + 1;
+		}
+
+		std::istringstream is(json.substr(position));
+
+		double value;
+
+		return is >> value ? value : fallback;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::map<std::string, std::string> options;
+
+	options["preset"] = "piano";
+	options["device"] = "gpu";
+	options["program"] = "htfe.cl";
+	options["steps"] = "500";
+	options["warmup"] = "50";
+	options["tolerance"] = "0.1";
+	options["seed"] = "1234";
+	options["cpu-tolerance"] = "0.001";
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string key = argv[i];
+
+		if (key.size() < 3 || key.compare(0, 2, "--") != 0) {
+			std::cerr << "Usage: " << argv[0] << " [--preset small|piano|large] [--layers n --size s] [--device cpu|gpu|all] [--program htfe.cl]"
+				" [--steps n] [--warmup n] [--seed n] [--replay frames.f32] [--out report.json] [--baseline report.json --tolerance 0.1]"
+				" [--check-cpu n --cpu-tolerance 0.001]" << std::endl;
+
+			return 1;
+		}
+
+		options[key.substr(2)] = argv[i + 1];
+	}
+
+	int inputWidth, inputHeight;
+	std::vector<htfe::LayerDesc> layerDescs;
+
+	if (!getPreset(options["preset"], inputWidth, inputHeight, layerDescs)) {
+		std::cerr << "Unknown preset " << options["preset"] << "!" << std::endl;
+
+		return 1;
+	}
+
+	// --layers and --size replace the preset's layers with a pyramid shrinking by a factor 0.7 per layer
+	if (options.count("layers") > 0 || options.count("size") > 0) {
+		int numLayers = options.count("layers") > 0 ? std::stoi(options["layers"]) : layerDescs.size();
+		float size = options.count("size") > 0 ? std::stoi(options["size"]) : layerDescs.front()._width;
+
+		layerDescs.assign(numLayers, htfe::LayerDesc());
+
+		for (int l = 0; l < numLayers; l++) {
+			layerDescs[l]._width = layerDescs[l]._height = std::max(4, static_cast<int>(size));
+
+			size *= 0.7f;
+		}
+	}
+
+	int inputSize = inputWidth * inputHeight;
+	int numSteps = std::stoi(options["steps"]);
+	int numWarmupSteps = std::stoi(options["warmup"]);
+
+	sys::DeviceType type = options["device"] == "cpu" ? sys::_cpu : (options["device"] == "all" ? sys::_all : sys::_gpu);
+
+	sys::ComputeSystem cs;
+
+	if (!cs.create(type)) {
+		std::cerr << "Could not create a compute system on device type " << options["device"] << "!" << std::endl;
+
+		return 1;
+	}
+
+	sys::ComputeProgram program;
+
+	if (!program.loadFromFile(options["program"], cs)) {
+		std::cerr << "Could not load program " << options["program"] << "!" << std::endl;
+
+		return 1;
+	}
+
+	std::vector<float> frames;
+
+	std::string workload = "synthetic";
+
+	if (options.count("replay") > 0) {
+		workload = "replay:" + options["replay"];
+
+		if (!replayFrames(options["replay"], inputSize, numSteps, frames))
+			return 1;
+	}
+	else
+		syntheticFrames(inputSize, numSteps, 64, 0.1f, frames);
+
+	htfe::HTFE h;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// A fixed seed gives every run the same initial weights, so reports of two builds compare the same model
+	if (!h.createRandom(cs, program, inputWidth, inputHeight, layerDescs, -0.1f, 0.1f, std::stoul(options["seed"]))) {
+		std::cerr << "Could not create the hierarchy!" << std::endl;
+
+		return 1;
+	}
+
+	cs.finish();
+
+	double createMs = elapsedMs(start);
+
+	std::vector<double> stepMs, activateMs, learnMs;
+
+	runSteps(h, cs, frames, inputSize, 0, numWarmupSteps, true, stepMs, activateMs, learnMs);
+
+	std::vector<double> trainStepMs, trainActivateMs, trainLearnMs;
+
+	runSteps(h, cs, frames, inputSize, 0, numSteps, true, trainStepMs, trainActivateMs, trainLearnMs);
+
+	std::vector<double> inferStepMs, inferActivateMs, inferLearnMs;
+
+	runSteps(h, cs, frames, inputSize, 0, numSteps, false, inferStepMs, inferActivateMs, inferLearnMs);
+
+	// Throughput without per step host round trips
+	std::vector<float> predictions(frames.size());
+
+	start = std::chrono::steady_clock::now();
+
+	h.trainSequence(cs, frames.data(), numSteps, predictions.data());
+
+	double trainSequenceMs = elapsedMs(start);
+
+	start = std::chrono::steady_clock::now();
+
+	h.predictSequence(cs, frames.data(), numSteps, predictions.data());
+
+	double predictSequenceMs = elapsedMs(start);
+
+	// Agreement of the OpenCL and CPU backends on a fresh pair of hierarchies
+	float cpuMaxError = 0.0f;
+
+	if (options.count("check-cpu") > 0) {
+		if (!compareCPU(cs, program, inputWidth, inputHeight, layerDescs, h.getSeed(), frames, std::stoi(options["check-cpu"]), cpuMaxError))
+			return 1;
+	}
+
+	std::ostringstream report;
+
+	int hiddenUnits = 0;
+
+	report << "{\n  \"preset\": \"" << escapeJson(options["preset"]) << "\",\n  \"device\": \"" << escapeJson(options["device"])
+		<< "\",\n  \"deviceName\": \"" << escapeJson(cs.getDevice().getInfo<CL_DEVICE_NAME>()) << "\",\n  \"workload\": \"" << escapeJson(workload)
+		<< "\",\n  \"inputWidth\": " << inputWidth << ",\n  \"inputHeight\": " << inputHeight << ",\n  \"layers\": [";
+
+	for (int l = 0; l < layerDescs.size(); l++) {
+		report << (l > 0 ? ", " : "") << "[" << layerDescs[l]._width << ", " << layerDescs[l]._height << "]";
+
+		hiddenUnits += layerDescs[l]._width * layerDescs[l]._height;
+	}
+
+	report << "],\n  \"hiddenUnits\": " << hiddenUnits << ",\n  \"steps\": " << numSteps << ",\n  \"seed\": " << h.getSeed()
+		<< ",\n  \"deviceMemoryBytes\": " << h.getDeviceMemorySize() << ",\n  \"createMs\": " << createMs << ",\n  \"train\": ";
+
+	writeTiming(report, trainStepMs, trainActivateMs, trainLearnMs, true);
+
+	report << ",\n  \"infer\": ";
+
+	writeTiming(report, inferStepMs, inferActivateMs, inferLearnMs, false);
+
+	report << ",\n  \"trainSequenceStepsPerSecond\": " << numSteps * 1000.0 / trainSequenceMs
+		<< ",\n  \"predictSequenceStepsPerSecond\": " << numSteps * 1000.0 / predictSequenceMs;
+
+	if (options.count("check-cpu") > 0)
+		report << ",\n  \"cpuCheck\": {\n    \"steps\": " << std::stoi(options["check-cpu"]) << ",\n    \"maxError\": " << cpuMaxError << "\n  }";
+
+	report << "\n}\n";
+
+	if (options.count("out") > 0) {
+		std::ofstream toFile(options["out"]);
+
+		toFile << report.str();
+	}
+
+	std::cout << report.str();
+
+	// Regression check against an earlier report of the same configuration, fails if a throughput dropped or a p99 latency grew by more than the tolerance
+	if (options.count("baseline") > 0) {
+		std::ifstream fromFile(options["baseline"]);
+
+		if (!fromFile.is_open()) {
+			std::cerr << "Could not open baseline " << options["baseline"] << "!" << std::endl;
+
+			return 1;
+		}
+
+		std::ostringstream baselineStream;
+		baselineStream << fromFile.rdbuf();
+
+		std::string baseline = baselineStream.str();
+
+		float tolerance = std::stof(options["tolerance"]);
+
+		struct {
+			const char* _path;
+			bool _higherIsBetter;
+		} metrics[] = {
+			{ "train.stepsPerSecond", true },
+			{ "train.p99Ms", false },
+			{ "infer.stepsPerSecond", true },
+			{ "infer.p99Ms", false },
+			{ "trainSequenceStepsPerSecond", true },
+			{ "predictSequenceStepsPerSecond", true }
+		};
+
+		bool regressed = false;
+
+		for (int m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++) {
+			double previous = readJsonNumber(baseline, metrics[m]._path, 0.0);
+			double current = readJsonNumber(report.str(), metrics[m]._path, 0.0);
+
+			if (previous <= 0.0)
+				continue;
+
+			if (metrics[m]._higherIsBetter ? current < previous * (1.0 - tolerance) : current > previous * (1.0 + tolerance)) {
+				std::cerr << metrics[m]._path << " regressed from " << previous << " to " << current << "!" << std::endl;
+
+				regressed = true;
+			}
+		}
+
+		if (regressed)
+			return 2;
+	}
+
+	if (options.count("check-cpu") > 0 && cpuMaxError > std::stof(options["cpu-tolerance"])) {
+		std::cerr << "CPU predictions differ from the OpenCL predictions by up to " << cpuMaxError << "!" << std::endl;
+
+		return 3;
+	}
+
+	return 0;
+}
\ No newline at end of file
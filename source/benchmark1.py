@@ -1,5 +1,6 @@
 import htfe as ht
 import pickle as pic
+import array
 import math
 import random
 
@@ -65,16 +66,14 @@ trainIterations = 1
 
 for i in range(0, trainIterations):
     for seq in range(0, numSequencesUse):
-        for j in range(0, len(dataset["train"][seq])):
-            for k in range(0, numNotes):
-                h.setInput(k, 0.0)
+        # Whole sequence in one call, the steps run back to back on the device
+        frames = array.array("f", [0.0] * (len(dataset["train"][seq]) * inputSize))
 
+        for j in range(0, len(dataset["train"][seq])):
             for k in dataset["train"][seq][j]:
-                h.setInput(int(k) - minNote, 1.0)
+                frames[j * inputSize + int(k) - minNote] = 1.0
 
-            h.activate(cs)
-            h.learn(cs)
-            h.stepEnd()
+        h.trainSequence(cs, frames)
 
         h.clearMemory(cs)
 
@@ -84,42 +83,63 @@ for i in range(0, trainIterations):
 
 ############################## Testing Predictions ##############################
 
-errorCount = 0.0
-totalCount = 0.0
+def testPredictions(model, name):
+    errorCount = 0.0
+    totalCount = 0.0
+
+    for seq in range(0, numSequencesUse):
+        prediction = []
+
+        for j in range(0, len(dataset["train"][seq])):
+            currentInput = []
+
+            for k in range(0, numNotes):
+                model.setInput(k, 0.0)
+                currentInput.append(0.0)
+
+            for k in dataset["train"][seq][j]:
+                model.setInput(int(k) - minNote, 1.0)
+                currentInput[int(k) - minNote] = 1.0
 
-for seq in range(0, numSequencesUse):
-    prediction = []
+            if j > 0:
+                # Compare prediction to input
+                for k in range(0, numNotes):
+                    if (prediction[k] > 0.5) != (currentInput[k] > 0.5):
+                        errorCount += 1
 
-    for j in range(0, len(dataset["train"][seq])):
-        currentInput = []
+                    totalCount += 1
+            
+            model.activate(cs)
 
-        for k in range(0, numNotes):
-            h.setInput(k, 0.0)
-            currentInput.append(0.0)
+            model.stepEnd()
 
-        for k in dataset["train"][seq][j]:
-            h.setInput(int(k) - minNote, 1.0)
-            currentInput[int(k) - minNote] = 1.0
+            prediction = []
 
-        if j > 0:
-            # Compare prediction to input
             for k in range(0, numNotes):
-                if (prediction[k] > 0.5) != (currentInput[k] > 0.5):
-                    errorCount += 1
+                prediction.append(model.getPrediction(k))
 
-                totalCount += 1
-        
-        h.activate(cs)
+        model.clearMemory(cs)
 
-        h.stepEnd()
+        print(name + " test sequence " + str(seq + 1) + " out of " + str(numSequencesUse) + " tested.")
 
-        prediction = []
+    print(name + " error percent: " + str(errorCount / totalCount * 100) + "%")
+
+testPredictions(h, "fp32")
+
+############################## Reduced Precision Weights ##############################
+
+# Inference only copies of the trained weights in fp16 and int8, compared on the same metric
+for weightType, name in [(ht._float16, "fp16"), (ht._int8, "int8")]:
+    reducedProg = ht.ComputeProgram()
 
-        for k in range(0, numNotes):
-            prediction.append(h.getPrediction(k))
+    if not reducedProg.loadFromFile("htfe.cl", cs, ht.weightTypeOptions(weightType)):
+        print("Could not load " + name + " program!")
+        continue
 
-    h.clearMemory(cs)
+    f = ht.HTFEFrozen()
 
-    print("Test sequence " + str(seq + 1) + " out of " + str(numSequencesUse) + " tested.")
+    if not f.create(cs, reducedProg, h):
+        print("Could not create " + name + " weights!")
+        continue
 
-print("Error percent: " + str(errorCount / totalCount * 100) + "%")
\ No newline at end of file
+    testPredictions(f, name)
@@ -1,719 +1,2060 @@
-#include "HTFE.h"
-
-#include <iostream>
-#include <time.h>
-
-using namespace htfe;
-
-struct Uint2 {
-	unsigned int _x, _y;
-};
-
-struct Float2 {
-	float _x, _y;
-};
-
-struct Float4 {
-	float _x, _y, _z, _w;
-};
-
-struct Int2 {
-	int _x, _y;
-};
-	
-void HTFE::createRandom(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight) {
-	std::mt19937 generator(time(nullptr));
-
-	std::uniform_int_distribution<int> seedDist(0, 99999);
-
-	_inputWidth = inputWidth;
-	_inputHeight = inputHeight;
-
-	_layerDescs = layerDescs;
-
-	_layers.resize(_layerDescs.size());
-
-	cl::Kernel initializeLayerHiddenKernel = cl::Kernel(program.getProgram(), "initializeLayerHidden");
-	cl::Kernel initializeLayerVisibleKernel = cl::Kernel(program.getProgram(), "initializeLayerVisible");
-
-	_input.clear();
-	_input.resize(_inputWidth * _inputHeight, 0.0f);
-
-	_prediction.clear();
-	_prediction.resize(_inputWidth * _inputHeight, 0.0f);
-
-	_inputImage = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _inputWidth, _inputHeight);
-	_inputImagePrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _inputWidth, _inputHeight);
-
-	{
-		cl_uint4 clear = { 0, 0, 0, 0 };
-
-		cl::size_t<3> origin;
-		origin[0] = 0;
-		origin[1] = 0;
-		origin[2] = 0;
-
-		cl::size_t<3> region;
-		region[0] = _inputWidth;
-		region[1] = _inputHeight;
-		region[2] = 1;
-
-		cs.getQueue().enqueueFillImage(_inputImage, clear, origin, region);
-		cs.getQueue().enqueueFillImage(_inputImagePrev, clear, origin, region);
-	}
-
-	int prevWidth = _inputWidth;
-	int prevHeight = _inputHeight;
-
-	for (int l = 0; l < _layers.size(); l++) {
-		int numFeedForwardWeights = std::pow(_layerDescs[l]._receptiveFieldRadius * 2 + 1, 2);
-		int numReconstructionWeights = std::pow(_layerDescs[l]._reconstructionRadius * 2 + 1, 2);
-		int numLateralWeights = std::pow(_layerDescs[l]._lateralConnectionRadius * 2 + 1, 2);
-		int numFeedBackWeights = std::pow(_layerDescs[l]._feedBackConnectionRadius * 2 + 1, 2);
-
-		_layers[l]._hiddenFeedForwardActivations = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-		
-		_layers[l]._hiddenFeedBackActivations = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-		_layers[l]._hiddenFeedBackActivationsPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-
-		_layers[l]._hiddenStatesFeedForward = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-		_layers[l]._hiddenStatesFeedForwardPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-
-		_layers[l]._hiddenStatesFeedBack = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-		_layers[l]._hiddenStatesFeedBackPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-		_layers[l]._hiddenStatesFeedBackPrevPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-
-		_layers[l]._feedForwardWeights = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height, numFeedForwardWeights);
-		_layers[l]._feedForwardWeightsPrev = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height, numFeedForwardWeights);
-
-		_layers[l]._reconstructionWeights = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight, numReconstructionWeights);
-		_layers[l]._reconstructionWeightsPrev = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight, numReconstructionWeights);
-
-		_layers[l]._visibleBiases = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight);
-		_layers[l]._visibleBiasesPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight);
-
-		_layers[l]._hiddenBiases = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-		_layers[l]._hiddenBiasesPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
-
-		_layers[l]._lateralWeights = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height, numLateralWeights);
-		_layers[l]._lateralWeightsPrev = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height, numLateralWeights);
-
-		_layers[l]._feedBackWeights = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height, numFeedBackWeights);
-		_layers[l]._feedBackWeightsPrev = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height, numFeedBackWeights);
-
-		_layers[l]._visibleReconstruction = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight);
-		_layers[l]._visibleReconstructionPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight);
-
-		// Initialize
-		Uint2 initSeedHidden;
-		initSeedHidden._x = seedDist(generator);
-		initSeedHidden._y = seedDist(generator);
-
-		int index = 0;
-
-		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
-		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
-		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenStatesFeedForward);
-		initializeLayerHiddenKernel.setArg(index++, _layers[l]._feedForwardWeights);
-		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenBiases);
-		initializeLayerHiddenKernel.setArg(index++, _layers[l]._lateralWeights);
-		initializeLayerHiddenKernel.setArg(index++, _layers[l]._feedBackWeights);
-		initializeLayerHiddenKernel.setArg(index++, numFeedForwardWeights);
-		initializeLayerHiddenKernel.setArg(index++, numLateralWeights);
-		initializeLayerHiddenKernel.setArg(index++, numFeedBackWeights);
-		initializeLayerHiddenKernel.setArg(index++, initSeedHidden);
-		initializeLayerHiddenKernel.setArg(index++, _layerDescs[l]._sparsity);
-		initializeLayerHiddenKernel.setArg(index++, _layerDescs[l]._lateralScalar);
-		initializeLayerHiddenKernel.setArg(index++, _layerDescs[l]._feedBackScalar);
-		initializeLayerHiddenKernel.setArg(index++, minInitWeight);
-		initializeLayerHiddenKernel.setArg(index++, maxInitWeight);
-
-		cs.getQueue().enqueueNDRangeKernel(initializeLayerHiddenKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
-
-		Uint2 initSeedVisible;
-		initSeedVisible._x = seedDist(generator);
-		initSeedVisible._y = seedDist(generator);
-
-		index = 0;
-
-		initializeLayerVisibleKernel.setArg(index++, _layers[l]._visibleBiases);
-		initializeLayerVisibleKernel.setArg(index++, _layers[l]._visibleReconstruction);
-		initializeLayerVisibleKernel.setArg(index++, _layers[l]._reconstructionWeights);
-		initializeLayerVisibleKernel.setArg(index++, numReconstructionWeights);
-		initializeLayerVisibleKernel.setArg(index++, initSeedVisible);
-		initializeLayerVisibleKernel.setArg(index++, minInitWeight);
-		initializeLayerVisibleKernel.setArg(index++, maxInitWeight);
-
-		cs.getQueue().enqueueNDRangeKernel(initializeLayerVisibleKernel, cl::NullRange, cl::NDRange(prevWidth, prevHeight));
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = _layerDescs[l]._width;
-			region[1] = _layerDescs[l]._height;
-			region[2] = 1;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenFeedBackActivations, _layers[l]._hiddenFeedBackActivationsPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = prevWidth;
-			region[1] = prevHeight;
-			region[2] = 1;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._visibleReconstruction, _layers[l]._visibleReconstructionPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = _layerDescs[l]._width;
-			region[1] = _layerDescs[l]._height;
-			region[2] = 1;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedForwardPrev, origin, origin, region);
-			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBack, origin, origin, region);
-			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBackPrev, origin, origin, region);
-			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBackPrevPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = _layerDescs[l]._width;
-			region[1] = _layerDescs[l]._height;
-			region[2] = numFeedForwardWeights;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._feedForwardWeights, _layers[l]._feedForwardWeightsPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = prevWidth;
-			region[1] = prevHeight;
-			region[2] = 1;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._visibleBiases, _layers[l]._visibleBiasesPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = _layerDescs[l]._width;
-			region[1] = _layerDescs[l]._height;
-			region[2] = 1;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenBiases, _layers[l]._hiddenBiasesPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = _layerDescs[l]._width;
-			region[1] = _layerDescs[l]._height;
-			region[2] = numLateralWeights;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._lateralWeights, _layers[l]._lateralWeightsPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = _layerDescs[l]._width;
-			region[1] = _layerDescs[l]._height;
-			region[2] = numFeedBackWeights;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._feedBackWeights, _layers[l]._feedBackWeightsPrev, origin, origin, region);
-		}
-
-		{
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = prevWidth;
-			region[1] = prevHeight;
-			region[2] = numReconstructionWeights;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._reconstructionWeights, _layers[l]._reconstructionWeightsPrev, origin, origin, region);
-		}
-
-		prevWidth = _layerDescs[l]._width;
-		prevHeight = _layerDescs[l]._height;
-	}
-
-	_layerHiddenFeedForwardActivateKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedForwardActivate");
-	_layerHiddenFeedBackActivateKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedBackActivate");
-	_layerHiddenInhibitKernel = cl::Kernel(program.getProgram(), "layerHiddenInhibit");
-	_layerVisibleReconstructKernel = cl::Kernel(program.getProgram(), "layerVisibleReconstruct");
-	_layerHiddenWeightUpdateKernel = cl::Kernel(program.getProgram(), "layerHiddenWeightUpdate");
-	_layerHiddenWeightUpdateLastKernel = cl::Kernel(program.getProgram(), "layerHiddenWeightUpdateLast");
-	_layerVisibleWeightUpdateKernel = cl::Kernel(program.getProgram(), "layerVisibleWeightUpdate");
-}
-
-void HTFE::activate(sys::ComputeSystem &cs) {	
-	{
-		cl::size_t<3> origin;
-		origin[0] = 0;
-		origin[1] = 0;
-		origin[2] = 0;
-
-		cl::size_t<3> region;
-		region[0] = _inputWidth;
-		region[1] = _inputHeight;
-		region[2] = 1;
-
-		cs.getQueue().enqueueWriteImage(_inputImage, CL_TRUE, origin, region, 0, 0, _input.data());
-	}
-	
-	std::uniform_int_distribution<int> seedDist(0, 99999);
-
-	// ------------------------------------------------------------------------------
-	// ------------------------------------ Go up -----------------------------------
-	// ------------------------------------------------------------------------------
-
-	cl::Image2D* pPrevLayer = &_inputImage;
-	int prevWidth = _inputWidth;
-	int prevHeight = _inputHeight;
-
-	for (int l = 0; l < _layers.size(); l++) {
-		float localActivity = std::round(_layerDescs[l]._sparsity * std::pow(2 * _layerDescs[l]._inhibitionRadius + 1, 2));
-
-		Int2 layerSize;
-		layerSize._x = _layerDescs[l]._width;
-		layerSize._y = _layerDescs[l]._height;
-
-		Int2 layerSizeMinusOne;
-		layerSizeMinusOne._x = _layerDescs[l]._width - 1;
-		layerSizeMinusOne._y = _layerDescs[l]._height - 1;
-
-		Float2 layerSizeMinusOneInv;
-		layerSizeMinusOneInv._x = 1.0f / (_layerDescs[l]._width - 1);
-		layerSizeMinusOneInv._y = 1.0f / (_layerDescs[l]._height - 1);
-
-		Int2 inputSize;
-		inputSize._x = prevWidth;
-		inputSize._y = prevHeight;
-
-		Int2 inputSizeMinusOne;
-		inputSizeMinusOne._x = prevWidth - 1;
-		inputSizeMinusOne._y = prevHeight - 1;
-
-		Float2 inputSizeMinusOneInv;
-		inputSizeMinusOneInv._x = 1.0f / (prevWidth - 1);
-		inputSizeMinusOneInv._y = 1.0f / (prevHeight - 1);
-
-		// -------------------------------- Activate --------------------------------
-
-		int index = 0;
-
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, *pPrevLayer);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._feedForwardWeightsPrev);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._lateralWeightsPrev);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenBiasesPrev);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, layerSize);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, layerSizeMinusOneInv);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, inputSize);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, inputSizeMinusOne);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
-		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
-
-		cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedForwardActivateKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
-
-		// ---------------------------------- Inhibit ---------------------------------
-
-		index = 0;
-
-		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
-		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedForwardPrev);
-		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedForward);
-		_layerHiddenInhibitKernel.setArg(index++, layerSize);
-		_layerHiddenInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
-		_layerHiddenInhibitKernel.setArg(index++, localActivity);
-
-		cs.getQueue().enqueueNDRangeKernel(_layerHiddenInhibitKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
-
-		pPrevLayer = &_layers[l]._hiddenStatesFeedForward;
-		prevWidth = _layerDescs[l]._width;
-		prevHeight = _layerDescs[l]._height;
-	}
-
-	// ------------------------------------------------------------------------------
-	// -------------------------------- Go back down --------------------------------
-	// ------------------------------------------------------------------------------
-
-	for (int l = _layers.size() - 1; l >= 0; l--) {
-		if (l > 0) {
-			pPrevLayer = &_layers[l - 1]._hiddenStatesFeedForward;
-			prevWidth = _layerDescs[l - 1]._width;
-			prevHeight = _layerDescs[l - 1]._height;
-		}
-		else {
-			pPrevLayer = &_inputImage;
-			prevWidth = _inputWidth;
-			prevHeight = _inputHeight;
-		}
-
-		float localActivity = std::round(_layerDescs[l]._sparsity * std::pow(2 * _layerDescs[l]._inhibitionRadius + 1, 2));
-
-		Int2 layerSize;
-		layerSize._x = _layerDescs[l]._width;
-		layerSize._y = _layerDescs[l]._height;
-
-		Int2 layerSizeMinusOne;
-		layerSizeMinusOne._x = _layerDescs[l]._width - 1;
-		layerSizeMinusOne._y = _layerDescs[l]._height - 1;
-
-		Float2 layerSizeMinusOneInv;
-		layerSizeMinusOneInv._x = 1.0f / (_layerDescs[l]._width - 1);
-		layerSizeMinusOneInv._y = 1.0f / (_layerDescs[l]._height - 1);
-
-		Int2 inputSize;
-		inputSize._x = prevWidth;
-		inputSize._y = prevHeight;
-
-		Int2 inputSizeMinusOne;
-		inputSizeMinusOne._x = prevWidth - 1;
-		inputSizeMinusOne._y = prevHeight - 1;
-
-		Float2 inputSizeMinusOneInv;
-		inputSizeMinusOneInv._x = 1.0f / (prevWidth - 1);
-		inputSizeMinusOneInv._y = 1.0f / (prevHeight - 1);
-
-		Int2 nextSize;
-		Int2 nextSizeMinusOne;
-
-		if (l == _layers.size() - 1) {
-			nextSize._x = nextSize._y = 1;
-			nextSizeMinusOne._x = nextSizeMinusOne._y = 0;
-		}
-		else {
-			nextSize._x = _layerDescs[l + 1]._width;
-			nextSize._y = _layerDescs[l + 1]._height;
-			nextSizeMinusOne._x = _layerDescs[l + 1]._width - 1;
-			nextSizeMinusOne._y = _layerDescs[l + 1]._height - 1;
-		}
-
-		// -------------------------------- Activate --------------------------------
-
-		int index = 0;
-
-		if (l == _layers.size() - 1) {
-			cl::size_t<3> origin;
-			origin[0] = 0;
-			origin[1] = 0;
-			origin[2] = 0;
-
-			cl::size_t<3> region;
-			region[0] = _layerDescs[l]._width;
-			region[1] = _layerDescs[l]._height;
-			region[2] = 1;
-
-			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenFeedForwardActivations, _layers[l]._hiddenFeedBackActivations, origin, origin, region);
-		}
-		else {
-			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l + 1]._hiddenFeedBackActivations);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._feedBackWeightsPrev);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, layerSize);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, layerSizeMinusOneInv);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, nextSize);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, nextSizeMinusOne);
-			_layerHiddenFeedBackActivateKernel.setArg(index++, _layerDescs[l]._feedBackConnectionRadius);
-
-			cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedBackActivateKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
-		}
-
-		// ---------------------------------- Inhibit ---------------------------------
-
-		index = 0;
-
-		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
-		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
-		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
-		_layerHiddenInhibitKernel.setArg(index++, layerSize);
-		_layerHiddenInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
-		_layerHiddenInhibitKernel.setArg(index++, localActivity);
-
-		cs.getQueue().enqueueNDRangeKernel(_layerHiddenInhibitKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
-
-		// --------------------- Make Predictions (Reconstruction) ---------------------
-
-		index = 0;
-
-		_layerVisibleReconstructKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
-		_layerVisibleReconstructKernel.setArg(index++, _layers[l]._reconstructionWeightsPrev);
-		_layerVisibleReconstructKernel.setArg(index++, _layers[l]._visibleBiasesPrev);
-		_layerVisibleReconstructKernel.setArg(index++, _layers[l]._visibleReconstruction);
-		_layerVisibleReconstructKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
-		_layerVisibleReconstructKernel.setArg(index++, inputSizeMinusOne);
-		_layerVisibleReconstructKernel.setArg(index++, inputSizeMinusOneInv);
-		_layerVisibleReconstructKernel.setArg(index++, layerSize);
-		_layerVisibleReconstructKernel.setArg(index++, layerSizeMinusOne);
-		_layerVisibleReconstructKernel.setArg(index++, layerSizeMinusOneInv);
-
-		cs.getQueue().enqueueNDRangeKernel(_layerVisibleReconstructKernel, cl::NullRange, cl::NDRange(prevWidth, prevHeight));
-	}
-
-	{
-		cl::size_t<3> origin;
-		origin[0] = 0;
-		origin[1] = 0;
-		origin[2] = 0;
-
-		cl::size_t<3> region;
-		region[0] = _inputWidth;
-		region[1] = _inputHeight;
-		region[2] = 1;
-
-		cs.getQueue().enqueueReadImage(_layers.front()._visibleReconstruction, CL_TRUE, origin, region, 0, 0, _prediction.data());
-	}
-}
-
-void HTFE::learn(sys::ComputeSystem &cs) {
-	// ------------------------------------------------------------------------------
-	// ---------------------- Weight Update and Predictions  ------------------------
-	// ------------------------------------------------------------------------------
-
-	cl::Image2D* pPrevLayer = &_inputImage;
-	int prevWidth = _inputWidth;
-	int prevHeight = _inputHeight;
-
-	cl::Image2D* pPrevLayerFeedForwardPrev = &_inputImagePrev;
-	cl::Image2D* pPrevLayerFeedBackPrev = &_inputImagePrev;
-
-	for (int l = 0; l < _layers.size(); l++) {
-		float localActivity = std::round(_layerDescs[l]._sparsity * std::pow(2 * _layerDescs[l]._inhibitionRadius + 1, 2));
-
-		Int2 layerSize;
-		layerSize._x = _layerDescs[l]._width;
-		layerSize._y = _layerDescs[l]._height;
-
-		Int2 layerSizeMinusOne;
-		layerSizeMinusOne._x = _layerDescs[l]._width - 1;
-		layerSizeMinusOne._y = _layerDescs[l]._height - 1;
-
-		Float2 layerSizeMinusOneInv;
-		layerSizeMinusOneInv._x = 1.0f / (_layerDescs[l]._width - 1);
-		layerSizeMinusOneInv._y = 1.0f / (_layerDescs[l]._height - 1);
-
-		Int2 inputSize;
-		inputSize._x = prevWidth;
-		inputSize._y = prevHeight;
-
-		Int2 inputSizeMinusOne;
-		inputSizeMinusOne._x = prevWidth - 1;
-		inputSizeMinusOne._y = prevHeight - 1;
-
-		Float2 inputSizeMinusOneInv;
-		inputSizeMinusOneInv._x = 1.0f / (prevWidth - 1);
-		inputSizeMinusOneInv._y = 1.0f / (prevHeight - 1);
-
-		Int2 nextSize;
-		Int2 nextSizeMinusOne;
-
-		if (l == _layers.size() - 1) {
-			nextSize._x = nextSize._y = 1;
-			nextSizeMinusOne._x = nextSizeMinusOne._y = 0;
-		}
-		else {
-			nextSize._x = _layerDescs[l + 1]._width;
-			nextSize._y = _layerDescs[l + 1]._height;
-			nextSizeMinusOne._x = _layerDescs[l + 1]._width - 1;
-			nextSizeMinusOne._y = _layerDescs[l + 1]._height - 1;
-		}
-
-		// ------------------------------- Weight Updates -------------------------------
-
-		Float4 alphas;
-		alphas._x = _layerDescs[l]._feedForwardAlpha;
-		alphas._y = _layerDescs[l]._lateralAlpha;
-		alphas._z = _layerDescs[l]._feedBackAlpha;
-		alphas._w = _layerDescs[l]._hiddenBiasAlpha;
-
-		int index = 0;
-
-		if (l == _layers.size() - 1) {
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._visibleReconstructionPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, *pPrevLayer);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, *pPrevLayerFeedForwardPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._hiddenFeedBackActivationsPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrevPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._reconstructionWeightsPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._feedForwardWeightsPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._lateralWeightsPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._hiddenBiasesPrev);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._feedForwardWeights);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._lateralWeights);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layers[l]._hiddenBiases);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, layerSize);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, layerSizeMinusOne);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, layerSizeMinusOneInv);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, inputSize);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, inputSizeMinusOne);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, inputSizeMinusOneInv);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layerDescs[l]._sparsity);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, alphas);
-			_layerHiddenWeightUpdateLastKernel.setArg(index++, _layerDescs[l]._weightDecay);
-
-			cs.getQueue().enqueueNDRangeKernel(_layerHiddenWeightUpdateLastKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
-		}
-		else {
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._visibleReconstructionPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, *pPrevLayer);
-			_layerHiddenWeightUpdateKernel.setArg(index++, *pPrevLayerFeedForwardPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._hiddenFeedBackActivationsPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrevPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l + 1]._hiddenStatesFeedBackPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._reconstructionWeightsPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._feedForwardWeightsPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._lateralWeightsPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._hiddenBiasesPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._feedBackWeightsPrev);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._feedForwardWeights);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._lateralWeights);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._hiddenBiases);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layers[l]._feedBackWeights);
-			_layerHiddenWeightUpdateKernel.setArg(index++, layerSize);
-			_layerHiddenWeightUpdateKernel.setArg(index++, layerSizeMinusOne);
-			_layerHiddenWeightUpdateKernel.setArg(index++, layerSizeMinusOneInv);
-			_layerHiddenWeightUpdateKernel.setArg(index++, inputSize);
-			_layerHiddenWeightUpdateKernel.setArg(index++, inputSizeMinusOne);
-			_layerHiddenWeightUpdateKernel.setArg(index++, inputSizeMinusOneInv);
-			_layerHiddenWeightUpdateKernel.setArg(index++, nextSize);
-			_layerHiddenWeightUpdateKernel.setArg(index++, nextSizeMinusOne);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._feedBackConnectionRadius);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._sparsity);
-			_layerHiddenWeightUpdateKernel.setArg(index++, alphas);
-			_layerHiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._weightDecay);
-
-			cs.getQueue().enqueueNDRangeKernel(_layerHiddenWeightUpdateKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
-		}
-
-		index = 0;
-
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layers[l]._visibleReconstructionPrev);
-		_layerVisibleWeightUpdateKernel.setArg(index++, *pPrevLayer);
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layers[l]._reconstructionWeightsPrev);
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layers[l]._visibleBiasesPrev);
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layers[l]._reconstructionWeights);
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layers[l]._visibleBiases);
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
-		_layerVisibleWeightUpdateKernel.setArg(index++, inputSizeMinusOne);
-		_layerVisibleWeightUpdateKernel.setArg(index++, inputSizeMinusOneInv);
-		_layerVisibleWeightUpdateKernel.setArg(index++, layerSize);
-		_layerVisibleWeightUpdateKernel.setArg(index++, layerSizeMinusOne);
-		_layerVisibleWeightUpdateKernel.setArg(index++, layerSizeMinusOneInv);
-		_layerVisibleWeightUpdateKernel.setArg(index++, _layerDescs[l]._reconstructionAlpha);
-
-		cs.getQueue().enqueueNDRangeKernel(_layerVisibleWeightUpdateKernel, cl::NullRange, cl::NDRange(prevWidth, prevHeight));
-
-		pPrevLayer = &_layers[l]._hiddenStatesFeedForward; // Or _hiddenStatesFeedBack ?
-		prevWidth = _layerDescs[l]._width;
-		prevHeight = _layerDescs[l]._height;
-
-		pPrevLayerFeedForwardPrev = &_layers[l]._hiddenStatesFeedForwardPrev;
-		pPrevLayerFeedBackPrev = &_layers[l]._hiddenStatesFeedBackPrev;
-	}
-}
-
-void HTFE::stepEnd() {
-	// ------------------------------------------------------------------------------
-	// ---------------------------------- Step End ----------------------------------
-	// ------------------------------------------------------------------------------
-
-	for (int l = 0; l < _layers.size(); l++) {
-		cl::Image2D temp2D;
-
-		std::swap(_layers[l]._visibleReconstruction, _layers[l]._visibleReconstructionPrev);
-		std::swap(_layers[l]._hiddenFeedBackActivations, _layers[l]._hiddenFeedBackActivationsPrev);
-		std::swap(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedForwardPrev);
-		
-		temp2D = _layers[l]._hiddenStatesFeedBackPrevPrev;
-		_layers[l]._hiddenStatesFeedBackPrevPrev = _layers[l]._hiddenStatesFeedBackPrev;
-		_layers[l]._hiddenStatesFeedBackPrev = _layers[l]._hiddenStatesFeedBack;
-		_layers[l]._hiddenStatesFeedBack = temp2D;
-
-		std::swap(_layers[l]._feedForwardWeights, _layers[l]._feedForwardWeightsPrev);
-		std::swap(_layers[l]._reconstructionWeights, _layers[l]._reconstructionWeightsPrev);
-		std::swap(_layers[l]._visibleBiases, _layers[l]._visibleBiasesPrev);
-		std::swap(_layers[l]._hiddenBiases, _layers[l]._hiddenBiasesPrev);
-		std::swap(_layers[l]._lateralWeights, _layers[l]._lateralWeightsPrev);
-		std::swap(_layers[l]._feedBackWeights, _layers[l]._feedBackWeightsPrev);
-	}
-
-	std::swap(_inputImage, _inputImagePrev);
-}
-
-void HTFE::clearMemory(sys::ComputeSystem &cs) {
-	// ------------------------------------------------------------------------------
-	// -------------------------------- Clear Memory --------------------------------
-	// ------------------------------------------------------------------------------
-
-	cl_uint4 clear = { 0, 0, 0, 0 };
-
-	for (int l = 0; l < _layers.size(); l++) {
-		cl::size_t<3> origin;
-		origin[0] = 0;
-		origin[1] = 0;
-		origin[2] = 0;
-
-		cl::size_t<3> region;
-		region[0] = _layerDescs[l]._width;
-		region[1] = _layerDescs[l]._height;
-		region[2] = 1;
-
-		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedBackPrevPrev, clear, origin, region);
-		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedBackPrev, clear, origin, region);
-		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedBack, clear, origin, region);
-	}
+#include "HTFE.h"
+
+#include "KernelTypes.h"
+#include "StateFormat.h"
+#include "Tiling.h"
+
+#include "../system/MappedFile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <map>
+
+using namespace htfe;
+
+namespace htfe {
+	struct CheckpointTensor {
+		cl::Image2D* _pImage;
+		cl::Buffer* _pBuffer;
+
+		int _width, _height;
+
+		// Bytes of tightly packed data
+		size_t _size;
+
+		// Device of the layer the tensor belongs to
+		int _device;
+	};
+}
+
+namespace {
+	const char checkpointMagic[4] = { 'H', 'T', 'F', 'E' };
+
+	// Increase whenever the header, LayerDesc or the tensor list changes
+	const std::uint32_t checkpointVersion = 3;
+
+	// Tensors start at multiples of this, so uploads read aligned memory straight from the mapping
+	const size_t checkpointAlignment = 4096;
+
+	// Random streams per layer used by createRandom, four weight tensors and two bias vectors. HTFECPU::createRandom draws the same streams
+	const cl_uint numInitStreams = 6;
+
+	// Staging size of trainSequence and predictSequence, each way
+	const size_t sequenceChunkSize = 16 << 20;
+
+	struct CheckpointHeader {
+		char _magic[4];
+		std::uint32_t _version;
+		std::uint32_t _layerDescSize;
+		std::uint32_t _weightType;
+		std::int32_t _inputWidth;
+		std::int32_t _inputHeight;
+		std::int32_t _numLayers;
+		std::uint64_t _dataOffset;
+		std::uint64_t _dataSize;
+	};
+
+	// Steps per chunk of trainSequence, predictSequence and rollout
+	int sequenceChunkSteps(size_t frameSize, int numSteps) {
+		return static_cast<int>(std::min<size_t>(std::max<size_t>(1, sequenceChunkSize / frameSize), numSteps));
+	}
+
+	size_t alignCheckpointOffset(size_t offset) {
+		return (offset + checkpointAlignment - 1) / checkpointAlignment * checkpointAlignment;
+	}
+
+	// Limits of the sizes and radii a checkpoint may hold, far beyond any device but small enough that no size computation overflows
+	const int maxCheckpointExtent = 1 << 15;
+	const int maxCheckpointRadius = 1 << 10;
+	const int maxCheckpointLayers = 1 << 10;
+
+	bool checkpointDescsValid(int inputWidth, int inputHeight, const std::vector<htfe::LayerDesc> &layerDescs) {
+		if (layerDescs.empty() || inputWidth < 1 || inputWidth > maxCheckpointExtent || inputHeight < 1 || inputHeight > maxCheckpointExtent)
+			return false;
+
+		for (int l = 0; l < layerDescs.size(); l++) {
+			const htfe::LayerDesc &desc = layerDescs[l];
+
+			if (desc._width < 1 || desc._width > maxCheckpointExtent || desc._height < 1 || desc._height > maxCheckpointExtent)
+				return false;
+
+			int radii[] = { desc._receptiveFieldRadius, desc._reconstructionRadius, desc._lateralConnectionRadius, desc._inhibitionRadius, desc._feedBackConnectionRadius };
+
+			for (int r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+				if (radii[r] < 0 || radii[r] > maxCheckpointRadius)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Bytes of the tensor data of a checkpoint of these layers, laid out as getCheckpointTensors lists them
+	size_t checkpointDataSize(size_t weightSize, int inputWidth, int inputHeight, const std::vector<htfe::LayerDesc> &layerDescs) {
+		std::vector<size_t> sizes;
+
+		size_t inputSize = static_cast<size_t>(inputWidth) * inputHeight;
+
+		sizes.push_back(inputSize * sizeof(float));
+		sizes.push_back(inputSize * sizeof(float));
+
+		size_t prevSize = inputSize;
+
+		for (int l = 0; l < layerDescs.size(); l++) {
+			size_t hiddenSize = static_cast<size_t>(layerDescs[l]._width) * layerDescs[l]._height;
+
+			size_t numFeedForwardWeights = std::pow(layerDescs[l]._receptiveFieldRadius * 2 + 1, 2);
+			size_t numReconstructionWeights = std::pow(layerDescs[l]._reconstructionRadius * 2 + 1, 2);
+			size_t numLateralWeights = std::pow(layerDescs[l]._lateralConnectionRadius * 2 + 1, 2);
+			size_t numFeedBackWeights = std::pow(layerDescs[l]._feedBackConnectionRadius * 2 + 1, 2);
+
+			sizes.push_back(hiddenSize * numFeedForwardWeights * weightSize);
+			sizes.push_back(prevSize * numReconstructionWeights * weightSize);
+			sizes.push_back(prevSize * sizeof(float));
+			sizes.push_back(hiddenSize * sizeof(float));
+			sizes.push_back(hiddenSize * numLateralWeights * weightSize);
+			sizes.push_back(hiddenSize * numFeedBackWeights * weightSize);
+
+			for (int i = 0; i < 3; i++)
+				sizes.push_back(hiddenSize * 2 * sizeof(float));
+
+			for (int i = 0; i < 5; i++)
+				sizes.push_back(hiddenSize * htfe::stateTexelSize);
+
+			sizes.push_back(prevSize * sizeof(float));
+			sizes.push_back(prevSize * sizeof(float));
+
+			prevSize = hiddenSize;
+		}
+
+		size_t dataSize = 0;
+
+		for (int t = 0; t < sizes.size(); t++)
+			dataSize = alignCheckpointOffset(dataSize) + sizes[t];
+
+		return dataSize;
+	}
+
+	htfe::CheckpointTensor checkpointImage(cl::Image2D &image, int width, int height, size_t texelSize, int device) {
+		htfe::CheckpointTensor tensor;
+		tensor._pImage = &image;
+		tensor._pBuffer = nullptr;
+		tensor._width = width;
+		tensor._height = height;
+		tensor._size = static_cast<size_t>(width) * height * texelSize;
+		tensor._device = device;
+
+		return tensor;
+	}
+
+	// Inverse of the reconstruction connectivity used by the hidden weight update, see reconstructionErrorSum in htfe.cl.
+	// Walks the feed forward receptive field of every hidden unit in kernel order and keeps the visible units whose reconstruction field contains the unit.
+	// The float math mirrors the kernels, so the entries are exactly the ones the containment test used to accept
+	void buildReconstructionErrorTable(int width, int height, int inputWidth, int inputHeight, int receptiveFieldRadius, int reconstructionRadius,
+		std::vector<int> &offsets, std::vector<int> &entries)
+	{
+		float layerSizeMinusOneInvX = 1.0f / (width - 1);
+		float layerSizeMinusOneInvY = 1.0f / (height - 1);
+		float inputSizeMinusOneInvX = 1.0f / (inputWidth - 1);
+		float inputSizeMinusOneInvY = 1.0f / (inputHeight - 1);
+
+		int reconstructionDiameter = reconstructionRadius * 2 + 1;
+
+		offsets.assign(width * height + 1, 0);
+		entries.clear();
+
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++) {
+				offsets[x + y * width] = entries.size() / 2;
+
+				int inputCenterX = static_cast<int>(x * layerSizeMinusOneInvX * (inputWidth - 1));
+				int inputCenterY = static_cast<int>(y * layerSizeMinusOneInvY * (inputHeight - 1));
+
+				for (int dx = -receptiveFieldRadius; dx <= receptiveFieldRadius; dx++)
+					for (int dy = -receptiveFieldRadius; dy <= receptiveFieldRadius; dy++) {
+						int inputX = inputCenterX + dx;
+						int inputY = inputCenterY + dy;
+
+						if (inputX < 0 || inputX >= inputWidth || inputY < 0 || inputY >= inputHeight)
+							continue;
+
+						int fieldLowerX = static_cast<int>(inputX * inputSizeMinusOneInvX * (width - 1)) - reconstructionRadius;
+						int fieldLowerY = static_cast<int>(inputY * inputSizeMinusOneInvY * (height - 1)) - reconstructionRadius;
+
+						int rdx = x - fieldLowerX;
+						int rdy = y - fieldLowerY;
+
+						if (rdx < 0 || rdx >= reconstructionDiameter || rdy < 0 || rdy >= reconstructionDiameter)
+							continue;
+
+						int weightIndex = rdy + rdx * reconstructionDiameter;
+
+						entries.push_back(inputX | (inputY << 16));
+						entries.push_back((weightIndex * inputHeight + inputY) * inputWidth + inputX);
+					}
+			}
+
+		offsets[width * height] = entries.size() / 2;
+
+		// Buffers can not be empty
+		if (entries.empty())
+			entries.resize(2, 0);
+	}
+
+	// Defines of a program specialized for one layer, see the SPECIALIZE_* macros in htfe.cl. pNextDesc is null for the top layer
+	std::string specializationOptions(const LayerDesc &desc, int inputWidth, int inputHeight, const LayerDesc* pNextDesc) {
+		std::ostringstream options;
+
+		options << "-D HTFE_LAYER_WIDTH=" << desc._width << " -D HTFE_LAYER_HEIGHT=" << desc._height;
+		options << " -D HTFE_INPUT_WIDTH=" << inputWidth << " -D HTFE_INPUT_HEIGHT=" << inputHeight;
+
+		if (pNextDesc != nullptr) {
+			options << " -D HTFE_NEXT_WIDTH=" << pNextDesc->_width << " -D HTFE_NEXT_HEIGHT=" << pNextDesc->_height;
+			options << " -D HTFE_FEED_BACK_CONNECTION_RADIUS=" << desc._feedBackConnectionRadius;
+		}
+
+		options << " -D HTFE_RECEPTIVE_FIELD_RADIUS=" << desc._receptiveFieldRadius;
+		options << " -D HTFE_RECONSTRUCTION_RADIUS=" << desc._reconstructionRadius;
+		options << " -D HTFE_LATERAL_CONNECTION_RADIUS=" << desc._lateralConnectionRadius;
+		options << " -D HTFE_INHIBITION_RADIUS=" << desc._inhibitionRadius;
+
+		return options.str();
+	}
+
+	// Device index of every layer, layers past the end of layerDevices run on device 0
+	std::vector<int> placeLayers(const std::vector<int> &layerDevices, int numLayers) {
+		std::vector<int> devices(numLayers);
+
+		for (int l = 0; l < numLayers; l++)
+			devices[l] = l < layerDevices.size() ? layerDevices[l] : 0;
+
+		return devices;
+	}
+
+	void buildReconstructionErrorTables(int inputWidth, int inputHeight, const std::vector<htfe::LayerDesc> &layerDescs,
+		std::vector<std::vector<int>> &offsets, std::vector<std::vector<int>> &entries)
+	{
+		offsets.resize(layerDescs.size());
+		entries.resize(layerDescs.size());
+
+		int prevWidth = inputWidth;
+		int prevHeight = inputHeight;
+
+		for (int l = 0; l < layerDescs.size(); l++) {
+			buildReconstructionErrorTable(layerDescs[l]._width, layerDescs[l]._height, prevWidth, prevHeight, layerDescs[l]._receptiveFieldRadius, layerDescs[l]._reconstructionRadius, offsets[l], entries[l]);
+
+			prevWidth = layerDescs[l]._width;
+			prevHeight = layerDescs[l]._height;
+		}
+	}
+
+	// Places of the buffers of a layer in the arena of its device
+	struct LayerRanges {
+		sys::ArenaRange _feedForwardWeights;
+		sys::ArenaRange _reconstructionWeights;
+		sys::ArenaRange _visibleBiases;
+		sys::ArenaRange _hiddenBiases;
+		sys::ArenaRange _lateralWeights;
+		sys::ArenaRange _feedBackWeights;
+
+		sys::ArenaRange _reconstructionErrorOffsets;
+		sys::ArenaRange _reconstructionErrorEntries;
+		sys::ArenaRange _activeUnits;
+		sys::ArenaRange _numActiveUnits;
+	};
+
+	// Reserves the buffers of every layer in the arena of its device. All weights and biases of a device are reserved before anything else,
+	// so they form the single range [0, parameterSizes[d]) that snapshots copy at once
+	void reserveLayerBuffers(std::vector<sys::DeviceArena> &arenas, std::vector<size_t> &parameterSizes, std::vector<LayerRanges> &ranges,
+		const std::vector<int> &devices, size_t weightSize, int inputWidth, int inputHeight, const std::vector<htfe::LayerDesc> &layerDescs,
+		const std::vector<std::vector<int>> &offsets, const std::vector<std::vector<int>> &entries)
+	{
+		ranges.resize(layerDescs.size());
+
+		int prevWidth = inputWidth;
+		int prevHeight = inputHeight;
+
+		for (int l = 0; l < layerDescs.size(); l++) {
+			sys::DeviceArena &arena = arenas[devices[l]];
+
+			size_t hiddenSize = layerDescs[l]._width * layerDescs[l]._height;
+			size_t visibleSize = prevWidth * prevHeight;
+
+			int numFeedForwardWeights = std::pow(layerDescs[l]._receptiveFieldRadius * 2 + 1, 2);
+			int numReconstructionWeights = std::pow(layerDescs[l]._reconstructionRadius * 2 + 1, 2);
+			int numLateralWeights = std::pow(layerDescs[l]._lateralConnectionRadius * 2 + 1, 2);
+			int numFeedBackWeights = std::pow(layerDescs[l]._feedBackConnectionRadius * 2 + 1, 2);
+
+			ranges[l]._feedForwardWeights = arena.reserve(hiddenSize * numFeedForwardWeights * weightSize);
+			ranges[l]._reconstructionWeights = arena.reserve(visibleSize * numReconstructionWeights * weightSize);
+			ranges[l]._visibleBiases = arena.reserve(visibleSize * sizeof(float));
+			ranges[l]._hiddenBiases = arena.reserve(hiddenSize * sizeof(float));
+			ranges[l]._lateralWeights = arena.reserve(hiddenSize * numLateralWeights * weightSize);
+			ranges[l]._feedBackWeights = arena.reserve(hiddenSize * numFeedBackWeights * weightSize);
+
+			prevWidth = layerDescs[l]._width;
+			prevHeight = layerDescs[l]._height;
+		}
+
+		parameterSizes.resize(arenas.size());
+
+		for (int d = 0; d < arenas.size(); d++)
+			parameterSizes[d] = arenas[d].getSize();
+
+		for (int l = 0; l < layerDescs.size(); l++) {
+			sys::DeviceArena &arena = arenas[devices[l]];
+
+			size_t hiddenSize = layerDescs[l]._width * layerDescs[l]._height;
+
+			ranges[l]._reconstructionErrorOffsets = arena.reserve(offsets[l].size() * sizeof(int));
+			ranges[l]._reconstructionErrorEntries = arena.reserve(entries[l].size() * sizeof(int));
+			ranges[l]._activeUnits = arena.reserve(hiddenSize * sizeof(int));
+			ranges[l]._numActiveUnits = arena.reserve(sizeof(int));
+		}
+	}
+
+	// Bytes of all images of a hierarchy as requested from the driver, the inputs, every layer and its boundary copies
+	size_t imageFootprint(int inputWidth, int inputHeight, const std::vector<htfe::LayerDesc> &layerDescs, const std::vector<int> &devices) {
+		size_t activationsSize = 2 * sizeof(float);
+
+		size_t size = 2 * static_cast<size_t>(inputWidth) * inputHeight * sizeof(float);
+
+		int prevWidth = inputWidth;
+		int prevHeight = inputHeight;
+
+		for (int l = 0; l < layerDescs.size(); l++) {
+			size_t hiddenSize = layerDescs[l]._width * layerDescs[l]._height;
+			size_t visibleSize = prevWidth * prevHeight;
+
+			size += hiddenSize * (3 * activationsSize + 5 * htfe::stateTexelSize) + visibleSize * 2 * sizeof(float);
+
+			if (l > 0 && devices[l] != devices[l - 1])
+				size += visibleSize * 2 * htfe::stateTexelSize;
+
+			if (l < layerDescs.size() - 1 && devices[l] != devices[l + 1])
+				size += layerDescs[l + 1]._width * layerDescs[l + 1]._height * (activationsSize + 2 * htfe::stateTexelSize);
+
+			prevWidth = layerDescs[l]._width;
+			prevHeight = layerDescs[l]._height;
+		}
+
+		return size;
+	}
+
+	// Size of the data store of a memory object, 0 if it was never created
+	size_t memorySize(const cl::Memory &memory) {
+		return memory() != nullptr ? memory.getInfo<CL_MEM_SIZE>() : 0;
+	}
+
+	// Wait list of a single event, empty while the event was never recorded
+	std::vector<cl::Event> waitList(const cl::Event &event) {
+		return event() != nullptr ? std::vector<cl::Event>(1, event) : std::vector<cl::Event>();
+	}
+
+	htfe::CheckpointTensor checkpointBuffer(cl::Buffer &buffer, int device) {
+		htfe::CheckpointTensor tensor;
+		tensor._pImage = nullptr;
+		tensor._pBuffer = &buffer;
+		tensor._width = tensor._height = 0;
+		tensor._size = buffer.getInfo<CL_MEM_SIZE>();
+		tensor._device = device;
+
+		return tensor;
+	}
+}
+
+bool HTFE::createLayers(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs) {
+	if (htfe::getWeightType(program) == _int8) {
+#ifdef SYS_DEBUG
+		std::cerr << "int8 weights can not learn, create an HTFEFrozen from a float HTFE instead!" << std::endl;
+#endif
+		return false;
+	}
+
+	_weightType = htfe::getWeightType(program);
+
+	size_t weightSize = weightTypeSize(_weightType);
+
+	_inputWidth = inputWidth;
+	_inputHeight = inputHeight;
+
+	_layerDescs = layerDescs;
+
+	_layers.clear();
+	_layers.resize(_layerDescs.size());
+
+	std::vector<int> devices = placeLayers(_layerDevices, _layers.size());
+
+	for (int l = 0; l < _layers.size(); l++) {
+		_layers[l]._device = devices[l];
+
+		if (_layers[l]._device < 0 || _layers[l]._device >= cs.getNumDevices()) {
+#ifdef SYS_DEBUG
+			std::cerr << "Layer " << l << " is placed on device " << _layers[l]._device << ", but the compute system has " << cs.getNumDevices() << " devices!" << std::endl;
+#endif
+			return false;
+		}
+	}
+
+	for (int l = 0; l < _layers.size(); l++) {
+		_layers[l]._boundaryBelow = l > 0 && _layers[l]._device != _layers[l - 1]._device;
+		_layers[l]._boundaryAbove = l < _layers.size() - 1 && _layers[l]._device != _layers[l + 1]._device;
+	}
+
+	// All buffers of the layers on a device are suballocated from one arena, planned completely before anything is allocated
+	std::vector<std::vector<int>> reconstructionErrorOffsets;
+	std::vector<std::vector<int>> reconstructionErrorEntries;
+
+	buildReconstructionErrorTables(_inputWidth, _inputHeight, _layerDescs, reconstructionErrorOffsets, reconstructionErrorEntries);
+
+	_arenas.resize(cs.getNumDevices());
+
+	for (int d = 0; d < _arenas.size(); d++)
+		_arenas[d].reset(sys::DeviceArena::getDeviceAlignment(cs.getDevice(d)));
+
+	std::vector<LayerRanges> ranges;
+
+	reserveLayerBuffers(_arenas, _parameterSizes, ranges, devices, weightSize, _inputWidth, _inputHeight, _layerDescs, reconstructionErrorOffsets, reconstructionErrorEntries);
+
+	_parameterSnapshots.clear();
+
+	for (int d = 0; d < _arenas.size(); d++) {
+		cl_ulong globalMemSize = cs.getDevice(d).getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+		if (_arenas[d].getSize() > globalMemSize) {
+#ifdef SYS_DEBUG
+			std::cerr << "The layers on device " << d << " need " << _arenas[d].getSize() << " bytes of buffers, the device has " << globalMemSize << "!" << std::endl;
+#endif
+			return false;
+		}
+
+		if (!_arenas[d].allocate(cs))
+			return false;
+	}
+
+	_input.clear();
+	_input.assign(_inputWidth * _inputHeight, 0.0f);
+
+	for (int slot = 0; slot < 2; slot++) {
+		size_t stagingSize = _inputWidth * _inputHeight * sizeof(float);
+
+		_inputStaging[slot] = cl::Buffer(cs.getContext(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, stagingSize);
+		_predictionStaging[slot] = cl::Buffer(cs.getContext(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, stagingSize);
+
+		// Stay mapped for the lifetime of the buffers, transfers to and from these pointers use pinned memory
+		_pInputStaging[slot] = static_cast<float*>(cs.getQueue().enqueueMapBuffer(_inputStaging[slot], CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, stagingSize));
+		_pPredictionStaging[slot] = static_cast<float*>(cs.getQueue().enqueueMapBuffer(_predictionStaging[slot], CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, stagingSize));
+
+		std::fill(_pInputStaging[slot], _pInputStaging[slot] + _inputWidth * _inputHeight, 0.0f);
+		std::fill(_pPredictionStaging[slot], _pPredictionStaging[slot] + _inputWidth * _inputHeight, 0.0f);
+
+		_inputEvents[slot] = cl::Event();
+		_predictionEvents[slot] = cl::Event();
+	}
+
+	_inputSlot = 0;
+	_pendingPredictionSlot = 0;
+	_predictionSlot = 0;
+
+	_inputImage = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _inputWidth, _inputHeight);
+	_inputImagePrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _inputWidth, _inputHeight);
+
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		_layers[l]._hiddenFeedForwardActivations = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
+		
+		_layers[l]._hiddenFeedBackActivations = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
+		_layers[l]._hiddenFeedBackActivationsPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
+
+		_layers[l]._hiddenStatesFeedForward = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+		_layers[l]._hiddenStatesFeedForwardPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+
+		_layers[l]._hiddenStatesFeedBack = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+		_layers[l]._hiddenStatesFeedBackPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+		_layers[l]._hiddenStatesFeedBackPrevPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+
+		sys::DeviceArena &arena = _arenas[_layers[l]._device];
+
+		_layers[l]._feedForwardWeights = arena.createView(ranges[l]._feedForwardWeights);
+		_layers[l]._reconstructionWeights = arena.createView(ranges[l]._reconstructionWeights);
+		_layers[l]._visibleBiases = arena.createView(ranges[l]._visibleBiases);
+		_layers[l]._hiddenBiases = arena.createView(ranges[l]._hiddenBiases);
+		_layers[l]._lateralWeights = arena.createView(ranges[l]._lateralWeights);
+		_layers[l]._feedBackWeights = arena.createView(ranges[l]._feedBackWeights);
+
+		_layers[l]._visibleReconstruction = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight);
+		_layers[l]._visibleReconstructionPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight);
+
+		_layers[l]._reconstructionErrorOffsets = arena.createView(ranges[l]._reconstructionErrorOffsets, CL_MEM_READ_ONLY);
+		_layers[l]._reconstructionErrorEntries = arena.createView(ranges[l]._reconstructionErrorEntries, CL_MEM_READ_ONLY);
+
+		cs.getQueue(_layers[l]._device).enqueueWriteBuffer(_layers[l]._reconstructionErrorOffsets, CL_TRUE, 0, ranges[l]._reconstructionErrorOffsets._size, reconstructionErrorOffsets[l].data());
+		cs.getQueue(_layers[l]._device).enqueueWriteBuffer(_layers[l]._reconstructionErrorEntries, CL_TRUE, 0, ranges[l]._reconstructionErrorEntries._size, reconstructionErrorEntries[l].data());
+
+		_layers[l]._activeUnits = arena.createView(ranges[l]._activeUnits);
+		_layers[l]._numActiveUnits = arena.createView(ranges[l]._numActiveUnits);
+
+		if (_layers[l]._boundaryBelow) {
+			_layers[l]._boundaryInput = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), prevWidth, prevHeight);
+			_layers[l]._boundaryInputPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), prevWidth, prevHeight);
+		}
+
+		if (_layers[l]._boundaryAbove) {
+			_layers[l]._boundaryNextActivations = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l + 1]._width, _layerDescs[l + 1]._height);
+			_layers[l]._boundaryNextStates = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l + 1]._width, _layerDescs[l + 1]._height);
+			_layers[l]._boundaryNextStatesPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l + 1]._width, _layerDescs[l + 1]._height);
+		}
+
+		prevWidth = _layerDescs[l]._width;
+		prevHeight = _layerDescs[l]._height;
+	}
+
+	// Layers with the same radii and sizes share a specialized program
+	std::map<std::string, cl::Program> specializedPrograms;
+
+	Int2 inputSize;
+	inputSize._x = _inputWidth;
+	inputSize._y = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		Int2 layerSize;
+		layerSize._x = _layerDescs[l]._width;
+		layerSize._y = _layerDescs[l]._height;
+
+		if (_specializeLayers) {
+			std::string options = specializationOptions(_layerDescs[l], inputSize._x, inputSize._y, l < _layers.size() - 1 ? &_layerDescs[l + 1] : nullptr);
+
+			std::map<std::string, cl::Program>::iterator it = specializedPrograms.find(options);
+
+			if (it == specializedPrograms.end()) {
+				sys::ComputeProgram specialized;
+
+				if (!specialized.createVariant(cs, program, options)) {
+#ifdef SYS_DEBUG
+					std::cerr << "Could not build the program specialized for layer " << l << "!" << std::endl;
+#endif
+					return false;
+				}
+
+				it = specializedPrograms.insert(std::make_pair(options, specialized.getProgram())).first;
+			}
+
+			_layers[l]._program = it->second;
+		}
+		else
+			_layers[l]._program = program.getProgram();
+
+		cl::Device &device = cs.getDevice(_layers[l]._device);
+
+		cl_ulong localMemSize = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+		size_t feedForwardWorkGroupSize = cl::Kernel(_layers[l]._program, "layerHiddenFeedForwardActivateInhibit").getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		size_t feedBackWorkGroupSize = cl::Kernel(_layers[l]._program, "layerHiddenFeedBackActivateInhibit").getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		size_t reconstructWorkGroupSize = cl::Kernel(_layers[l]._program, "layerVisibleReconstructTiled").getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+
+		size_t fusedWorkGroupSize = std::min(feedForwardWorkGroupSize, feedBackWorkGroupSize);
+
+		chooseTileSizes(_layerDescs[l], l < _layers.size() - 1 ? &_layerDescs[l + 1] : nullptr, inputSize, fusedWorkGroupSize, reconstructWorkGroupSize, localMemSize,
+			_layers[l]._fusedTileSize, _layers[l]._reconstructTileSize);
+
+		inputSize = layerSize;
+	}
+
+	_rolloutFeedBackKernel = cl::Kernel(program.getProgram(), "rolloutFeedBack");
+
+	bindLayerKernels();
+
+	return true;
+}
+
+void HTFE::bindLayerKernels() {
+	// Only int8 weights are scaled
+	Float4 weightScales;
+	weightScales._x = weightScales._y = weightScales._z = weightScales._w = 1.0f;
+
+	cl::Image2D* pPrevLayer = &_inputImage;
+	cl::Image2D* pPrevLayerFeedForwardPrev = &_inputImagePrev;
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		Layer &layer = _layers[l];
+
+		// Across a device boundary the layer below is read from the copies pushed into this layer
+		if (layer._boundaryBelow) {
+			pPrevLayer = &layer._boundaryInput;
+			pPrevLayerFeedForwardPrev = &layer._boundaryInputPrev;
+		}
+
+		float localActivity = std::round(_layerDescs[l]._sparsity * std::pow(2 * _layerDescs[l]._inhibitionRadius + 1, 2));
+
+		Int2 layerSize;
+		layerSize._x = _layerDescs[l]._width;
+		layerSize._y = _layerDescs[l]._height;
+
+		Int2 layerSizeMinusOne;
+		layerSizeMinusOne._x = _layerDescs[l]._width - 1;
+		layerSizeMinusOne._y = _layerDescs[l]._height - 1;
+
+		Float2 layerSizeMinusOneInv;
+		layerSizeMinusOneInv._x = 1.0f / (_layerDescs[l]._width - 1);
+		layerSizeMinusOneInv._y = 1.0f / (_layerDescs[l]._height - 1);
+
+		Int2 inputSize;
+		inputSize._x = prevWidth;
+		inputSize._y = prevHeight;
+
+		Int2 inputSizeMinusOne;
+		inputSizeMinusOne._x = prevWidth - 1;
+		inputSizeMinusOne._y = prevHeight - 1;
+
+		Float2 inputSizeMinusOneInv;
+		inputSizeMinusOneInv._x = 1.0f / (prevWidth - 1);
+		inputSizeMinusOneInv._y = 1.0f / (prevHeight - 1);
+
+		Int2 nextSize;
+		Int2 nextSizeMinusOne;
+
+		if (l == _layers.size() - 1) {
+			nextSize._x = nextSize._y = 1;
+			nextSizeMinusOne._x = nextSizeMinusOne._y = 0;
+		}
+		else {
+			nextSize._x = _layerDescs[l + 1]._width;
+			nextSize._y = _layerDescs[l + 1]._height;
+			nextSizeMinusOne._x = _layerDescs[l + 1]._width - 1;
+			nextSizeMinusOne._y = _layerDescs[l + 1]._height - 1;
+		}
+
+		int index;
+
+		// ------------------------------ Activate + Inhibit ------------------------------
+
+		if (layer._fusedTileSize > 0) {
+			int tileSize = layer._fusedTileSize;
+			int haloTileSize = tileSize + 2 * _layerDescs[l]._inhibitionRadius;
+
+			Int2 inputPatchSize = patchSize(haloTileSize, layerSize, inputSize, _layerDescs[l]._receptiveFieldRadius);
+
+			Int2 statesPatchSize;
+			statesPatchSize._x = statesPatchSize._y = haloTileSize + 2 * _layerDescs[l]._lateralConnectionRadius;
+
+			layer._feedForwardKernel = cl::Kernel(layer._program, "layerHiddenFeedForwardActivateInhibit");
+
+			index = 0;
+
+			layer._feedForwardKernel.setArg(index++, *pPrevLayer);
+			layer._feedForwardKernel.setArg(index++, layer._hiddenStatesFeedBackPrev);
+			layer._feedForwardKernel.setArg(index++, layer._feedForwardWeights);
+			layer._feedForwardKernel.setArg(index++, layer._lateralWeights);
+			layer._feedForwardKernel.setArg(index++, layer._hiddenBiases);
+			layer._feedForwardKernel.setArg(index++, layer._hiddenFeedForwardActivations);
+			layer._feedForwardKernel.setArg(index++, layer._hiddenStatesFeedForward);
+			layer._feedForwardKernel.setArg(index++, cl::Local(haloTileSize * haloTileSize * sizeof(float)));
+			layer._feedForwardKernel.setArg(index++, cl::Local(patchArea(inputPatchSize) * sizeof(float)));
+			layer._feedForwardKernel.setArg(index++, cl::Local(patchArea(statesPatchSize) * sizeof(float)));
+			layer._feedForwardKernel.setArg(index++, cl::Local(patchArea(statesPatchSize) * sizeof(int)));
+			layer._feedForwardKernel.setArg(index++, inputPatchSize);
+			layer._feedForwardKernel.setArg(index++, statesPatchSize);
+			layer._feedForwardKernel.setArg(index++, layerSize);
+			layer._feedForwardKernel.setArg(index++, layerSizeMinusOneInv);
+			layer._feedForwardKernel.setArg(index++, inputSize);
+			layer._feedForwardKernel.setArg(index++, inputSizeMinusOne);
+			layer._feedForwardKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
+			layer._feedForwardKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
+			layer._feedForwardKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+			layer._feedForwardKernel.setArg(index++, localActivity);
+			layer._feedForwardKernel.setArg(index++, weightScales);
+
+			if (l < _layers.size() - 1) {
+				Int2 nextPatchSize = patchSize(haloTileSize, layerSize, nextSize, _layerDescs[l]._feedBackConnectionRadius);
+
+				layer._feedBackKernel = cl::Kernel(layer._program, "layerHiddenFeedBackActivateInhibit");
+
+				index = 0;
+
+				layer._feedBackKernel.setArg(index++, layer._hiddenFeedForwardActivations);
+				layer._feedBackKernel.setArg(index++, layer._boundaryAbove ? layer._boundaryNextActivations : _layers[l + 1]._hiddenFeedBackActivations);
+				layer._feedBackKernel.setArg(index++, layer._feedBackWeights);
+				layer._feedBackKernel.setArg(index++, layer._hiddenFeedBackActivations);
+				layer._feedBackKernel.setArg(index++, layer._hiddenStatesFeedBack);
+				layer._feedBackKernel.setArg(index++, cl::Local(haloTileSize * haloTileSize * sizeof(float)));
+				layer._feedBackKernel.setArg(index++, cl::Local(patchArea(nextPatchSize) * sizeof(float)));
+				layer._feedBackKernel.setArg(index++, nextPatchSize);
+				layer._feedBackKernel.setArg(index++, layerSize);
+				layer._feedBackKernel.setArg(index++, layerSizeMinusOneInv);
+				layer._feedBackKernel.setArg(index++, nextSize);
+				layer._feedBackKernel.setArg(index++, nextSizeMinusOne);
+				layer._feedBackKernel.setArg(index++, _layerDescs[l]._feedBackConnectionRadius);
+				layer._feedBackKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+				layer._feedBackKernel.setArg(index++, localActivity);
+				layer._feedBackKernel.setArg(index++, weightScales);
+			}
+
+			layer._hiddenRange = cl::NDRange(roundUp(_layerDescs[l]._width, tileSize), roundUp(_layerDescs[l]._height, tileSize));
+			layer._hiddenLocalRange = cl::NDRange(tileSize, tileSize);
+		}
+		else {
+			layer._feedForwardKernel = cl::Kernel(layer._program, "layerHiddenFeedForwardActivate");
+
+			index = 0;
+
+			layer._feedForwardKernel.setArg(index++, *pPrevLayer);
+			layer._feedForwardKernel.setArg(index++, layer._hiddenStatesFeedBackPrev);
+			layer._feedForwardKernel.setArg(index++, layer._feedForwardWeights);
+			layer._feedForwardKernel.setArg(index++, layer._lateralWeights);
+			layer._feedForwardKernel.setArg(index++, layer._hiddenBiases);
+			layer._feedForwardKernel.setArg(index++, layer._hiddenFeedForwardActivations);
+			layer._feedForwardKernel.setArg(index++, layerSize);
+			layer._feedForwardKernel.setArg(index++, layerSizeMinusOneInv);
+			layer._feedForwardKernel.setArg(index++, inputSize);
+			layer._feedForwardKernel.setArg(index++, inputSizeMinusOne);
+			layer._feedForwardKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
+			layer._feedForwardKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
+			layer._feedForwardKernel.setArg(index++, weightScales);
+
+			layer._feedForwardInhibitKernel = cl::Kernel(layer._program, "layerHiddenInhibit");
+
+			index = 0;
+
+			layer._feedForwardInhibitKernel.setArg(index++, layer._hiddenFeedForwardActivations);
+			layer._feedForwardInhibitKernel.setArg(index++, layer._hiddenStatesFeedForwardPrev);
+			layer._feedForwardInhibitKernel.setArg(index++, layer._hiddenStatesFeedForward);
+			layer._feedForwardInhibitKernel.setArg(index++, layerSize);
+			layer._feedForwardInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+			layer._feedForwardInhibitKernel.setArg(index++, localActivity);
+
+			if (l < _layers.size() - 1) {
+				layer._feedBackKernel = cl::Kernel(layer._program, "layerHiddenFeedBackActivate");
+
+				index = 0;
+
+				layer._feedBackKernel.setArg(index++, layer._hiddenFeedForwardActivations);
+				layer._feedBackKernel.setArg(index++, layer._boundaryAbove ? layer._boundaryNextActivations : _layers[l + 1]._hiddenFeedBackActivations);
+				layer._feedBackKernel.setArg(index++, layer._feedBackWeights);
+				layer._feedBackKernel.setArg(index++, layer._hiddenFeedBackActivations);
+				layer._feedBackKernel.setArg(index++, layerSize);
+				layer._feedBackKernel.setArg(index++, layerSizeMinusOneInv);
+				layer._feedBackKernel.setArg(index++, nextSize);
+				layer._feedBackKernel.setArg(index++, nextSizeMinusOne);
+				layer._feedBackKernel.setArg(index++, _layerDescs[l]._feedBackConnectionRadius);
+				layer._feedBackKernel.setArg(index++, weightScales);
+
+				layer._feedBackInhibitKernel = cl::Kernel(layer._program, "layerHiddenInhibit");
+
+				index = 0;
+
+				layer._feedBackInhibitKernel.setArg(index++, layer._hiddenFeedBackActivations);
+				layer._feedBackInhibitKernel.setArg(index++, layer._hiddenStatesFeedBackPrev);
+				layer._feedBackInhibitKernel.setArg(index++, layer._hiddenStatesFeedBack);
+				layer._feedBackInhibitKernel.setArg(index++, layerSize);
+				layer._feedBackInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+				layer._feedBackInhibitKernel.setArg(index++, localActivity);
+			}
+
+			layer._hiddenRange = cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height);
+			layer._hiddenLocalRange = cl::NullRange;
+		}
+
+		// --------------------------------- Reconstruct ---------------------------------
+
+		if (layer._reconstructTileSize > 0) {
+			int tileSize = layer._reconstructTileSize;
+
+			Int2 hiddenPatchSize = patchSize(tileSize, inputSize, layerSize, _layerDescs[l]._reconstructionRadius);
+
+			layer._reconstructKernel = cl::Kernel(layer._program, "layerVisibleReconstructTiled");
+
+			index = 0;
+
+			layer._reconstructKernel.setArg(index++, layer._hiddenStatesFeedBack);
+			layer._reconstructKernel.setArg(index++, layer._reconstructionWeights);
+			layer._reconstructKernel.setArg(index++, layer._visibleBiases);
+			layer._reconstructKernel.setArg(index++, layer._visibleReconstruction);
+			layer._reconstructKernel.setArg(index++, cl::Local(patchArea(hiddenPatchSize) * sizeof(float)));
+			layer._reconstructKernel.setArg(index++, cl::Local(patchArea(hiddenPatchSize) * sizeof(int)));
+			layer._reconstructKernel.setArg(index++, hiddenPatchSize);
+			layer._reconstructKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
+			layer._reconstructKernel.setArg(index++, inputSizeMinusOne);
+			layer._reconstructKernel.setArg(index++, inputSizeMinusOneInv);
+			layer._reconstructKernel.setArg(index++, layerSize);
+			layer._reconstructKernel.setArg(index++, layerSizeMinusOne);
+			layer._reconstructKernel.setArg(index++, layerSizeMinusOneInv);
+			layer._reconstructKernel.setArg(index++, weightScales);
+
+			layer._visibleRange = cl::NDRange(roundUp(prevWidth, tileSize), roundUp(prevHeight, tileSize));
+			layer._visibleLocalRange = cl::NDRange(tileSize, tileSize);
+		}
+		else {
+			layer._reconstructKernel = cl::Kernel(layer._program, "layerVisibleReconstruct");
+
+			index = 0;
+
+			layer._reconstructKernel.setArg(index++, layer._hiddenStatesFeedBack);
+			layer._reconstructKernel.setArg(index++, layer._reconstructionWeights);
+			layer._reconstructKernel.setArg(index++, layer._visibleBiases);
+			layer._reconstructKernel.setArg(index++, layer._visibleReconstruction);
+			layer._reconstructKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
+			layer._reconstructKernel.setArg(index++, inputSizeMinusOne);
+			layer._reconstructKernel.setArg(index++, inputSizeMinusOneInv);
+			layer._reconstructKernel.setArg(index++, layerSize);
+			layer._reconstructKernel.setArg(index++, layerSizeMinusOne);
+			layer._reconstructKernel.setArg(index++, layerSizeMinusOneInv);
+			layer._reconstructKernel.setArg(index++, weightScales);
+
+			layer._visibleRange = cl::NDRange(prevWidth, prevHeight);
+			layer._visibleLocalRange = cl::NullRange;
+		}
+
+		// -------------------------------- Weight Updates --------------------------------
+
+		layer._listActiveUnitsKernel = cl::Kernel(layer._program, "layerListActiveUnits");
+
+		index = 0;
+
+		layer._listActiveUnitsKernel.setArg(index++, layer._hiddenStatesFeedBackPrev);
+		layer._listActiveUnitsKernel.setArg(index++, layer._activeUnits);
+		layer._listActiveUnitsKernel.setArg(index++, layer._numActiveUnits);
+
+		Float4 alphas;
+		alphas._x = _layerDescs[l]._feedForwardAlpha;
+		alphas._y = _layerDescs[l]._lateralAlpha;
+		alphas._z = _layerDescs[l]._feedBackAlpha;
+		alphas._w = _layerDescs[l]._hiddenBiasAlpha;
+
+		index = 0;
+
+		if (l == _layers.size() - 1) {
+			layer._hiddenWeightUpdateKernel = cl::Kernel(layer._program, "layerHiddenWeightUpdateLast");
+
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._visibleReconstructionPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, *pPrevLayer);
+			layer._hiddenWeightUpdateKernel.setArg(index++, *pPrevLayerFeedForwardPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._hiddenFeedBackActivationsPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._hiddenStatesFeedBackPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._hiddenStatesFeedBackPrevPrev);
+		}
+		else {
+			layer._hiddenWeightUpdateKernel = cl::Kernel(layer._program, "layerHiddenWeightUpdate");
+
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._visibleReconstructionPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, *pPrevLayer);
+			layer._hiddenWeightUpdateKernel.setArg(index++, *pPrevLayerFeedForwardPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._hiddenFeedBackActivationsPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._hiddenStatesFeedBackPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._hiddenStatesFeedBackPrevPrev);
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._boundaryAbove ? layer._boundaryNextStatesPrev : _layers[l + 1]._hiddenStatesFeedBackPrev);
+		}
+
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._activeUnits);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._numActiveUnits);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._reconstructionWeights);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._reconstructionErrorOffsets);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._reconstructionErrorEntries);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._feedForwardWeights);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._lateralWeights);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layer._hiddenBiases);
+
+		if (l < _layers.size() - 1)
+			layer._hiddenWeightUpdateKernel.setArg(index++, layer._feedBackWeights);
+
+		layer._hiddenWeightUpdateKernel.setArg(index++, layerSize);
+		layer._hiddenWeightUpdateKernel.setArg(index++, layerSizeMinusOneInv);
+		layer._hiddenWeightUpdateKernel.setArg(index++, inputSize);
+		layer._hiddenWeightUpdateKernel.setArg(index++, inputSizeMinusOne);
+
+		if (l < _layers.size() - 1) {
+			layer._hiddenWeightUpdateKernel.setArg(index++, nextSize);
+			layer._hiddenWeightUpdateKernel.setArg(index++, nextSizeMinusOne);
+		}
+
+		layer._hiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
+		layer._hiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
+
+		if (l < _layers.size() - 1)
+			layer._hiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._feedBackConnectionRadius);
+
+		layer._hiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._sparsity);
+		layer._hiddenWeightUpdateKernel.setArg(index++, alphas);
+		layer._hiddenWeightUpdateKernel.setArg(index++, _layerDescs[l]._weightDecay);
+
+		layer._visibleWeightUpdateKernel = cl::Kernel(layer._program, "layerVisibleWeightUpdate");
+
+		index = 0;
+
+		layer._visibleWeightUpdateKernel.setArg(index++, layer._visibleReconstructionPrev);
+		layer._visibleWeightUpdateKernel.setArg(index++, *pPrevLayer);
+		layer._visibleWeightUpdateKernel.setArg(index++, layer._hiddenStatesFeedBackPrev);
+		layer._visibleWeightUpdateKernel.setArg(index++, layer._reconstructionWeights);
+		layer._visibleWeightUpdateKernel.setArg(index++, layer._visibleBiases);
+		layer._visibleWeightUpdateKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
+		layer._visibleWeightUpdateKernel.setArg(index++, inputSizeMinusOne);
+		layer._visibleWeightUpdateKernel.setArg(index++, inputSizeMinusOneInv);
+		layer._visibleWeightUpdateKernel.setArg(index++, layerSize);
+		layer._visibleWeightUpdateKernel.setArg(index++, layerSizeMinusOne);
+		layer._visibleWeightUpdateKernel.setArg(index++, layerSizeMinusOneInv);
+		layer._visibleWeightUpdateKernel.setArg(index++, _layerDescs[l]._reconstructionAlpha);
+
+		layer._unitRange = cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height);
+		layer._visibleUnitRange = cl::NDRange(prevWidth, prevHeight);
+		layer._updateRange = cl::NDRange(_layerDescs[l]._width * _layerDescs[l]._height);
+
+		pPrevLayer = &layer._hiddenStatesFeedForward;
+		pPrevLayerFeedForwardPrev = &layer._hiddenStatesFeedForwardPrev;
+		prevWidth = _layerDescs[l]._width;
+		prevHeight = _layerDescs[l]._height;
+	}
+}
+
+void HTFE::bindLayerImages() {
+	cl::Image2D* pPrevLayer = &_inputImage;
+	cl::Image2D* pPrevLayerFeedForwardPrev = &_inputImagePrev;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		Layer &layer = _layers[l];
+
+		if (layer._boundaryBelow) {
+			pPrevLayer = &layer._boundaryInput;
+			pPrevLayerFeedForwardPrev = &layer._boundaryInputPrev;
+		}
+
+		layer._feedForwardKernel.setArg(0, *pPrevLayer);
+		layer._feedForwardKernel.setArg(1, layer._hiddenStatesFeedBackPrev);
+
+		if (layer._fusedTileSize > 0)
+			layer._feedForwardKernel.setArg(6, layer._hiddenStatesFeedForward);
+		else {
+			layer._feedForwardInhibitKernel.setArg(1, layer._hiddenStatesFeedForwardPrev);
+			layer._feedForwardInhibitKernel.setArg(2, layer._hiddenStatesFeedForward);
+		}
+
+		if (l < _layers.size() - 1) {
+			layer._feedBackKernel.setArg(1, layer._boundaryAbove ? layer._boundaryNextActivations : _layers[l + 1]._hiddenFeedBackActivations);
+			layer._feedBackKernel.setArg(3, layer._hiddenFeedBackActivations);
+
+			if (layer._fusedTileSize > 0)
+				layer._feedBackKernel.setArg(4, layer._hiddenStatesFeedBack);
+			else {
+				layer._feedBackInhibitKernel.setArg(0, layer._hiddenFeedBackActivations);
+				layer._feedBackInhibitKernel.setArg(1, layer._hiddenStatesFeedBackPrev);
+				layer._feedBackInhibitKernel.setArg(2, layer._hiddenStatesFeedBack);
+			}
+		}
+
+		layer._reconstructKernel.setArg(0, layer._hiddenStatesFeedBack);
+		layer._reconstructKernel.setArg(3, layer._visibleReconstruction);
+
+		layer._listActiveUnitsKernel.setArg(0, layer._hiddenStatesFeedBackPrev);
+
+		layer._hiddenWeightUpdateKernel.setArg(0, layer._visibleReconstructionPrev);
+		layer._hiddenWeightUpdateKernel.setArg(1, *pPrevLayer);
+		layer._hiddenWeightUpdateKernel.setArg(2, *pPrevLayerFeedForwardPrev);
+		layer._hiddenWeightUpdateKernel.setArg(3, layer._hiddenFeedBackActivationsPrev);
+		layer._hiddenWeightUpdateKernel.setArg(4, layer._hiddenStatesFeedBackPrev);
+		layer._hiddenWeightUpdateKernel.setArg(5, layer._hiddenStatesFeedBackPrevPrev);
+
+		if (l < _layers.size() - 1)
+			layer._hiddenWeightUpdateKernel.setArg(6, layer._boundaryAbove ? layer._boundaryNextStatesPrev : _layers[l + 1]._hiddenStatesFeedBackPrev);
+
+		layer._visibleWeightUpdateKernel.setArg(0, layer._visibleReconstructionPrev);
+		layer._visibleWeightUpdateKernel.setArg(1, *pPrevLayer);
+		layer._visibleWeightUpdateKernel.setArg(2, layer._hiddenStatesFeedBackPrev);
+
+		pPrevLayer = &layer._hiddenStatesFeedForward;
+		pPrevLayerFeedForwardPrev = &layer._hiddenStatesFeedForwardPrev;
+	}
+}
+
+bool HTFE::createRandom(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight) {
+	std::random_device device;
+
+	return createRandom(cs, program, inputWidth, inputHeight, layerDescs, minInitWeight, maxInitWeight, device());
+}
+
+bool HTFE::createRandom(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight, unsigned int seed) {
+	if (!createLayers(cs, program, inputWidth, inputHeight, layerDescs))
+		return false;
+
+	_seed = seed;
+
+	cl::Kernel initializeWeightsKernel = cl::Kernel(program.getProgram(), "initializeWeights");
+	cl::Kernel initializeLayerHiddenKernel = cl::Kernel(program.getProgram(), "initializeLayerHidden");
+	cl::Kernel initializeLayerVisibleKernel = cl::Kernel(program.getProgram(), "initializeLayerVisible");
+
+	{
+		cl_uint4 clear = { 0, 0, 0, 0 };
+
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = _inputWidth;
+		region[1] = _inputHeight;
+		region[2] = 1;
+
+		cs.getQueue(_layers.front()._device).enqueueFillImage(_inputImage, clear, origin, region);
+		cs.getQueue(_layers.front()._device).enqueueFillImage(_inputImagePrev, clear, origin, region);
+	}
+
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		int numFeedForwardWeights = std::pow(_layerDescs[l]._receptiveFieldRadius * 2 + 1, 2);
+		int numReconstructionWeights = std::pow(_layerDescs[l]._reconstructionRadius * 2 + 1, 2);
+		int numLateralWeights = std::pow(_layerDescs[l]._lateralConnectionRadius * 2 + 1, 2);
+		int numFeedBackWeights = std::pow(_layerDescs[l]._feedBackConnectionRadius * 2 + 1, 2);
+
+		cl::CommandQueue &queue = cs.getQueue(_layers[l]._device);
+
+		// Every tensor draws from its own stream of the seed, so no value depends on the launch order or on the other tensors
+		cl_uint stream = l * numInitStreams;
+
+		struct {
+			cl::Buffer* _pWeights;
+			int _width, _height, _numWeights;
+			float _scalar;
+		} weightTensors[] = {
+			{ &_layers[l]._feedForwardWeights, _layerDescs[l]._width, _layerDescs[l]._height, numFeedForwardWeights, 1.0f },
+			{ &_layers[l]._lateralWeights, _layerDescs[l]._width, _layerDescs[l]._height, numLateralWeights, _layerDescs[l]._lateralScalar },
+			{ &_layers[l]._feedBackWeights, _layerDescs[l]._width, _layerDescs[l]._height, numFeedBackWeights, _layerDescs[l]._feedBackScalar },
+			{ &_layers[l]._reconstructionWeights, prevWidth, prevHeight, numReconstructionWeights, 1.0f }
+		};
+
+		for (int t = 0; t < sizeof(weightTensors) / sizeof(weightTensors[0]); t++) {
+			int index = 0;
+
+			initializeWeightsKernel.setArg(index++, *weightTensors[t]._pWeights);
+			initializeWeightsKernel.setArg(index++, seed);
+			initializeWeightsKernel.setArg(index++, stream++);
+			initializeWeightsKernel.setArg(index++, weightTensors[t]._scalar);
+			initializeWeightsKernel.setArg(index++, minInitWeight);
+			initializeWeightsKernel.setArg(index++, maxInitWeight);
+
+			queue.enqueueNDRangeKernel(initializeWeightsKernel, cl::NullRange, cl::NDRange(weightTensors[t]._width, weightTensors[t]._height, weightTensors[t]._numWeights));
+		}
+
+		int index = 0;
+
+		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
+		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenStatesFeedForward);
+		initializeLayerHiddenKernel.setArg(index++, _layers[l]._hiddenBiases);
+		initializeLayerHiddenKernel.setArg(index++, seed);
+		initializeLayerHiddenKernel.setArg(index++, stream++);
+		initializeLayerHiddenKernel.setArg(index++, minInitWeight);
+		initializeLayerHiddenKernel.setArg(index++, maxInitWeight);
+
+		queue.enqueueNDRangeKernel(initializeLayerHiddenKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
+
+		index = 0;
+
+		initializeLayerVisibleKernel.setArg(index++, _layers[l]._visibleBiases);
+		initializeLayerVisibleKernel.setArg(index++, _layers[l]._visibleReconstruction);
+		initializeLayerVisibleKernel.setArg(index++, seed);
+		initializeLayerVisibleKernel.setArg(index++, stream++);
+		initializeLayerVisibleKernel.setArg(index++, minInitWeight);
+		initializeLayerVisibleKernel.setArg(index++, maxInitWeight);
+
+		queue.enqueueNDRangeKernel(initializeLayerVisibleKernel, cl::NullRange, cl::NDRange(prevWidth, prevHeight));
+
+		{
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = _layerDescs[l]._width;
+			region[1] = _layerDescs[l]._height;
+			region[2] = 1;
+
+			queue.enqueueCopyImage(_layers[l]._hiddenFeedBackActivations, _layers[l]._hiddenFeedBackActivationsPrev, origin, origin, region);
+		}
+
+		{
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = prevWidth;
+			region[1] = prevHeight;
+			region[2] = 1;
+
+			queue.enqueueCopyImage(_layers[l]._visibleReconstruction, _layers[l]._visibleReconstructionPrev, origin, origin, region);
+		}
+
+		{
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = _layerDescs[l]._width;
+			region[1] = _layerDescs[l]._height;
+			region[2] = 1;
+
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedForwardPrev, origin, origin, region);
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBack, origin, origin, region);
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBackPrev, origin, origin, region);
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBackPrevPrev, origin, origin, region);
+		}
+
+		prevWidth = _layerDescs[l]._width;
+		prevHeight = _layerDescs[l]._height;
+	}
+
+	syncBoundaries(cs);
+
+	return true;
+}
+
+void HTFE::activate(sys::ComputeSystem &cs) {
+	activateAsync(cs);
+
+	waitForPrediction();
+}
+
+void HTFE::waitForPrediction() {
+	if (_predictionEvents[_pendingPredictionSlot]() != nullptr)
+		_predictionEvents[_pendingPredictionSlot].wait();
+
+	_predictionSlot = _pendingPredictionSlot;
+}
+
+cl::Event* HTFE::profileEvent(const char* phase, int layer) {
+	if (_pProfiler == nullptr)
+		return nullptr;
+
+	return _pProfiler->event(phase, layer, _layers[std::max(0, layer)]._device);
+}
+
+void HTFE::profileRecord(const cl::Event &event, const char* phase, int layer) {
+	if (_pProfiler != nullptr)
+		_pProfiler->record(event, phase, layer, _layers[std::max(0, layer)]._device);
+}
+
+cl::Event HTFE::activateAsync(sys::ComputeSystem &cs) {
+	int slot = _inputSlot;
+
+	// The upload enqueued from this slot two steps ago has to finish before the host overwrites it
+	if (_inputEvents[slot]() != nullptr)
+		_inputEvents[slot].wait();
+
+	std::copy(_input.begin(), _input.end(), _pInputStaging[slot]);
+
+	{
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = _inputWidth;
+		region[1] = _inputHeight;
+		region[2] = 1;
+
+		cs.getQueue(_layers.front()._device).enqueueWriteImage(_inputImage, CL_FALSE, origin, region, 0, 0, _pInputStaging[slot], nullptr, &_inputEvents[slot]);
+
+		profileRecord(_inputEvents[slot], "input", -1);
+	}
+
+	enqueueLayers(cs);
+
+	{
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = _inputWidth;
+		region[1] = _inputHeight;
+		region[2] = 1;
+
+		cs.getQueue(_layers.front()._device).enqueueReadImage(_layers.front()._visibleReconstruction, CL_FALSE, origin, region, 0, 0, _pPredictionStaging[slot], nullptr, &_predictionEvents[slot]);
+
+		profileRecord(_predictionEvents[slot], "prediction", -1);
+	}
+
+	for (int d = 0; d < cs.getNumDevices(); d++)
+		cs.getQueue(d).flush();
+
+	_pendingPredictionSlot = slot;
+
+	_inputSlot = 1 - slot;
+
+	return _predictionEvents[slot];
+}
+
+void HTFE::enqueueLayers(sys::ComputeSystem &cs) {
+	// Every argument was bound in createLayers and stepEnd, only the enqueues are left
+
+	// ------------------------------------------------------------------------------
+	// ------------------------------------ Go up -----------------------------------
+	// ------------------------------------------------------------------------------
+
+	// Each layer runs on the queue of its device. Across a device boundary the producer pushes the images the consumer reads
+	// right after computing them, and the consumer waits only for that push
+
+	for (int l = 0; l < _layers.size(); l++) {
+		cl::CommandQueue &queue = cs.getQueue(_layers[l]._device);
+
+		std::vector<cl::Event> waitEvents;
+
+		if (_layers[l]._boundaryBelow)
+			waitEvents = waitList(_layers[l]._boundaryInputEvent);
+
+		queue.enqueueNDRangeKernel(_layers[l]._feedForwardKernel, cl::NullRange, _layers[l]._hiddenRange, _layers[l]._hiddenLocalRange, &waitEvents, profileEvent("up", l));
+
+		if (_layers[l]._fusedTileSize == 0)
+			queue.enqueueNDRangeKernel(_layers[l]._feedForwardInhibitKernel, cl::NullRange, _layers[l]._hiddenRange, cl::NullRange, nullptr, profileEvent("up", l));
+
+		if (l < _layers.size() - 1 && _layers[l + 1]._boundaryBelow) {
+			Layer &next = _layers[l + 1];
+
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = _layerDescs[l]._width;
+			region[1] = _layerDescs[l]._height;
+			region[2] = 1;
+
+			// Overwrites what the layer above read last step, so wait for its last command
+			waitEvents = waitList(next._doneEvent);
+
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, next._boundaryInput, origin, origin, region, &waitEvents, &next._boundaryInputEvent);
+
+			profileRecord(next._boundaryInputEvent, "transfer", l);
+
+			queue.flush();
+		}
+	}
+
+	// ------------------------------------------------------------------------------
+	// -------------------------------- Go back down --------------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = _layers.size() - 1; l >= 0; l--) {
+		cl::CommandQueue &queue = cs.getQueue(_layers[l]._device);
+
+		if (l == _layers.size() - 1) {
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = _layerDescs[l]._width;
+			region[1] = _layerDescs[l]._height;
+			region[2] = 1;
+
+			// Without feed back the top layer inhibits the same activations as on the way up, so its states are copied as well
+			queue.enqueueCopyImage(_layers[l]._hiddenFeedForwardActivations, _layers[l]._hiddenFeedBackActivations, origin, origin, region, nullptr, profileEvent("down", l));
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBack, origin, origin, region, nullptr, profileEvent("down", l));
+		}
+		else {
+			std::vector<cl::Event> waitEvents;
+
+			if (_layers[l]._boundaryAbove)
+				waitEvents = waitList(_layers[l]._boundaryNextEvent);
+
+			queue.enqueueNDRangeKernel(_layers[l]._feedBackKernel, cl::NullRange, _layers[l]._hiddenRange, _layers[l]._hiddenLocalRange, &waitEvents, profileEvent("down", l));
+
+			if (_layers[l]._fusedTileSize == 0)
+				queue.enqueueNDRangeKernel(_layers[l]._feedBackInhibitKernel, cl::NullRange, _layers[l]._hiddenRange, cl::NullRange, nullptr, profileEvent("down", l));
+		}
+
+		if (l > 0 && _layers[l - 1]._boundaryAbove) {
+			Layer &below = _layers[l - 1];
+
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = _layerDescs[l]._width;
+			region[1] = _layerDescs[l]._height;
+			region[2] = 1;
+
+			std::vector<cl::Event> waitEvents = waitList(below._doneEvent);
+
+			queue.enqueueCopyImage(_layers[l]._hiddenFeedBackActivations, below._boundaryNextActivations, origin, origin, region, &waitEvents, profileEvent("transfer", l));
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedBack, below._boundaryNextStates, origin, origin, region, nullptr, &below._boundaryNextEvent);
+
+			profileRecord(below._boundaryNextEvent, "transfer", l);
+
+			queue.flush();
+		}
+
+		// --------------------- Make Predictions (Reconstruction) ---------------------
+
+		if (_layers[l]._boundaryBelow || _layers[l]._boundaryAbove) {
+			queue.enqueueNDRangeKernel(_layers[l]._reconstructKernel, cl::NullRange, _layers[l]._visibleRange, _layers[l]._visibleLocalRange, nullptr, &_layers[l]._doneEvent);
+
+			profileRecord(_layers[l]._doneEvent, "reconstruct", l);
+		}
+		else
+			queue.enqueueNDRangeKernel(_layers[l]._reconstructKernel, cl::NullRange, _layers[l]._visibleRange, _layers[l]._visibleLocalRange, nullptr, profileEvent("reconstruct", l));
+	}
+}
+
+void HTFE::runChunked(sys::ComputeSystem &cs, int numSteps, float* predictions, bool learning,
+	const std::function<void(int, int)> &beginChunk, const std::function<void(int, int)> &enqueueInput)
+{
+	if (numSteps <= 0)
+		return;
+
+	cl::CommandQueue &queue = cs.getQueue(_layers.front()._device);
+
+	size_t frameSize = _inputWidth * _inputHeight * sizeof(float);
+
+	// Frames go up and predictions come back in chunks of about sequenceChunkSize bytes
+	int chunkSteps = sequenceChunkSteps(frameSize, numSteps);
+
+	cl::Buffer chunkPredictions;
+
+	if (predictions != nullptr)
+		chunkPredictions = cl::Buffer(cs.getContext(), CL_MEM_WRITE_ONLY, chunkSteps * frameSize);
+
+	cl::size_t<3> origin;
+	origin[0] = 0;
+	origin[1] = 0;
+	origin[2] = 0;
+
+	cl::size_t<3> region;
+	region[0] = _inputWidth;
+	region[1] = _inputHeight;
+	region[2] = 1;
+
+	for (int chunkStart = 0; chunkStart < numSteps; chunkStart += chunkSteps) {
+		int steps = std::min(chunkSteps, numSteps - chunkStart);
+
+		if (beginChunk)
+			beginChunk(chunkStart, steps);
+
+		for (int s = 0; s < steps; s++) {
+			enqueueInput(chunkStart + s, s);
+
+			enqueueLayers(cs);
+
+			if (predictions != nullptr)
+				queue.enqueueCopyImageToBuffer(_layers.front()._visibleReconstruction, chunkPredictions, origin, region, s * frameSize, nullptr, profileEvent("prediction", -1));
+
+			// getPrediction continues from the last step whether or not predictions are wanted. Queued behind any activateAsync readback into that slot
+			if (chunkStart + s == numSteps - 1)
+				queue.enqueueReadImage(_layers.front()._visibleReconstruction, CL_FALSE, origin, region, 0, 0, _pPredictionStaging[_pendingPredictionSlot], nullptr, profileEvent("prediction", -1));
+
+			if (learning)
+				learn(cs);
+
+			stepEnd();
+		}
+
+		// Non blocking, the in order queue keeps the chunk buffer from being overwritten before the read. Caller memory stays valid until the finish below
+		if (predictions != nullptr)
+			queue.enqueueReadBuffer(chunkPredictions, CL_FALSE, 0, steps * frameSize, predictions + chunkStart * _inputWidth * _inputHeight, nullptr, profileEvent("prediction", -1));
+
+		for (int d = 0; d < cs.getNumDevices(); d++)
+			cs.getQueue(d).flush();
+	}
+
+	cs.finish();
+
+	// Pending readbacks of activateAsync completed with the finish, the pending slot now holds the last prediction
+	_predictionSlot = _pendingPredictionSlot;
+}
+
+void HTFE::runSequence(sys::ComputeSystem &cs, const float* inputs, int numSteps, float* predictions, bool learning) {
+	if (numSteps <= 0)
+		return;
+
+	cl::CommandQueue &queue = cs.getQueue(_layers.front()._device);
+
+	size_t frameSize = _inputWidth * _inputHeight * sizeof(float);
+
+	cl::Buffer chunkInputs(cs.getContext(), CL_MEM_READ_ONLY, sequenceChunkSteps(frameSize, numSteps) * frameSize);
+
+	cl::size_t<3> origin;
+	origin[0] = 0;
+	origin[1] = 0;
+	origin[2] = 0;
+
+	cl::size_t<3> region;
+	region[0] = _inputWidth;
+	region[1] = _inputHeight;
+	region[2] = 1;
+
+	runChunked(cs, numSteps, predictions, learning,
+		[&](int chunkStart, int steps) {
+			// Non blocking like the prediction reads, the in order queue keeps the buffer from being overwritten while the previous chunk uses it
+			queue.enqueueWriteBuffer(chunkInputs, CL_FALSE, 0, steps * frameSize, inputs + chunkStart * _inputWidth * _inputHeight, nullptr, profileEvent("input", -1));
+		},
+		[&](int, int chunkStep) {
+			queue.enqueueCopyBufferToImage(chunkInputs, _inputImage, chunkStep * frameSize, origin, region, nullptr, profileEvent("input", -1));
+		});
+}
+
+bool HTFE::runSequence(sys::ComputeSystem &cs, const std::vector<float> &inputs, std::vector<float> &predictions, bool learning) {
+	size_t frameSize = _inputWidth * _inputHeight;
+
+	if (inputs.size() % frameSize != 0) {
+#ifdef SYS_DEBUG
+		std::cerr << "Sequence of " << inputs.size() << " values is not a whole number of " << frameSize << " value frames!" << std::endl;
+#endif
+		return false;
+	}
+
+	predictions.resize(inputs.size());
+
+	runSequence(cs, inputs.data(), inputs.size() / frameSize, predictions.data(), learning);
+
+	return true;
+}
+
+void HTFE::rollout(sys::ComputeSystem &cs, int numSteps, float* predictions, RolloutMode mode, float threshold, unsigned int seed) {
+	cl::CommandQueue &queue = cs.getQueue(_layers.front()._device);
+
+	runChunked(cs, numSteps, predictions, false, std::function<void(int, int)>(),
+		[&](int step, int) {
+			// After stepEnd the prediction of the last step is the previous reconstruction
+			int index = 0;
+
+			_rolloutFeedBackKernel.setArg(index++, _layers.front()._visibleReconstructionPrev);
+			_rolloutFeedBackKernel.setArg(index++, _inputImage);
+			_rolloutFeedBackKernel.setArg(index++, static_cast<int>(mode));
+			_rolloutFeedBackKernel.setArg(index++, threshold);
+			_rolloutFeedBackKernel.setArg(index++, seed);
+			_rolloutFeedBackKernel.setArg(index++, static_cast<cl_uint>(step));
+
+			queue.enqueueNDRangeKernel(_rolloutFeedBackKernel, cl::NullRange, cl::NDRange(_inputWidth, _inputHeight), cl::NullRange, nullptr, profileEvent("input", -1));
+		});
+}
+
+void HTFE::learn(sys::ComputeSystem &cs) {
+	// ------------------------------------------------------------------------------
+	// ---------------------- Weight Update and Predictions  ------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = 0; l < _layers.size(); l++) {
+		cl::CommandQueue &queue = cs.getQueue(_layers[l]._device);
+
+		// Only units with an active previous state change their weights
+		queue.enqueueFillBuffer(_layers[l]._numActiveUnits, 0, 0, sizeof(int), nullptr, profileEvent("active list", l));
+
+		queue.enqueueNDRangeKernel(_layers[l]._listActiveUnitsKernel, cl::NullRange, _layers[l]._unitRange, cl::NullRange, nullptr, profileEvent("active list", l));
+		queue.enqueueNDRangeKernel(_layers[l]._hiddenWeightUpdateKernel, cl::NullRange, _layers[l]._updateRange, cl::NullRange, nullptr, profileEvent("hidden update", l));
+
+		if (_layers[l]._boundaryBelow || _layers[l]._boundaryAbove) {
+			queue.enqueueNDRangeKernel(_layers[l]._visibleWeightUpdateKernel, cl::NullRange, _layers[l]._visibleUnitRange, cl::NullRange, nullptr, &_layers[l]._doneEvent);
+
+			profileRecord(_layers[l]._doneEvent, "visible update", l);
+		}
+		else
+			queue.enqueueNDRangeKernel(_layers[l]._visibleWeightUpdateKernel, cl::NullRange, _layers[l]._visibleUnitRange, cl::NullRange, nullptr, profileEvent("visible update", l));
+	}
+
+	if (cs.getNumDevices() > 1) {
+		for (int d = 0; d < cs.getNumDevices(); d++)
+			cs.getQueue(d).flush();
+	}
+}
+
+void HTFE::stepEnd() {
+	// ------------------------------------------------------------------------------
+	// ---------------------------------- Step End ----------------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = 0; l < _layers.size(); l++) {
+		cl::Image2D temp2D;
+
+		std::swap(_layers[l]._visibleReconstruction, _layers[l]._visibleReconstructionPrev);
+		std::swap(_layers[l]._hiddenFeedBackActivations, _layers[l]._hiddenFeedBackActivationsPrev);
+		std::swap(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedForwardPrev);
+		
+		temp2D = _layers[l]._hiddenStatesFeedBackPrevPrev;
+		_layers[l]._hiddenStatesFeedBackPrevPrev = _layers[l]._hiddenStatesFeedBackPrev;
+		_layers[l]._hiddenStatesFeedBackPrev = _layers[l]._hiddenStatesFeedBack;
+		_layers[l]._hiddenStatesFeedBack = temp2D;
+
+		std::swap(_layers[l]._boundaryInput, _layers[l]._boundaryInputPrev);
+		std::swap(_layers[l]._boundaryNextStates, _layers[l]._boundaryNextStatesPrev);
+	}
+
+	std::swap(_inputImage, _inputImagePrev);
+
+	bindLayerImages();
+}
+
+void HTFE::clearMemory(sys::ComputeSystem &cs) {
+	// ------------------------------------------------------------------------------
+	// -------------------------------- Clear Memory --------------------------------
+	// ------------------------------------------------------------------------------
+
+	cl_uint4 clear = { 0, 0, 0, 0 };
+
+	// Boundary copies of the cleared states may still be read on other devices
+	if (cs.getNumDevices() > 1)
+		cs.finish();
+
+	for (int l = 0; l < _layers.size(); l++) {
+		cl::CommandQueue &queue = cs.getQueue(_layers[l]._device);
+
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = _layerDescs[l]._width;
+		region[1] = _layerDescs[l]._height;
+		region[2] = 1;
+
+		queue.enqueueFillImage(_layers[l]._hiddenStatesFeedBackPrevPrev, clear, origin, region);
+		queue.enqueueFillImage(_layers[l]._hiddenStatesFeedBackPrev, clear, origin, region);
+		queue.enqueueFillImage(_layers[l]._hiddenStatesFeedBack, clear, origin, region);
+	}
+
+	syncBoundaries(cs);
+}
+
+void HTFE::syncBoundaries(sys::ComputeSystem &cs) {
+	bool hasBoundaries = false;
+
+	for (int l = 0; l < _layers.size(); l++)
+		hasBoundaries = hasBoundaries || _layers[l]._boundaryBelow;
+
+	if (!hasBoundaries)
+		return;
+
+	cs.finish();
+
+	cl::size_t<3> origin;
+	origin[0] = 0;
+	origin[1] = 0;
+	origin[2] = 0;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		cl::size_t<3> region;
+		region[0] = _layerDescs[l]._width;
+		region[1] = _layerDescs[l]._height;
+		region[2] = 1;
+
+		cl::CommandQueue &queue = cs.getQueue(_layers[l]._device);
+
+		if (l < _layers.size() - 1 && _layers[l + 1]._boundaryBelow) {
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l + 1]._boundaryInput, origin, origin, region);
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedForwardPrev, _layers[l + 1]._boundaryInputPrev, origin, origin, region);
+		}
+
+		if (l > 0 && _layers[l - 1]._boundaryAbove) {
+			queue.enqueueCopyImage(_layers[l]._hiddenFeedBackActivations, _layers[l - 1]._boundaryNextActivations, origin, origin, region);
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedBack, _layers[l - 1]._boundaryNextStates, origin, origin, region);
+			queue.enqueueCopyImage(_layers[l]._hiddenStatesFeedBackPrev, _layers[l - 1]._boundaryNextStatesPrev, origin, origin, region);
+		}
+	}
+
+	cs.finish();
+
+	for (int l = 0; l < _layers.size(); l++) {
+		_layers[l]._boundaryInputEvent = cl::Event();
+		_layers[l]._boundaryNextEvent = cl::Event();
+		_layers[l]._doneEvent = cl::Event();
+	}
+}
+
+size_t SessionState::getSize() const {
+	size_t size = 0;
+
+	for (int d = 0; d < _buffers.size(); d++)
+		size += memorySize(_buffers[d]);
+
+	return size;
+}
+
+void HTFE::getSessionSizes(std::vector<size_t> &sizes) {
+	std::vector<CheckpointTensor> tensors;
+
+	getCheckpointTensors(tensors);
+
+	sizes.assign(_arenas.size(), 0);
+
+	for (int t = 0; t < tensors.size(); t++) {
+		if (tensors[t]._pImage != nullptr)
+			sizes[tensors[t]._device] += tensors[t]._size;
+	}
+}
+
+void HTFE::captureSession(sys::ComputeSystem &cs, SessionState &session) {
+	std::vector<CheckpointTensor> tensors;
+
+	getCheckpointTensors(tensors);
+
+	std::vector<size_t> sizes;
+
+	getSessionSizes(sizes);
+
+	if (session._buffers.size() != sizes.size())
+		session._buffers.assign(sizes.size(), cl::Buffer());
+
+	for (int d = 0; d < sizes.size(); d++) {
+		if (memorySize(session._buffers[d]) != sizes[d])
+			session._buffers[d] = sizes[d] > 0 ? cl::Buffer(cs.getContext(), CL_MEM_READ_WRITE, sizes[d]) : cl::Buffer();
+	}
+
+	// Each image is copied on the queue of its layer, behind the commands that write it
+	std::vector<size_t> offsets(sizes.size(), 0);
+
+	cl::size_t<3> origin;
+	origin[0] = 0;
+	origin[1] = 0;
+	origin[2] = 0;
+
+	for (int t = 0; t < tensors.size(); t++) {
+		if (tensors[t]._pImage == nullptr)
+			continue;
+
+		int device = tensors[t]._device;
+
+		cl::size_t<3> region;
+		region[0] = tensors[t]._width;
+		region[1] = tensors[t]._height;
+		region[2] = 1;
+
+		cs.getQueue(device).enqueueCopyImageToBuffer(*tensors[t]._pImage, session._buffers[device], origin, region, offsets[device]);
+
+		offsets[device] += tensors[t]._size;
+	}
+}
+
+bool HTFE::restoreSession(sys::ComputeSystem &cs, const SessionState &session) {
+	std::vector<CheckpointTensor> tensors;
+
+	getCheckpointTensors(tensors);
+
+	std::vector<size_t> sizes;
+
+	getSessionSizes(sizes);
+
+	if (session._buffers.size() != sizes.size()) {
+#ifdef SYS_DEBUG
+		std::cerr << "Session was captured from a different layout!" << std::endl;
+#endif
+		return false;
+	}
+
+	for (int d = 0; d < sizes.size(); d++) {
+		if (memorySize(session._buffers[d]) != sizes[d]) {
+#ifdef SYS_DEBUG
+			std::cerr << "Session was captured from a different layout!" << std::endl;
+#endif
+			return false;
+		}
+	}
+
+	// Boundary copies of the replaced states may still be read on other devices
+	if (cs.getNumDevices() > 1)
+		cs.finish();
+
+	std::vector<size_t> offsets(sizes.size(), 0);
+
+	cl::size_t<3> origin;
+	origin[0] = 0;
+	origin[1] = 0;
+	origin[2] = 0;
+
+	for (int t = 0; t < tensors.size(); t++) {
+		if (tensors[t]._pImage == nullptr)
+			continue;
+
+		int device = tensors[t]._device;
+
+		cl::size_t<3> region;
+		region[0] = tensors[t]._width;
+		region[1] = tensors[t]._height;
+		region[2] = 1;
+
+		cs.getQueue(device).enqueueCopyBufferToImage(session._buffers[device], *tensors[t]._pImage, offsets[device], origin, region);
+
+		offsets[device] += tensors[t]._size;
+	}
+
+	syncBoundaries(cs);
+
+	return true;
+}
+
+bool HTFE::forkSession(sys::ComputeSystem &cs, const SessionState &source, SessionState &destination) {
+	if (source._buffers.size() > cs.getNumDevices()) {
+#ifdef SYS_DEBUG
+		std::cerr << "Session was captured on more devices than the compute system has!" << std::endl;
+#endif
+		return false;
+	}
+
+	if (destination._buffers.size() != source._buffers.size())
+		destination._buffers.assign(source._buffers.size(), cl::Buffer());
+
+	for (int d = 0; d < source._buffers.size(); d++) {
+		size_t size = memorySize(source._buffers[d]);
+
+		if (memorySize(destination._buffers[d]) != size)
+			destination._buffers[d] = size > 0 ? cl::Buffer(cs.getContext(), CL_MEM_READ_WRITE, size) : cl::Buffer();
+
+		if (size > 0)
+			cs.getQueue(d).enqueueCopyBuffer(source._buffers[d], destination._buffers[d], 0, 0, size);
+	}
+
+	return true;
+}
+
+size_t HTFE::getDeviceMemorySize() const {
+	size_t size = memorySize(_inputImage) + memorySize(_inputImagePrev);
+
+	for (int slot = 0; slot < 2; slot++)
+		size += memorySize(_inputStaging[slot]) + memorySize(_predictionStaging[slot]);
+
+	for (int l = 0; l < _layers.size(); l++) {
+		const Layer &layer = _layers[l];
+
+		const cl::Memory* memories[] = {
+			&layer._hiddenFeedForwardActivations, &layer._hiddenFeedBackActivations, &layer._hiddenFeedBackActivationsPrev,
+			&layer._hiddenStatesFeedForward, &layer._hiddenStatesFeedForwardPrev,
+			&layer._hiddenStatesFeedBack, &layer._hiddenStatesFeedBackPrev, &layer._hiddenStatesFeedBackPrevPrev,
+			&layer._visibleReconstruction, &layer._visibleReconstructionPrev,
+			&layer._boundaryInput, &layer._boundaryInputPrev, &layer._boundaryNextActivations, &layer._boundaryNextStates, &layer._boundaryNextStatesPrev
+		};
+
+		for (int m = 0; m < sizeof(memories) / sizeof(memories[0]); m++)
+			size += memorySize(*memories[m]);
+	}
+
+	// The layer buffers are views, their memory is the arenas
+	for (int d = 0; d < _arenas.size(); d++)
+		size += memorySize(_arenas[d].getBuffer());
+
+	return size;
+}
+
+size_t HTFE::getFootprint(sys::ComputeSystem &cs, WeightType weightType, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs) const {
+	std::vector<int> devices = placeLayers(_layerDevices, layerDescs.size());
+
+	std::vector<std::vector<int>> reconstructionErrorOffsets;
+	std::vector<std::vector<int>> reconstructionErrorEntries;
+
+	buildReconstructionErrorTables(inputWidth, inputHeight, layerDescs, reconstructionErrorOffsets, reconstructionErrorEntries);
+
+	std::vector<sys::DeviceArena> arenas(cs.getNumDevices());
+
+	for (int d = 0; d < arenas.size(); d++)
+		arenas[d].reset(sys::DeviceArena::getDeviceAlignment(cs.getDevice(d)));
+
+	std::vector<size_t> parameterSizes;
+	std::vector<LayerRanges> ranges;
+
+	reserveLayerBuffers(arenas, parameterSizes, ranges, devices, weightTypeSize(weightType), inputWidth, inputHeight, layerDescs, reconstructionErrorOffsets, reconstructionErrorEntries);
+
+	// Double buffered input and prediction staging
+	size_t size = 4 * static_cast<size_t>(inputWidth) * inputHeight * sizeof(float);
+
+	size += imageFootprint(inputWidth, inputHeight, layerDescs, devices);
+
+	for (int d = 0; d < arenas.size(); d++)
+		size += arenas[d].getSize();
+
+	return size;
+}
+
+void HTFE::snapshotParameters(sys::ComputeSystem &cs) {
+	_parameterSnapshots.resize(_arenas.size());
+
+	for (int d = 0; d < _arenas.size(); d++) {
+		if (_parameterSizes[d] == 0)
+			continue;
+
+		if (_parameterSnapshots[d]() == nullptr)
+			_parameterSnapshots[d] = cl::Buffer(cs.getContext(), CL_MEM_READ_WRITE, _parameterSizes[d]);
+
+		cs.getQueue(d).enqueueCopyBuffer(_arenas[d].getBuffer(), _parameterSnapshots[d], 0, 0, _parameterSizes[d]);
+	}
+}
+
+bool HTFE::restoreParameters(sys::ComputeSystem &cs) {
+	if (_parameterSnapshots.size() != _arenas.size()) {
+#ifdef SYS_DEBUG
+		std::cerr << "No parameter snapshot to restore!" << std::endl;
+#endif
+		return false;
+	}
+
+	for (int d = 0; d < _arenas.size(); d++) {
+		if (_parameterSizes[d] != 0)
+			cs.getQueue(d).enqueueCopyBuffer(_parameterSnapshots[d], _arenas[d].getBuffer(), 0, 0, _parameterSizes[d]);
+	}
+
+	return true;
+}
+
+bool HTFE::copyParameters(sys::ComputeSystem &cs, const HTFE &other) {
+	if (other._parameterSizes != _parameterSizes || other._weightType != _weightType || other._layers.size() != _layers.size()) {
+#ifdef SYS_DEBUG
+		std::cerr << "Can only copy the parameters of an HTFE with the same layout!" << std::endl;
+#endif
+		return false;
+	}
+
+	// Other may still be writing its weights on its own queues
+	if (cs.getNumDevices() > 1)
+		cs.finish();
+
+	for (int d = 0; d < _arenas.size(); d++) {
+		if (_parameterSizes[d] != 0)
+			cs.getQueue(d).enqueueCopyBuffer(other._arenas[d].getBuffer(), _arenas[d].getBuffer(), 0, 0, _parameterSizes[d]);
+	}
+
+	return true;
+}
+
+void HTFE::getCheckpointTensors(std::vector<CheckpointTensor> &tensors) {
+	tensors.clear();
+
+	tensors.push_back(checkpointImage(_inputImage, _inputWidth, _inputHeight, sizeof(float), _layers.front()._device));
+	tensors.push_back(checkpointImage(_inputImagePrev, _inputWidth, _inputHeight, sizeof(float), _layers.front()._device));
+
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		int width = _layerDescs[l]._width;
+		int height = _layerDescs[l]._height;
+
+		tensors.push_back(checkpointBuffer(_layers[l]._feedForwardWeights, _layers[l]._device));
+		tensors.push_back(checkpointBuffer(_layers[l]._reconstructionWeights, _layers[l]._device));
+		tensors.push_back(checkpointBuffer(_layers[l]._visibleBiases, _layers[l]._device));
+		tensors.push_back(checkpointBuffer(_layers[l]._hiddenBiases, _layers[l]._device));
+		tensors.push_back(checkpointBuffer(_layers[l]._lateralWeights, _layers[l]._device));
+		tensors.push_back(checkpointBuffer(_layers[l]._feedBackWeights, _layers[l]._device));
+
+		tensors.push_back(checkpointImage(_layers[l]._hiddenFeedForwardActivations, width, height, 2 * sizeof(float), _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._hiddenFeedBackActivations, width, height, 2 * sizeof(float), _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._hiddenFeedBackActivationsPrev, width, height, 2 * sizeof(float), _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._hiddenStatesFeedForward, width, height, stateTexelSize, _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._hiddenStatesFeedForwardPrev, width, height, stateTexelSize, _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._hiddenStatesFeedBack, width, height, stateTexelSize, _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._hiddenStatesFeedBackPrev, width, height, stateTexelSize, _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._hiddenStatesFeedBackPrevPrev, width, height, stateTexelSize, _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._visibleReconstruction, prevWidth, prevHeight, sizeof(float), _layers[l]._device));
+		tensors.push_back(checkpointImage(_layers[l]._visibleReconstructionPrev, prevWidth, prevHeight, sizeof(float), _layers[l]._device));
+
+		prevWidth = width;
+		prevHeight = height;
+	}
+}
+
+bool HTFE::save(sys::ComputeSystem &cs, const std::string &name) {
+	std::ofstream toFile(name, std::ios::binary | std::ios::trunc);
+
+	if (!toFile.is_open()) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not open file " << name << "!" << std::endl;
+#endif
+		return false;
+	}
+
+	std::vector<CheckpointTensor> tensors;
+
+	getCheckpointTensors(tensors);
+
+	size_t dataOffset = alignCheckpointOffset(sizeof(CheckpointHeader) + _layerDescs.size() * sizeof(LayerDesc));
+	size_t dataSize = 0;
+
+	for (int t = 0; t < tensors.size(); t++)
+		dataSize = alignCheckpointOffset(dataSize) + tensors[t]._size;
+
+	CheckpointHeader header;
+	std::memset(&header, 0, sizeof(CheckpointHeader));
+	std::memcpy(header._magic, checkpointMagic, sizeof(checkpointMagic));
+	header._version = checkpointVersion;
+	header._layerDescSize = sizeof(LayerDesc);
+	header._weightType = _weightType;
+	header._inputWidth = _inputWidth;
+	header._inputHeight = _inputHeight;
+	header._numLayers = _layerDescs.size();
+	header._dataOffset = dataOffset;
+	header._dataSize = dataSize;
+
+	toFile.write(reinterpret_cast<const char*>(&header), sizeof(CheckpointHeader));
+
+	if (!_layerDescs.empty())
+		toFile.write(reinterpret_cast<const char*>(_layerDescs.data()), _layerDescs.size() * sizeof(LayerDesc));
+
+	std::vector<char> data(dataOffset - sizeof(CheckpointHeader) - _layerDescs.size() * sizeof(LayerDesc), 0);
+
+	toFile.write(data.data(), data.size());
+
+	// Layers on other devices may still be running
+	if (cs.getNumDevices() > 1)
+		cs.finish();
+
+	// Tensor offsets are relative to dataOffset
+	size_t offset = 0;
+
+	for (int t = 0; t < tensors.size(); t++) {
+		data.assign(alignCheckpointOffset(offset) - offset, 0);
+		toFile.write(data.data(), data.size());
+
+		data.resize(tensors[t]._size);
+
+		// Blocking reads on the in-order queue, so everything enqueued before save is included
+		if (tensors[t]._pImage != nullptr) {
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = tensors[t]._width;
+			region[1] = tensors[t]._height;
+			region[2] = 1;
+
+			cs.getQueue().enqueueReadImage(*tensors[t]._pImage, CL_TRUE, origin, region, 0, 0, data.data());
+		}
+		else
+			cs.getQueue().enqueueReadBuffer(*tensors[t]._pBuffer, CL_TRUE, 0, tensors[t]._size, data.data());
+
+		toFile.write(data.data(), tensors[t]._size);
+
+		offset = alignCheckpointOffset(offset) + tensors[t]._size;
+	}
+
+	if (!toFile.good()) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not write checkpoint " << name << "!" << std::endl;
+#endif
+		return false;
+	}
+
+	return true;
+}
+
+bool HTFE::load(sys::ComputeSystem &cs, sys::ComputeProgram &program, const std::string &name) {
+	sys::MappedFile file;
+
+	if (!file.open(name))
+		return false;
+
+	CheckpointHeader header;
+
+	if (file.getSize() < sizeof(CheckpointHeader)) {
+#ifdef SYS_DEBUG
+		std::cerr << "Checkpoint " << name << " is truncated!" << std::endl;
+#endif
+		return false;
+	}
+
+	std::memcpy(&header, file.getData(), sizeof(CheckpointHeader));
+
+	if (std::memcmp(header._magic, checkpointMagic, sizeof(checkpointMagic)) != 0 || header._version != checkpointVersion || header._layerDescSize != sizeof(LayerDesc)) {
+#ifdef SYS_DEBUG
+		std::cerr << "Checkpoint " << name << " has an unsupported format!" << std::endl;
+#endif
+		return false;
+	}
+
+	// Compared without sums that could wrap on a corrupt header
+	if (header._numLayers < 1 || header._numLayers > maxCheckpointLayers
+		|| header._dataOffset < sizeof(CheckpointHeader) + header._numLayers * sizeof(LayerDesc)
+		|| header._dataOffset > file.getSize() || header._dataSize > file.getSize() - header._dataOffset)
+	{
+#ifdef SYS_DEBUG
+		std::cerr << "Checkpoint " << name << " is truncated!" << std::endl;
+#endif
+		return false;
+	}
+
+	std::vector<LayerDesc> layerDescs(header._numLayers);
+
+	if (!layerDescs.empty())
+		std::memcpy(layerDescs.data(), file.getData() + sizeof(CheckpointHeader), layerDescs.size() * sizeof(LayerDesc));
+
+	if (header._weightType != htfe::getWeightType(program)) {
+#ifdef SYS_DEBUG
+		std::cerr << "Checkpoint " << name << " was saved with a different weight type than the program is built for!" << std::endl;
+#endif
+		return false;
+	}
+
+	// Checked before createLayers replaces the current hierarchy
+	if (!checkpointDescsValid(header._inputWidth, header._inputHeight, layerDescs)
+		|| checkpointDataSize(weightTypeSize(static_cast<WeightType>(header._weightType)), header._inputWidth, header._inputHeight, layerDescs) != header._dataSize)
+	{
+#ifdef SYS_DEBUG
+		std::cerr << "Checkpoint " << name << " does not match its layer descs!" << std::endl;
+#endif
+		return false;
+	}
+
+	if (!createLayers(cs, program, header._inputWidth, header._inputHeight, layerDescs))
+		return false;
+
+	std::vector<CheckpointTensor> tensors;
+
+	getCheckpointTensors(tensors);
+
+	size_t offset = 0;
+
+	for (int t = 0; t < tensors.size(); t++) {
+		offset = alignCheckpointOffset(offset);
+
+		if (offset + tensors[t]._size > header._dataSize) {
+#ifdef SYS_DEBUG
+			std::cerr << "Checkpoint " << name << " does not match its layer descs!" << std::endl;
+#endif
+			cs.getQueue().finish();
+
+			return false;
+		}
+
+		const char* pData = file.getData() + header._dataOffset + offset;
+
+		// Non blocking, the mapping stays valid until the finish below
+		if (tensors[t]._pImage != nullptr) {
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = tensors[t]._width;
+			region[1] = tensors[t]._height;
+			region[2] = 1;
+
+			cs.getQueue().enqueueWriteImage(*tensors[t]._pImage, CL_FALSE, origin, region, 0, 0, const_cast<char*>(pData));
+		}
+		else
+			cs.getQueue().enqueueWriteBuffer(*tensors[t]._pBuffer, CL_FALSE, 0, tensors[t]._size, pData);
+
+		offset += tensors[t]._size;
+	}
+
+	cs.getQueue().finish();
+
+	syncBoundaries(cs);
+
+	return true;
 }
\ No newline at end of file
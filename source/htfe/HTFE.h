@@ -1,145 +1,405 @@
-#pragma once
-
-#include "../system/ComputeSystem.h"
-#include "../system/ComputeProgram.h"
-
-#include <vector>
-#include <list>
-
-#include <random>
-
-#include <memory>
-
-namespace htfe {
-	struct LayerDesc {
-		int _width, _height;
-
-		int _receptiveFieldRadius;
-		int _reconstructionRadius;
-		int _lateralConnectionRadius;
-		int _inhibitionRadius;
-		int _feedBackConnectionRadius;
-
-		float _sparsity;
-
-		float _dutyCycleDecay;
-		float _feedForwardAlpha;
-		float _lateralAlpha;
-		float _feedBackAlpha;
-		float _hiddenBiasAlpha;
-		float _reconstructionAlpha;
-		float _gamma;
-		float _lateralScalar;
-		float _feedBackScalar;
-		float _weightDecay;
-
-		LayerDesc()
-			: _width(16), _height(16), _receptiveFieldRadius(5), _reconstructionRadius(8), _lateralConnectionRadius(7), _inhibitionRadius(4), _feedBackConnectionRadius(6),
-			_sparsity(1.01f / 81.0f), _dutyCycleDecay(0.01f),
-			_feedForwardAlpha(0.05f), _lateralAlpha(0.05f), _feedBackAlpha(0.05f), _hiddenBiasAlpha(0.05f), _reconstructionAlpha(0.05f),
-			_gamma(0.0f), _lateralScalar(0.1f), _feedBackScalar(0.1f), _weightDecay(0.001f)
-		{}
-	};
-
-	struct Layer {
-		cl::Image2D _hiddenFeedForwardActivations;
-		cl::Image2D _hiddenFeedBackActivations;
-		cl::Image2D _hiddenFeedBackActivationsPrev;
-
-		cl::Image2D _hiddenStatesFeedForward;
-		cl::Image2D _hiddenStatesFeedForwardPrev;
-
-		cl::Image2D _hiddenStatesFeedBack;
-		cl::Image2D _hiddenStatesFeedBackPrev;
-		cl::Image2D _hiddenStatesFeedBackPrevPrev;
-
-		cl::Image3D _feedForwardWeights;
-		cl::Image3D _feedForwardWeightsPrev;
-
-		cl::Image3D _reconstructionWeights;
-		cl::Image3D _reconstructionWeightsPrev;
-
-		cl::Image2D _visibleBiases;
-		cl::Image2D _visibleBiasesPrev;
-
-		cl::Image2D _hiddenBiases;
-		cl::Image2D _hiddenBiasesPrev;
-
-		cl::Image3D _lateralWeights;
-		cl::Image3D _lateralWeightsPrev;
-
-		cl::Image3D _feedBackWeights;
-		cl::Image3D _feedBackWeightsPrev;
-
-		cl::Image2D _visibleReconstruction;
-		cl::Image2D _visibleReconstructionPrev;
-	};
-		
-	class HTFE {
-	private:
-		int _inputWidth, _inputHeight;
-
-		std::vector<LayerDesc> _layerDescs;
-		std::vector<Layer> _layers;
-
-		cl::Kernel _layerHiddenFeedForwardActivateKernel;
-		cl::Kernel _layerHiddenFeedBackActivateKernel;
-		cl::Kernel _layerHiddenInhibitKernel;
-		cl::Kernel _layerVisibleReconstructKernel;
-		cl::Kernel _layerHiddenWeightUpdateKernel;
-		cl::Kernel _layerHiddenWeightUpdateLastKernel;
-		cl::Kernel _layerVisibleWeightUpdateKernel;
-		cl::Kernel _layerUpdateQKernel;
-
-		std::vector<float> _input;
-		std::vector<float> _prediction;
-
-		cl::Image2D _inputImage;
-		cl::Image2D _inputImagePrev;
-
-	public:
-		void createRandom(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight);
-	
-		void activate(sys::ComputeSystem &cs);
-		void learn(sys::ComputeSystem &cs);
-		void stepEnd();
-
-		int getInputWidth() const {
-			return _inputWidth;
-		}
-
-		int getInputHeight() const {
-			return _inputHeight;
-		}
-
-		const std::vector<LayerDesc> &getLayerDescs() const {
-			return _layerDescs;
-		}
-
-		const std::vector<Layer> &getLayers() const {
-			return _layers;
-		}
-
-		const cl::Image2D &getInputImage() const {
-			return _inputImage;
-		}
-
-		void setInput(int i, float value) {
-			_input[i] = value;
-		}
-
-		void setInput(int x, int y, float value) {
-			setInput(x + y * _inputWidth, value);
-		}
-
-		float getPrediction(int i) const {
-			return _prediction[i];
-		}
-
-		float getPrediction(int x, int y) const {
-			return getPrediction(x + y * _inputWidth);
-		}
-
-		void clearMemory(sys::ComputeSystem &cs);
-	};
+#pragma once
+
+#include "../system/ComputeSystem.h"
+#include "../system/ComputeProgram.h"
+#include "../system/DeviceArena.h"
+#include "../system/Profiler.h"
+
+#include "LayerDesc.h"
+#include "WeightType.h"
+
+#include <vector>
+#include <string>
+#include <list>
+#include <functional>
+
+#include <random>
+
+#include <memory>
+
+namespace htfe {
+	struct Layer {
+		cl::Image2D _hiddenFeedForwardActivations;
+		cl::Image2D _hiddenFeedBackActivations;
+		cl::Image2D _hiddenFeedBackActivationsPrev;
+
+		cl::Image2D _hiddenStatesFeedForward;
+		cl::Image2D _hiddenStatesFeedForwardPrev;
+
+		cl::Image2D _hiddenStatesFeedBack;
+		cl::Image2D _hiddenStatesFeedBackPrev;
+		cl::Image2D _hiddenStatesFeedBackPrevPrev;
+
+		// Weights and biases are single buffers updated in place by learn, weights are laid out in (width, height) planes per weight index
+		cl::Buffer _feedForwardWeights;
+		cl::Buffer _reconstructionWeights;
+		cl::Buffer _visibleBiases;
+		cl::Buffer _hiddenBiases;
+		cl::Buffer _lateralWeights;
+		cl::Buffer _feedBackWeights;
+
+		cl::Image2D _visibleReconstruction;
+		cl::Image2D _visibleReconstructionPrev;
+
+		// Per hidden unit lists of the visible units it reconstructs, replaces the containment search of the hidden weight update
+		cl::Buffer _reconstructionErrorOffsets;
+		cl::Buffer _reconstructionErrorEntries;
+
+		// Units the hidden weight update runs over, rebuilt every learn, and their count
+		cl::Buffer _activeUnits;
+		cl::Buffer _numActiveUnits;
+
+		// Work group edges of the fused activate + inhibit and the tiled reconstruct kernels, 0 if the layer uses the per texel kernels
+		int _fusedTileSize;
+		int _reconstructTileSize;
+
+		// Index of the ComputeSystem device whose queue runs this layer
+		int _device;
+
+		// Where the layer below or above runs on another device, this layer reads copies of the images it needs from it.
+		// The neighbour pushes them on its own queue right after producing them, nothing else crosses devices
+		bool _boundaryBelow;
+		bool _boundaryAbove;
+
+		// Hidden states feed forward of the layer below
+		cl::Image2D _boundaryInput;
+		cl::Image2D _boundaryInputPrev;
+
+		// Hidden feed back activations and states of the layer above
+		cl::Image2D _boundaryNextActivations;
+		cl::Image2D _boundaryNextStates;
+		cl::Image2D _boundaryNextStatesPrev;
+
+		// Completion of the last push into the boundary images from below and from above
+		cl::Event _boundaryInputEvent;
+		cl::Event _boundaryNextEvent;
+
+		// Last command of this layer with a boundary, pushes into its boundary images wait for it
+		cl::Event _doneEvent;
+
+		// Program the kernels below come from, built for this layer alone if the HTFE specializes its layers
+		cl::Program _program;
+
+		// Kernels of this layer with all arguments bound, the inhibit kernels are only used without fusion
+		cl::Kernel _feedForwardKernel;
+		cl::Kernel _feedForwardInhibitKernel;
+		cl::Kernel _feedBackKernel;
+		cl::Kernel _feedBackInhibitKernel;
+		cl::Kernel _reconstructKernel;
+		cl::Kernel _listActiveUnitsKernel;
+		cl::Kernel _hiddenWeightUpdateKernel;
+		cl::Kernel _visibleWeightUpdateKernel;
+
+		// Launch ranges of the kernels above, the local ranges are cl::NullRange for the per texel kernels
+		cl::NDRange _hiddenRange;
+		cl::NDRange _hiddenLocalRange;
+		cl::NDRange _visibleRange;
+		cl::NDRange _visibleLocalRange;
+		cl::NDRange _unitRange;
+		cl::NDRange _visibleUnitRange;
+		cl::NDRange _updateRange;
+	};
+
+	struct CheckpointTensor;
+
+	// How HTFE::rollout turns a prediction into the next input
+	enum RolloutMode {
+		_feedPrediction, _feedThreshold, _feedSample
+	};
+
+	// Recurrent state of an HTFE, written by HTFE::captureSession. Holds one tightly packed device buffer per device with the images
+	// of the layers placed there, the weights are not part of it
+	class SessionState {
+	private:
+		std::vector<cl::Buffer> _buffers;
+
+		friend class HTFE;
+
+	public:
+		// True until the first capture
+		bool empty() const {
+			return _buffers.empty();
+		}
+
+		// Bytes of device memory held
+		size_t getSize() const;
+	};
+		
+	class HTFE {
+	private:
+		int _inputWidth, _inputHeight;
+
+		std::vector<LayerDesc> _layerDescs;
+		std::vector<Layer> _layers;
+
+		WeightType _weightType;
+
+		unsigned int _seed;
+
+		bool _specializeLayers;
+
+		std::vector<int> _layerDevices;
+
+		sys::Profiler* _pProfiler;
+
+		// Per device, every buffer of the layers on that device is a sub-buffer of its arena.
+		// The weights and biases come first and fill [0, _parameterSizes[d])
+		std::vector<sys::DeviceArena> _arenas;
+		std::vector<size_t> _parameterSizes;
+
+		// Device side copies of the parameter ranges, written by snapshotParameters
+		std::vector<cl::Buffer> _parameterSnapshots;
+
+		cl::Kernel _layerUpdateQKernel;
+
+		cl::Kernel _rolloutFeedBackKernel;
+
+		// Input the host writes, copied into a pinned staging slot by activateAsync so pointers to it stay valid
+		std::vector<float> _input;
+
+		// Double buffered pinned host staging, activateAsync fills one input slot while the other may still be uploading
+		cl::Buffer _inputStaging[2];
+		cl::Buffer _predictionStaging[2];
+
+		float* _pInputStaging[2];
+		float* _pPredictionStaging[2];
+
+		cl::Event _inputEvents[2];
+		cl::Event _predictionEvents[2];
+
+		int _inputSlot;
+		int _pendingPredictionSlot;
+		int _predictionSlot;
+
+		cl::Image2D _inputImage;
+		cl::Image2D _inputImagePrev;
+
+		// Allocates every image and buffer without initializing them, weights in the weight type program was built for.
+		// Fails for int8 programs, those weights can not learn
+		bool createLayers(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs);
+
+		// Creates the kernels of every layer and binds all their arguments, called once the images, buffers and tile sizes exist
+		void bindLayerKernels();
+
+		// Rebinds only the image arguments stepEnd rotates
+		void bindLayerImages();
+
+		// Enqueues the up and down passes of a step on the input already in _inputImage
+		void enqueueLayers(sys::ComputeSystem &cs);
+
+		// Runs numSteps steps in chunks without returning to the host, learning or not, and reads the prediction of every step into predictions if not null.
+		// beginChunk(chunkStart, steps), if set, runs before each chunk, enqueueInput(step, chunkStep) must enqueue the input of each step into _inputImage.
+		// Waits for all steps, getPrediction then holds the last prediction
+		void runChunked(sys::ComputeSystem &cs, int numSteps, float* predictions, bool learning,
+			const std::function<void(int, int)> &beginChunk, const std::function<void(int, int)> &enqueueInput);
+
+		// Shared by trainSequence and predictSequence
+		void runSequence(sys::ComputeSystem &cs, const float* inputs, int numSteps, float* predictions, bool learning);
+		bool runSequence(sys::ComputeSystem &cs, const std::vector<float> &inputs, std::vector<float> &predictions, bool learning);
+
+		// Event slot of an enqueue labelled with phase and layer while profiling, null otherwise. Layer -1 are the input and prediction transfers
+		cl::Event* profileEvent(const char* phase, int layer);
+
+		// Labels an enqueue that keeps its own event, while profiling
+		void profileRecord(const cl::Event &event, const char* phase, int layer);
+
+		// Copies the current neighbour images into all boundary images, after creation, load and clearMemory
+		void syncBoundaries(sys::ComputeSystem &cs);
+
+		// Every tensor stored in a checkpoint, in file order. The images among them are the recurrent state of a session
+		void getCheckpointTensors(std::vector<CheckpointTensor> &tensors);
+
+		// Bytes of the recurrent state images on every device
+		void getSessionSizes(std::vector<size_t> &sizes);
+
+	public:
+		HTFE()
+			: _weightType(_float32), _seed(0), _specializeLayers(false), _pProfiler(nullptr), _inputSlot(0), _pendingPredictionSlot(0), _predictionSlot(0)
+		{
+			_pInputStaging[0] = _pInputStaging[1] = nullptr;
+			_pPredictionStaging[0] = _pPredictionStaging[1] = nullptr;
+		}
+
+		// Seeded from std::random_device, getSeed returns the seed drawn
+		bool createRandom(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight);
+
+		// Every weight and bias is a counter based random function of seed and its index, so the same seed, descs and weight type give bitwise identical models
+		bool createRandom(sys::ComputeSystem &cs, sys::ComputeProgram &program, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight, unsigned int seed);
+
+		// Writes the layer descs, weights and recurrent state to a binary checkpoint, waits for all queued work first
+		bool save(sys::ComputeSystem &cs, const std::string &name);
+
+		// Replaces this HTFE with a checkpoint written by save. The file is memory mapped and uploaded as is, so program must be built for the weight type it was saved with
+		bool load(sys::ComputeSystem &cs, sys::ComputeProgram &program, const std::string &name);
+	
+		// Blocking step, same as activateAsync followed by waitForPrediction
+		void activate(sys::ComputeSystem &cs);
+
+		// Uploads the current input and enqueues the step without waiting for the device.
+		// setInput may be called for the next step right away, the returned event completes once the prediction has been read back.
+		// The prediction of a step stays readable until the activateAsync two steps later
+		cl::Event activateAsync(sys::ComputeSystem &cs);
+
+		// Waits for the last activateAsync and makes its prediction visible to getPrediction
+		void waitForPrediction();
+		void learn(sys::ComputeSystem &cs);
+		void stepEnd();
+
+		// inputs holds numSteps frames of inputWidth * inputHeight values back to back. Runs activate, learn and stepEnd for every frame
+		// without returning to the host: frames are uploaded in large chunks and the prediction of every step is copied on the device
+		// into predictions, same layout as inputs, which may be null when not needed. Returns once all steps are done,
+		// getPrediction then holds the last prediction
+		void trainSequence(sys::ComputeSystem &cs, const float* inputs, int numSteps, float* predictions = nullptr) {
+			runSequence(cs, inputs, numSteps, predictions, true);
+		}
+
+		// Same as trainSequence without learn
+		void predictSequence(sys::ComputeSystem &cs, const float* inputs, int numSteps, float* predictions) {
+			runSequence(cs, inputs, numSteps, predictions, false);
+		}
+
+		// Forecasts numSteps steps ahead without returning to the host. Each step takes the prediction of the step before as input,
+		// starting from the prediction of the last step, as is, thresholded at threshold or sampled with seed depending on mode.
+		// predictions receives numSteps frames back to back. Does not learn, but advances the recurrent state like any step,
+		// capture a session first to continue from before the rollout
+		void rollout(sys::ComputeSystem &cs, int numSteps, float* predictions, RolloutMode mode = _feedPrediction, float threshold = 0.5f, unsigned int seed = 0);
+
+		// Vector versions, predictions is resized to the size of inputs. False if inputs is not a whole number of frames
+		bool trainSequence(sys::ComputeSystem &cs, const std::vector<float> &inputs, std::vector<float> &predictions) {
+			return runSequence(cs, inputs, predictions, true);
+		}
+
+		bool predictSequence(sys::ComputeSystem &cs, const std::vector<float> &inputs, std::vector<float> &predictions) {
+			return runSequence(cs, inputs, predictions, false);
+		}
+
+		void rollout(sys::ComputeSystem &cs, int numSteps, std::vector<float> &predictions, RolloutMode mode = _feedPrediction, float threshold = 0.5f, unsigned int seed = 0) {
+			predictions.resize(static_cast<size_t>(numSteps) * _inputWidth * _inputHeight);
+
+			rollout(cs, numSteps, predictions.data(), mode, threshold, seed);
+		}
+
+		int getInputWidth() const {
+			return _inputWidth;
+		}
+
+		int getInputHeight() const {
+			return _inputHeight;
+		}
+
+		const std::vector<LayerDesc> &getLayerDescs() const {
+			return _layerDescs;
+		}
+
+		const std::vector<Layer> &getLayers() const {
+			return _layers;
+		}
+
+		WeightType getWeightType() const {
+			return _weightType;
+		}
+
+		// Seed of the last createRandom
+		unsigned int getSeed() const {
+			return _seed;
+		}
+
+		// Bytes of device memory held by all images and buffers, including the host staging
+		size_t getDeviceMemorySize() const;
+
+		// Bytes of device memory createRandom or load would allocate for these layers on the current layer devices, computed without allocating.
+		// Same accounting as getDeviceMemorySize, images counted at their texel sizes
+		size_t getFootprint(sys::ComputeSystem &cs, WeightType weightType, int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs) const;
+
+		// Bytes of the buffer arena of a device, and of the weights and biases at its start
+		size_t getArenaSize(int device) const {
+			return device < _arenas.size() ? _arenas[device].getSize() : 0;
+		}
+
+		size_t getParameterSize(int device) const {
+			return device < _parameterSizes.size() ? _parameterSizes[device] : 0;
+		}
+
+		// Copies all weights and biases into device memory kept by this HTFE, a single copy per device
+		void snapshotParameters(sys::ComputeSystem &cs);
+
+		// Copies the last snapshot back over the weights and biases, false if there is none
+		bool restoreParameters(sys::ComputeSystem &cs);
+
+		// Copies the weights and biases of other, created on the same compute system with the same layer descs, devices and weight type
+		bool copyParameters(sys::ComputeSystem &cs, const HTFE &other);
+
+		// Build a program per distinct layer configuration with its radii and sizes as compile time constants, so the window loops can be unrolled.
+		// Costs a build per configuration, combine with a program cache directory. Applies to the next createRandom or load
+		void setSpecializeLayers(bool specializeLayers) {
+			_specializeLayers = specializeLayers;
+		}
+
+		bool getSpecializeLayers() const {
+			return _specializeLayers;
+		}
+
+		// Device index per layer, layers past the end of layerDevices run on device 0. Place contiguous layer ranges on a device,
+		// only the images at the boundaries between ranges are copied across. Applies to the next createRandom or load
+		void setLayerDevices(const std::vector<int> &layerDevices) {
+			_layerDevices = layerDevices;
+		}
+
+		const std::vector<int> &getLayerDevices() const {
+			return _layerDevices;
+		}
+
+		// Labels every command of the steps with its phase and layer in pProfiler, null stops profiling.
+		// Phases are input, up, transfer, down, reconstruct, prediction, active list, hidden update and visible update
+		void setProfiler(sys::Profiler* pProfiler) {
+			_pProfiler = pProfiler;
+		}
+
+		const cl::Image2D &getInputImage() const {
+			return _inputImage;
+		}
+
+		void setInput(int i, float value) {
+			_input[i] = value;
+		}
+
+		void setInput(int x, int y, float value) {
+			setInput(x + y * _inputWidth, value);
+		}
+
+		float getPrediction(int i) const {
+			return _pPredictionStaging[_predictionSlot][i];
+		}
+
+		float getPrediction(int x, int y) const {
+			return getPrediction(x + y * _inputWidth);
+		}
+
+		// Contiguous input and prediction of getInputSize() values, for bulk access such as the Python buffer bindings.
+		// The input pointer is valid until the model is created or loaded again, the prediction pointer, into the pinned staging, until the next waitForPrediction
+		float* getInputData() {
+			return _input.data();
+		}
+
+		const float* getPredictionData() const {
+			return _pPredictionStaging[_predictionSlot];
+		}
+
+		int getInputSize() const {
+			return _inputWidth * _inputHeight;
+		}
+
+		void clearMemory(sys::ComputeSystem &cs);
+
+		// Copies the recurrent state of all layers (hidden states, activations, reconstructions and the previous input) into session on the device.
+		// Enqueued behind the current step, session is allocated on its first capture and reused after
+		void captureSession(sys::ComputeSystem &cs, SessionState &session);
+
+		// Replaces the recurrent state with a capture of this HTFE or of one with the same layer descs and devices, false if session does not fit.
+		// getPrediction keeps the last prediction until the next step
+		bool restoreSession(sys::ComputeSystem &cs, const SessionState &session);
+
+		// Copies source into destination on the device, so both sessions continue independently from the same context
+		bool forkSession(sys::ComputeSystem &cs, const SessionState &source, SessionState &destination);
+	};
 }
\ No newline at end of file
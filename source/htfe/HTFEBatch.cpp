@@ -0,0 +1,321 @@
+#include "HTFEBatch.h"
+
+#include "KernelTypes.h"
+#include "StateFormat.h"
+
+#include <cmath>
+#include <iostream>
+
+using namespace htfe;
+
+bool HTFEBatch::create(sys::ComputeSystem &cs, sys::ComputeProgram &program, const HTFE &source, int batchSize) {
+	if (getWeightType(program) != source.getWeightType()) {
+#ifdef SYS_DEBUG
+		std::cerr << "HTFEBatch program is built for a different weight type than its source!" << std::endl;
+#endif
+		return false;
+	}
+
+	_pSource = &source;
+	_batchSize = batchSize;
+
+	// A source spread over several devices may still be running on the other queues
+	if (cs.getNumDevices() > 1)
+		cs.finish();
+
+	const std::vector<LayerDesc> &layerDescs = _pSource->getLayerDescs();
+
+	int inputWidth = _pSource->getInputWidth();
+	int inputHeight = _pSource->getInputHeight();
+
+	_layers.clear();
+	_layers.resize(layerDescs.size());
+
+	_inputs.clear();
+	_inputs.resize(inputWidth * inputHeight * _batchSize, 0.0f);
+
+	_predictions.clear();
+	_predictions.resize(inputWidth * inputHeight * _batchSize, 0.0f);
+
+	_inputImage = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), inputWidth, inputHeight, _batchSize);
+
+	int prevWidth = inputWidth;
+	int prevHeight = inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		_layers[l]._hiddenFeedForwardActivations = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), layerDescs[l]._width, layerDescs[l]._height, _batchSize);
+		_layers[l]._hiddenFeedBackActivations = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), layerDescs[l]._width, layerDescs[l]._height, _batchSize);
+
+		_layers[l]._hiddenStatesFeedForward = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), layerDescs[l]._width, layerDescs[l]._height, _batchSize);
+
+		_layers[l]._hiddenStatesFeedBack = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), layerDescs[l]._width, layerDescs[l]._height, _batchSize);
+		_layers[l]._hiddenStatesFeedBackPrev = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), layerDescs[l]._width, layerDescs[l]._height, _batchSize);
+
+		_layers[l]._visibleReconstruction = cl::Image3D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight, _batchSize);
+
+		prevWidth = layerDescs[l]._width;
+		prevHeight = layerDescs[l]._height;
+	}
+
+	clearMemory(cs);
+
+	_layerHiddenFeedForwardActivateKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedForwardActivateBatch");
+	_layerHiddenFeedBackActivateKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedBackActivateBatch");
+	_layerHiddenInhibitKernel = cl::Kernel(program.getProgram(), "layerHiddenInhibitBatch");
+	_layerVisibleReconstructKernel = cl::Kernel(program.getProgram(), "layerVisibleReconstructBatch");
+
+	return true;
+}
+
+void HTFEBatch::activate(sys::ComputeSystem &cs) {
+	const std::vector<LayerDesc> &layerDescs = _pSource->getLayerDescs();
+	const std::vector<Layer> &sourceLayers = _pSource->getLayers();
+
+	int inputWidth = _pSource->getInputWidth();
+	int inputHeight = _pSource->getInputHeight();
+
+	{
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = inputWidth;
+		region[1] = inputHeight;
+		region[2] = _batchSize;
+
+		cs.getQueue().enqueueWriteImage(_inputImage, CL_TRUE, origin, region, 0, 0, _inputs.data());
+	}
+
+	// ------------------------------------------------------------------------------
+	// ------------------------------------ Go up -----------------------------------
+	// ------------------------------------------------------------------------------
+
+	cl::Image3D* pPrevLayer = &_inputImage;
+	int prevWidth = inputWidth;
+	int prevHeight = inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		float localActivity = std::round(layerDescs[l]._sparsity * std::pow(2 * layerDescs[l]._inhibitionRadius + 1, 2));
+
+		Int2 layerSize;
+		layerSize._x = layerDescs[l]._width;
+		layerSize._y = layerDescs[l]._height;
+
+		Float2 layerSizeMinusOneInv;
+		layerSizeMinusOneInv._x = 1.0f / (layerDescs[l]._width - 1);
+		layerSizeMinusOneInv._y = 1.0f / (layerDescs[l]._height - 1);
+
+		Int2 inputSize;
+		inputSize._x = prevWidth;
+		inputSize._y = prevHeight;
+
+		Int2 inputSizeMinusOne;
+		inputSizeMinusOne._x = prevWidth - 1;
+		inputSizeMinusOne._y = prevHeight - 1;
+
+		// -------------------------------- Activate --------------------------------
+
+		int index = 0;
+
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, *pPrevLayer);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, sourceLayers[l]._feedForwardWeights);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, sourceLayers[l]._lateralWeights);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, sourceLayers[l]._hiddenBiases);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, layerSize);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, layerSizeMinusOneInv);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, inputSize);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, inputSizeMinusOne);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, layerDescs[l]._receptiveFieldRadius);
+		_layerHiddenFeedForwardActivateKernel.setArg(index++, layerDescs[l]._lateralConnectionRadius);
+
+		cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedForwardActivateKernel, cl::NullRange, cl::NDRange(layerDescs[l]._width, layerDescs[l]._height, _batchSize));
+
+		// ---------------------------------- Inhibit ---------------------------------
+
+		index = 0;
+
+		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedForward);
+		_layerHiddenInhibitKernel.setArg(index++, layerSize);
+		_layerHiddenInhibitKernel.setArg(index++, layerDescs[l]._inhibitionRadius);
+		_layerHiddenInhibitKernel.setArg(index++, localActivity);
+
+		cs.getQueue().enqueueNDRangeKernel(_layerHiddenInhibitKernel, cl::NullRange, cl::NDRange(layerDescs[l]._width, layerDescs[l]._height, _batchSize));
+
+		pPrevLayer = &_layers[l]._hiddenStatesFeedForward;
+		prevWidth = layerDescs[l]._width;
+		prevHeight = layerDescs[l]._height;
+	}
+
+	// ------------------------------------------------------------------------------
+	// -------------------------------- Go back down --------------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = _layers.size() - 1; l >= 0; l--) {
+		if (l > 0) {
+			prevWidth = layerDescs[l - 1]._width;
+			prevHeight = layerDescs[l - 1]._height;
+		}
+		else {
+			prevWidth = inputWidth;
+			prevHeight = inputHeight;
+		}
+
+		float localActivity = std::round(layerDescs[l]._sparsity * std::pow(2 * layerDescs[l]._inhibitionRadius + 1, 2));
+
+		Int2 layerSize;
+		layerSize._x = layerDescs[l]._width;
+		layerSize._y = layerDescs[l]._height;
+
+		Int2 layerSizeMinusOne;
+		layerSizeMinusOne._x = layerDescs[l]._width - 1;
+		layerSizeMinusOne._y = layerDescs[l]._height - 1;
+
+		Float2 layerSizeMinusOneInv;
+		layerSizeMinusOneInv._x = 1.0f / (layerDescs[l]._width - 1);
+		layerSizeMinusOneInv._y = 1.0f / (layerDescs[l]._height - 1);
+
+		Int2 inputSizeMinusOne;
+		inputSizeMinusOne._x = prevWidth - 1;
+		inputSizeMinusOne._y = prevHeight - 1;
+
+		Float2 inputSizeMinusOneInv;
+		inputSizeMinusOneInv._x = 1.0f / (prevWidth - 1);
+		inputSizeMinusOneInv._y = 1.0f / (prevHeight - 1);
+
+		// -------------------------------- Activate --------------------------------
+
+		int index = 0;
+
+		if (l == _layers.size() - 1) {
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = layerDescs[l]._width;
+			region[1] = layerDescs[l]._height;
+			region[2] = _batchSize;
+
+			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenFeedForwardActivations, _layers[l]._hiddenFeedBackActivations, origin, origin, region);
+		}
+		else {
+			Int2 nextSize;
+			nextSize._x = layerDescs[l + 1]._width;
+			nextSize._y = layerDescs[l + 1]._height;
+
+			Int2 nextSizeMinusOne;
+			nextSizeMinusOne._x = layerDescs[l + 1]._width - 1;
+			nextSizeMinusOne._y = layerDescs[l + 1]._height - 1;
+
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l + 1]._hiddenFeedBackActivations);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, sourceLayers[l]._feedBackWeights);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, layerSize);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, layerSizeMinusOneInv);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, nextSize);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, nextSizeMinusOne);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, layerDescs[l]._feedBackConnectionRadius);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedBackActivateKernel, cl::NullRange, cl::NDRange(layerDescs[l]._width, layerDescs[l]._height, _batchSize));
+		}
+
+		// ---------------------------------- Inhibit ---------------------------------
+
+		index = 0;
+
+		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
+		_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
+		_layerHiddenInhibitKernel.setArg(index++, layerSize);
+		_layerHiddenInhibitKernel.setArg(index++, layerDescs[l]._inhibitionRadius);
+		_layerHiddenInhibitKernel.setArg(index++, localActivity);
+
+		cs.getQueue().enqueueNDRangeKernel(_layerHiddenInhibitKernel, cl::NullRange, cl::NDRange(layerDescs[l]._width, layerDescs[l]._height, _batchSize));
+
+		// --------------------- Make Predictions (Reconstruction) ---------------------
+
+		index = 0;
+
+		_layerVisibleReconstructKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
+		_layerVisibleReconstructKernel.setArg(index++, sourceLayers[l]._reconstructionWeights);
+		_layerVisibleReconstructKernel.setArg(index++, _layers[l]._visibleReconstruction);
+		_layerVisibleReconstructKernel.setArg(index++, layerDescs[l]._reconstructionRadius);
+		_layerVisibleReconstructKernel.setArg(index++, inputSizeMinusOne);
+		_layerVisibleReconstructKernel.setArg(index++, inputSizeMinusOneInv);
+		_layerVisibleReconstructKernel.setArg(index++, layerSize);
+		_layerVisibleReconstructKernel.setArg(index++, layerSizeMinusOne);
+		_layerVisibleReconstructKernel.setArg(index++, layerSizeMinusOneInv);
+
+		cs.getQueue().enqueueNDRangeKernel(_layerVisibleReconstructKernel, cl::NullRange, cl::NDRange(prevWidth, prevHeight, _batchSize));
+	}
+
+	{
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = inputWidth;
+		region[1] = inputHeight;
+		region[2] = _batchSize;
+
+		cs.getQueue().enqueueReadImage(_layers.front()._visibleReconstruction, CL_TRUE, origin, region, 0, 0, _predictions.data());
+	}
+}
+
+void HTFEBatch::stepEnd() {
+	for (int l = 0; l < _layers.size(); l++)
+		std::swap(_layers[l]._hiddenStatesFeedBack, _layers[l]._hiddenStatesFeedBackPrev);
+}
+
+void HTFEBatch::clearMemory(sys::ComputeSystem &cs) {
+	clearStreams(cs, 0, _batchSize);
+}
+
+void HTFEBatch::clearMemory(sys::ComputeSystem &cs, int stream) {
+	clearStreams(cs, stream, 1);
+}
+
+void HTFEBatch::clearStreams(sys::ComputeSystem &cs, int firstStream, int numStreams) {
+	const std::vector<LayerDesc> &layerDescs = _pSource->getLayerDescs();
+
+	cl_uint4 clear = { 0, 0, 0, 0 };
+
+	int prevWidth = _pSource->getInputWidth();
+	int prevHeight = _pSource->getInputHeight();
+
+	for (int l = 0; l < _layers.size(); l++) {
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = firstStream;
+
+		cl::size_t<3> region;
+		region[0] = layerDescs[l]._width;
+		region[1] = layerDescs[l]._height;
+		region[2] = numStreams;
+
+		cs.getQueue().enqueueFillImage(_layers[l]._hiddenFeedForwardActivations, clear, origin, region);
+		cs.getQueue().enqueueFillImage(_layers[l]._hiddenFeedBackActivations, clear, origin, region);
+		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedForward, clear, origin, region);
+		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedBack, clear, origin, region);
+		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedBackPrev, clear, origin, region);
+
+		cl::size_t<3> visibleRegion;
+		visibleRegion[0] = prevWidth;
+		visibleRegion[1] = prevHeight;
+		visibleRegion[2] = numStreams;
+
+		cs.getQueue().enqueueFillImage(_layers[l]._visibleReconstruction, clear, origin, visibleRegion);
+
+		prevWidth = layerDescs[l]._width;
+		prevHeight = layerDescs[l]._height;
+	}
+}
\ No newline at end of file
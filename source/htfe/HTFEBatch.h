@@ -0,0 +1,96 @@
+#pragma once
+
+#include "HTFE.h"
+
+namespace htfe {
+	// Per-stream state of one layer, z indexes the stream
+	struct LayerBatch {
+		cl::Image3D _hiddenFeedForwardActivations;
+		cl::Image3D _hiddenFeedBackActivations;
+
+		cl::Image3D _hiddenStatesFeedForward;
+
+		cl::Image3D _hiddenStatesFeedBack;
+		cl::Image3D _hiddenStatesFeedBackPrev;
+
+		cl::Image3D _visibleReconstruction;
+	};
+
+	// Runs many independent sequences through the weights of one HTFE.
+	// Only the recurrent state is per stream, so every kernel launches once over (width, height, batchSize).
+	// Inference only: the weights are read from the source HTFE on every activate, so it may keep learning on its own stream
+	class HTFEBatch {
+	private:
+		const HTFE* _pSource;
+
+		int _batchSize;
+
+		std::vector<LayerBatch> _layers;
+
+		cl::Kernel _layerHiddenFeedForwardActivateKernel;
+		cl::Kernel _layerHiddenFeedBackActivateKernel;
+		cl::Kernel _layerHiddenInhibitKernel;
+		cl::Kernel _layerVisibleReconstructKernel;
+
+		std::vector<float> _inputs;
+		std::vector<float> _predictions;
+
+		cl::Image3D _inputImage;
+
+		void clearStreams(sys::ComputeSystem &cs, int firstStream, int numStreams);
+
+	public:
+		HTFEBatch()
+			: _pSource(nullptr), _batchSize(0)
+		{}
+
+		// The source HTFE must outlive this object, program must be built for the weight type of the source
+		bool create(sys::ComputeSystem &cs, sys::ComputeProgram &program, const HTFE &source, int batchSize);
+
+		void activate(sys::ComputeSystem &cs);
+		void stepEnd();
+
+		int getBatchSize() const {
+			return _batchSize;
+		}
+
+		const std::vector<LayerBatch> &getLayers() const {
+			return _layers;
+		}
+
+		void setInput(int stream, int i, float value) {
+			_inputs[i + stream * _pSource->getInputWidth() * _pSource->getInputHeight()] = value;
+		}
+
+		void setInput(int stream, int x, int y, float value) {
+			setInput(stream, x + y * _pSource->getInputWidth(), value);
+		}
+
+		float getPrediction(int stream, int i) const {
+			return _predictions[i + stream * _pSource->getInputWidth() * _pSource->getInputHeight()];
+		}
+
+		float getPrediction(int stream, int x, int y) const {
+			return getPrediction(stream, x + y * _pSource->getInputWidth());
+		}
+
+		// Inputs and predictions of all streams, stream after stream, getInputSize() values, for bulk access such as the Python buffer bindings
+		float* getInputData() {
+			return _inputs.data();
+		}
+
+		const float* getPredictionData() const {
+			return _predictions.data();
+		}
+
+		int getInputSize() const {
+			return _batchSize * _pSource->getInputWidth() * _pSource->getInputHeight();
+		}
+
+		// Clears the recurrent state of all streams
+		void clearMemory(sys::ComputeSystem &cs);
+
+		// Clears the recurrent state of one stream, e.g. when it is handed to a new sequence
+		void clearMemory(sys::ComputeSystem &cs, int stream);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,589 @@
+#include "HTFECPU.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define HTFE_CPU_SSE 1
+#else
+#define HTFE_CPU_SSE 0
+#endif
+
+using namespace htfe;
+
+namespace {
+	// Random streams per layer, numInitStreams in HTFE.cpp
+	const std::uint32_t numInitStreams = 6;
+
+	float sigmoid(float x) {
+		return 1.0f / (1.0f + std::exp(-x));
+	}
+
+	// Same float rounding as the center position computations in htfe.cl
+	int project(int position, float sizeMinusOneInv, int targetSizeMinusOne) {
+		return static_cast<int>(position * sizeMinusOneInv * targetSizeMinusOne);
+	}
+
+	float dot(const float* a, const float* b, int count) {
+		float sum = 0.0f;
+
+		int i = 0;
+
+#if HTFE_CPU_SSE
+		__m128 acc = _mm_setzero_ps();
+
+		for (; i + 4 <= count; i += 4)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+		float lanes[4];
+
+		_mm_storeu_ps(lanes, acc);
+
+		sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+		for (; i < count; i++)
+			sum += a[i] * b[i];
+
+		return sum;
+	}
+
+	// weights = scale * weights + alpha * (error * inputs)
+	void scaleAdd(float* weights, const float* inputs, int count, float scale, float error, float alpha) {
+		int i = 0;
+
+#if HTFE_CPU_SSE
+		__m128 scale4 = _mm_set1_ps(scale);
+		__m128 error4 = _mm_set1_ps(error);
+		__m128 alpha4 = _mm_set1_ps(alpha);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 eligibility = _mm_mul_ps(error4, _mm_loadu_ps(inputs + i));
+
+			_mm_storeu_ps(weights + i, _mm_add_ps(_mm_mul_ps(scale4, _mm_loadu_ps(weights + i)), _mm_mul_ps(alpha4, eligibility)));
+		}
+#endif
+
+		for (; i < count; i++)
+			weights[i] = scale * weights[i] + alpha * (error * inputs[i]);
+	}
+
+	// Sum of weights * field over the window around (centerX, centerY), positions outside the field contribute nothing
+	float gather(const float* field, int width, int height, const float* weights, int centerX, int centerY, int radius) {
+		int diameter = radius * 2 + 1;
+
+		int yStart = std::max(0, centerY - radius);
+		int yEnd = std::min(height - 1, centerY + radius);
+
+		if (yStart > yEnd)
+			return 0.0f;
+
+		int count = yEnd - yStart + 1;
+		int weightOffset = yStart - (centerY - radius);
+
+		float sum = 0.0f;
+
+		for (int dx = -radius; dx <= radius; dx++) {
+			int x = centerX + dx;
+
+			if (x < 0 || x >= width)
+				continue;
+
+			sum += dot(weights + (dx + radius) * diameter + weightOffset, field + x * height + yStart, count);
+		}
+
+		return sum;
+	}
+
+	// Weight update over the same window as gather, weights of positions outside the field are left untouched
+	void update(float* weights, const float* field, int width, int height, int centerX, int centerY, int radius, float scale, float error, float alpha) {
+		int diameter = radius * 2 + 1;
+
+		int yStart = std::max(0, centerY - radius);
+		int yEnd = std::min(height - 1, centerY + radius);
+
+		if (yStart > yEnd)
+			return;
+
+		int count = yEnd - yStart + 1;
+		int weightOffset = yStart - (centerY - radius);
+
+		for (int dx = -radius; dx <= radius; dx++) {
+			int x = centerX + dx;
+
+			if (x < 0 || x >= width)
+				continue;
+
+			scaleAdd(weights + (dx + radius) * diameter + weightOffset, field + x * height + yStart, count, scale, error, alpha);
+		}
+	}
+
+	// Same generator as philox2x32 in htfe.cl
+	void philox2x32(std::uint32_t &x, std::uint32_t &y, std::uint32_t key) {
+		for (int r = 0; r < 10; r++) {
+			std::uint64_t product = static_cast<std::uint64_t>(0xd256d193u) * x;
+
+			std::uint32_t hi = static_cast<std::uint32_t>(product >> 32);
+			std::uint32_t lo = static_cast<std::uint32_t>(product);
+
+			x = hi ^ key ^ y;
+			y = lo;
+			key += 0x9e3779b9u;
+		}
+	}
+
+	// Same as philoxFloat in htfe.cl, index is the element address of the device layout
+	float philoxFloat(std::uint32_t index, std::uint32_t stream, std::uint32_t seed) {
+		std::uint32_t x = index;
+		std::uint32_t y = stream;
+
+		philox2x32(x, y, seed);
+
+		return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Fills per unit column major weights as initializeWeights in htfe.cl fills its (x, y, weight index) planes
+	void initializeWeights(std::vector<float> &weights, int width, int height, int numWeights, std::uint32_t seed, std::uint32_t stream, float scalar, float minWeight, float maxWeight) {
+		weights.resize(static_cast<size_t>(width) * height * numWeights);
+
+		for (int x = 0; x < width; x++)
+			for (int y = 0; y < height; y++) {
+				float* pUnitWeights = &weights[(y + x * height) * static_cast<size_t>(numWeights)];
+
+				for (int wi = 0; wi < numWeights; wi++)
+					pUnitWeights[wi] = scalar * (philoxFloat((wi * height + y) * width + x, stream, seed) * (maxWeight - minWeight) + minWeight);
+			}
+	}
+
+	// initializeLayerHidden and initializeLayerVisible in htfe.cl
+	void initializeBiases(std::vector<float> &biases, int width, int height, std::uint32_t seed, std::uint32_t stream, float minWeight, float maxWeight) {
+		biases.resize(width * height);
+
+		for (int x = 0; x < width; x++)
+			for (int y = 0; y < height; y++)
+				biases[y + x * height] = philoxFloat(x + y * width, stream, seed) * (maxWeight - minWeight) + minWeight;
+	}
+
+	void transpose(const float* source, float* destination, int width, int height) {
+		for (int x = 0; x < width; x++)
+			for (int y = 0; y < height; y++)
+				destination[y + x * height] = source[x + y * width];
+	}
+}
+
+void HTFECPU::createRandom(int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight, int numThreads) {
+	std::random_device device;
+
+	createRandom(inputWidth, inputHeight, layerDescs, minInitWeight, maxInitWeight, numThreads, device());
+}
+
+void HTFECPU::createRandom(int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight, int numThreads, unsigned int seed) {
+	_pool.create(numThreads);
+
+	_seed = seed;
+
+	_inputWidth = inputWidth;
+	_inputHeight = inputHeight;
+
+	_layerDescs = layerDescs;
+
+	_layers.clear();
+	_layers.resize(_layerDescs.size());
+
+	_input.clear();
+	_input.resize(_inputWidth * _inputHeight, 0.0f);
+
+	_prediction.clear();
+	_prediction.resize(_inputWidth * _inputHeight, 0.0f);
+
+	_inputField.clear();
+	_inputField.resize(_inputWidth * _inputHeight, 0.0f);
+
+	_inputFieldPrev.clear();
+	_inputFieldPrev.resize(_inputWidth * _inputHeight, 0.0f);
+
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		const LayerDesc &desc = _layerDescs[l];
+		LayerCPU &layer = _layers[l];
+
+		int numHidden = desc._width * desc._height;
+		int numVisible = prevWidth * prevHeight;
+
+		int numFeedForwardWeights = std::pow(desc._receptiveFieldRadius * 2 + 1, 2);
+		int numReconstructionWeights = std::pow(desc._reconstructionRadius * 2 + 1, 2);
+		int numLateralWeights = std::pow(desc._lateralConnectionRadius * 2 + 1, 2);
+		int numFeedBackWeights = std::pow(desc._feedBackConnectionRadius * 2 + 1, 2);
+
+		layer._hiddenFeedForwardActivations.assign(numHidden, 0.0f);
+		layer._hiddenFeedForwardSums.assign(numHidden, 0.0f);
+		layer._hiddenFeedBackActivations.assign(numHidden, 0.0f);
+		layer._hiddenFeedBackActivationsPrev.assign(numHidden, 0.0f);
+
+		layer._hiddenStatesFeedForward.assign(numHidden, 0.0f);
+		layer._hiddenStatesFeedForwardPrev.assign(numHidden, 0.0f);
+
+		layer._hiddenStatesFeedBack.assign(numHidden, 0.0f);
+		layer._hiddenStatesFeedBackPrev.assign(numHidden, 0.0f);
+		layer._hiddenStatesFeedBackPrevPrev.assign(numHidden, 0.0f);
+
+		layer._visibleReconstruction.assign(numVisible, 0.0f);
+		layer._visibleReconstructionPrev.assign(numVisible, 0.0f);
+
+		// Streams in the order of HTFE::createRandom: the four weight tensors, then the hidden and visible biases
+		std::uint32_t stream = l * numInitStreams;
+
+		initializeWeights(layer._feedForwardWeights, desc._width, desc._height, numFeedForwardWeights, seed, stream++, 1.0f, minInitWeight, maxInitWeight);
+		initializeWeights(layer._lateralWeights, desc._width, desc._height, numLateralWeights, seed, stream++, desc._lateralScalar, minInitWeight, maxInitWeight);
+		initializeWeights(layer._feedBackWeights, desc._width, desc._height, numFeedBackWeights, seed, stream++, desc._feedBackScalar, minInitWeight, maxInitWeight);
+		initializeWeights(layer._reconstructionWeights, prevWidth, prevHeight, numReconstructionWeights, seed, stream++, 1.0f, minInitWeight, maxInitWeight);
+
+		initializeBiases(layer._hiddenBiases, desc._width, desc._height, seed, stream++, minInitWeight, maxInitWeight);
+		initializeBiases(layer._visibleBiases, prevWidth, prevHeight, seed, stream++, minInitWeight, maxInitWeight);
+
+		prevWidth = desc._width;
+		prevHeight = desc._height;
+	}
+}
+
+void HTFECPU::parallelFor(int count, const std::function<void(int, int)> &func) {
+	_pool.parallelFor(count, count / (_pool.getNumThreads() * 4), func);
+}
+
+void HTFECPU::inhibit(const std::vector<float> &activations, std::vector<float> &states, const LayerDesc &desc) {
+	float localActivity = std::round(desc._sparsity * std::pow(2 * desc._inhibitionRadius + 1, 2));
+
+	int width = desc._width;
+	int height = desc._height;
+	int radius = desc._inhibitionRadius;
+
+	parallelFor(width, [&](int begin, int end) {
+		for (int x = begin; x < end; x++)
+			for (int y = 0; y < height; y++) {
+				float thisActivation = activations[y + x * height];
+
+				int yStart = std::max(0, y - radius);
+				int yEnd = std::min(height - 1, y + radius);
+
+				float numHigher = 0.0f;
+
+				for (int ox = std::max(0, x - radius); ox <= std::min(width - 1, x + radius); ox++) {
+					const float* column = &activations[ox * height];
+
+					for (int oy = yStart; oy <= yEnd; oy++)
+						numHigher += column[oy] >= thisActivation ? 1.0f : 0.0f;
+				}
+
+				// The window loop counted this unit against itself
+				numHigher -= 1.0f;
+
+				states[y + x * height] = numHigher < localActivity ? 1.0f : 0.0f;
+			}
+	});
+}
+
+void HTFECPU::activate() {
+	transpose(_input.data(), _inputField.data(), _inputWidth, _inputHeight);
+
+	// ------------------------------------------------------------------------------
+	// ------------------------------------ Go up -----------------------------------
+	// ------------------------------------------------------------------------------
+
+	const float* pPrevLayer = _inputField.data();
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		const LayerDesc &desc = _layerDescs[l];
+		LayerCPU &layer = _layers[l];
+
+		int width = desc._width;
+		int height = desc._height;
+
+		float layerSizeMinusOneInvX = 1.0f / (width - 1);
+		float layerSizeMinusOneInvY = 1.0f / (height - 1);
+
+		int numFeedForwardWeights = std::pow(desc._receptiveFieldRadius * 2 + 1, 2);
+		int numLateralWeights = std::pow(desc._lateralConnectionRadius * 2 + 1, 2);
+
+		// -------------------------------- Activate --------------------------------
+
+		parallelFor(width, [&](int begin, int end) {
+			for (int x = begin; x < end; x++)
+				for (int y = 0; y < height; y++) {
+					int i = y + x * height;
+
+					int inputCenterX = project(x, layerSizeMinusOneInvX, prevWidth - 1);
+					int inputCenterY = project(y, layerSizeMinusOneInvY, prevHeight - 1);
+
+					float sum = gather(pPrevLayer, prevWidth, prevHeight, &layer._feedForwardWeights[i * numFeedForwardWeights], inputCenterX, inputCenterY, desc._receptiveFieldRadius);
+
+					sum += gather(layer._hiddenStatesFeedBackPrev.data(), width, height, &layer._lateralWeights[i * numLateralWeights], x, y, desc._lateralConnectionRadius);
+
+					// Bias
+					sum += layer._hiddenBiases[i];
+
+					layer._hiddenFeedForwardActivations[i] = sigmoid(sum);
+					layer._hiddenFeedForwardSums[i] = sum;
+				}
+		});
+
+		// ---------------------------------- Inhibit ---------------------------------
+
+		inhibit(layer._hiddenFeedForwardActivations, layer._hiddenStatesFeedForward, desc);
+
+		pPrevLayer = layer._hiddenStatesFeedForward.data();
+		prevWidth = width;
+		prevHeight = height;
+	}
+
+	// ------------------------------------------------------------------------------
+	// -------------------------------- Go back down --------------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = _layers.size() - 1; l >= 0; l--) {
+		const LayerDesc &desc = _layerDescs[l];
+		LayerCPU &layer = _layers[l];
+
+		int width = desc._width;
+		int height = desc._height;
+
+		if (l > 0) {
+			prevWidth = _layerDescs[l - 1]._width;
+			prevHeight = _layerDescs[l - 1]._height;
+		}
+		else {
+			prevWidth = _inputWidth;
+			prevHeight = _inputHeight;
+		}
+
+		float layerSizeMinusOneInvX = 1.0f / (width - 1);
+		float layerSizeMinusOneInvY = 1.0f / (height - 1);
+
+		float inputSizeMinusOneInvX = 1.0f / (prevWidth - 1);
+		float inputSizeMinusOneInvY = 1.0f / (prevHeight - 1);
+
+		// -------------------------------- Activate --------------------------------
+
+		if (l == _layers.size() - 1)
+			std::copy(layer._hiddenFeedForwardActivations.begin(), layer._hiddenFeedForwardActivations.end(), layer._hiddenFeedBackActivations.begin());
+		else {
+			const LayerCPU &next = _layers[l + 1];
+
+			int nextWidth = _layerDescs[l + 1]._width;
+			int nextHeight = _layerDescs[l + 1]._height;
+
+			int numFeedBackWeights = std::pow(desc._feedBackConnectionRadius * 2 + 1, 2);
+
+			parallelFor(width, [&](int begin, int end) {
+				for (int x = begin; x < end; x++)
+					for (int y = 0; y < height; y++) {
+						int i = y + x * height;
+
+						int nextCenterX = project(x, layerSizeMinusOneInvX, nextWidth - 1);
+						int nextCenterY = project(y, layerSizeMinusOneInvY, nextHeight - 1);
+
+						float sum = layer._hiddenFeedForwardSums[i];
+
+						sum += gather(next._hiddenFeedBackActivations.data(), nextWidth, nextHeight, &layer._feedBackWeights[i * numFeedBackWeights], nextCenterX, nextCenterY, desc._feedBackConnectionRadius);
+
+						layer._hiddenFeedBackActivations[i] = sigmoid(sum);
+					}
+			});
+		}
+
+		// ---------------------------------- Inhibit ---------------------------------
+
+		inhibit(layer._hiddenFeedBackActivations, layer._hiddenStatesFeedBack, desc);
+
+		// --------------------- Make Predictions (Reconstruction) ---------------------
+
+		int numReconstructionWeights = std::pow(desc._reconstructionRadius * 2 + 1, 2);
+
+		parallelFor(prevWidth, [&](int begin, int end) {
+			for (int x = begin; x < end; x++)
+				for (int y = 0; y < prevHeight; y++) {
+					int i = y + x * prevHeight;
+
+					int layerCenterX = project(x, inputSizeMinusOneInvX, width - 1);
+					int layerCenterY = project(y, inputSizeMinusOneInvY, height - 1);
+
+					layer._visibleReconstruction[i] = gather(layer._hiddenStatesFeedBack.data(), width, height, &layer._reconstructionWeights[i * numReconstructionWeights], layerCenterX, layerCenterY, desc._reconstructionRadius);
+				}
+		});
+	}
+
+	for (int x = 0; x < _inputWidth; x++)
+		for (int y = 0; y < _inputHeight; y++)
+			_prediction[x + y * _inputWidth] = _layers.front()._visibleReconstruction[y + x * _inputHeight];
+}
+
+void HTFECPU::learn() {
+	// ------------------------------------------------------------------------------
+	// ---------------------- Weight Update and Predictions  ------------------------
+	// ------------------------------------------------------------------------------
+
+	// Weights are updated in place: a unit only touches its own weights, and the hidden update of a layer reads
+	// its reconstruction weights before the visible update of that layer changes them, same as the Prev images on the device
+
+	const float* pPrevLayer = _inputField.data();
+	const float* pPrevLayerPrev = _inputFieldPrev.data();
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		const LayerDesc &desc = _layerDescs[l];
+		LayerCPU &layer = _layers[l];
+
+		int width = desc._width;
+		int height = desc._height;
+
+		bool last = l == _layers.size() - 1;
+
+		int nextWidth = last ? 1 : _layerDescs[l + 1]._width;
+		int nextHeight = last ? 1 : _layerDescs[l + 1]._height;
+
+		float layerSizeMinusOneInvX = 1.0f / (width - 1);
+		float layerSizeMinusOneInvY = 1.0f / (height - 1);
+
+		float inputSizeMinusOneInvX = 1.0f / (prevWidth - 1);
+		float inputSizeMinusOneInvY = 1.0f / (prevHeight - 1);
+
+		int reconstructionDiameter = desc._reconstructionRadius * 2 + 1;
+
+		int numFeedForwardWeights = std::pow(desc._receptiveFieldRadius * 2 + 1, 2);
+		int numReconstructionWeights = reconstructionDiameter * reconstructionDiameter;
+		int numLateralWeights = std::pow(desc._lateralConnectionRadius * 2 + 1, 2);
+		int numFeedBackWeights = std::pow(desc._feedBackConnectionRadius * 2 + 1, 2);
+
+		// ------------------------------- Weight Updates -------------------------------
+
+		parallelFor(width, [&](int begin, int end) {
+			for (int x = begin; x < end; x++)
+				for (int y = 0; y < height; y++) {
+					int i = y + x * height;
+
+					float thisHiddenStatePrev = layer._hiddenStatesFeedBackPrev[i];
+
+					// No learning signal and no decay, the update would leave everything unchanged
+					if (thisHiddenStatePrev == 0.0f)
+						continue;
+
+					int inputCenterX = project(x, layerSizeMinusOneInvX, prevWidth - 1);
+					int inputCenterY = project(y, layerSizeMinusOneInvY, prevHeight - 1);
+
+					float thisHiddenStatePrevPrev = layer._hiddenStatesFeedBackPrevPrev[i];
+					float thisActivation = layer._hiddenFeedBackActivationsPrev[i];
+
+					// --------------------------------- Collect Error -------------------------------------
+
+					float sum = 0.0f;
+
+					for (int dx = -desc._receptiveFieldRadius; dx <= desc._receptiveFieldRadius; dx++) {
+						int inputX = inputCenterX + dx;
+
+						if (inputX < 0 || inputX >= prevWidth)
+							continue;
+
+						int fieldLowerX = project(inputX, inputSizeMinusOneInvX, width - 1) - desc._reconstructionRadius;
+
+						if (x < fieldLowerX || x > fieldLowerX + 2 * desc._reconstructionRadius)
+							continue;
+
+						for (int dy = -desc._receptiveFieldRadius; dy <= desc._receptiveFieldRadius; dy++) {
+							int inputY = inputCenterY + dy;
+
+							if (inputY < 0 || inputY >= prevHeight)
+								continue;
+
+							int fieldLowerY = project(inputY, inputSizeMinusOneInvY, height - 1) - desc._reconstructionRadius;
+
+							// Check for containment
+							if (y >= fieldLowerY && y <= fieldLowerY + 2 * desc._reconstructionRadius) {
+								int v = inputY + inputX * prevHeight;
+
+								int weightIndex = (y - fieldLowerY) + (x - fieldLowerX) * reconstructionDiameter;
+
+								sum += (pPrevLayer[v] - layer._visibleReconstructionPrev[v]) * layer._reconstructionWeights[v * numReconstructionWeights + weightIndex];
+							}
+						}
+					}
+
+					float learn = thisHiddenStatePrev * (1.0f - thisHiddenStatePrevPrev);
+					float error = learn * thisActivation * (1.0f - thisActivation) * sum;
+
+					// --------------------------------- Update on Error ---------------------------------
+
+					float decay = 1.0f - desc._weightDecay * thisHiddenStatePrev;
+
+					update(&layer._feedForwardWeights[i * numFeedForwardWeights], pPrevLayerPrev, prevWidth, prevHeight, inputCenterX, inputCenterY, desc._receptiveFieldRadius, decay, error, desc._feedForwardAlpha);
+
+					update(&layer._lateralWeights[i * numLateralWeights], layer._hiddenStatesFeedBackPrevPrev.data(), width, height, x, y, desc._lateralConnectionRadius, decay, error, desc._lateralAlpha);
+
+					if (!last) {
+						int nextCenterX = project(x, layerSizeMinusOneInvX, nextWidth - 1);
+						int nextCenterY = project(y, layerSizeMinusOneInvY, nextHeight - 1);
+
+						update(&layer._feedBackWeights[i * numFeedBackWeights], _layers[l + 1]._hiddenStatesFeedBackPrev.data(), nextWidth, nextHeight, nextCenterX, nextCenterY, desc._feedBackConnectionRadius, decay, error, desc._feedBackAlpha);
+					}
+
+					layer._hiddenBiases[i] = decay * layer._hiddenBiases[i] + desc._hiddenBiasAlpha * error;
+				}
+		});
+
+		parallelFor(prevWidth, [&](int begin, int end) {
+			for (int x = begin; x < end; x++)
+				for (int y = 0; y < prevHeight; y++) {
+					int i = y + x * prevHeight;
+
+					int layerCenterX = project(x, inputSizeMinusOneInvX, width - 1);
+					int layerCenterY = project(y, inputSizeMinusOneInvY, height - 1);
+
+					float error = pPrevLayer[i] - layer._visibleReconstructionPrev[i];
+
+					update(&layer._reconstructionWeights[i * numReconstructionWeights], layer._hiddenStatesFeedBackPrev.data(), width, height, layerCenterX, layerCenterY, desc._reconstructionRadius, 1.0f, error, desc._reconstructionAlpha);
+
+					layer._visibleBiases[i] += desc._reconstructionAlpha * error;
+				}
+		});
+
+		pPrevLayer = layer._hiddenStatesFeedForward.data();
+		pPrevLayerPrev = layer._hiddenStatesFeedForwardPrev.data();
+		prevWidth = width;
+		prevHeight = height;
+	}
+}
+
+void HTFECPU::stepEnd() {
+	// ------------------------------------------------------------------------------
+	// ---------------------------------- Step End ----------------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = 0; l < _layers.size(); l++) {
+		std::swap(_layers[l]._visibleReconstruction, _layers[l]._visibleReconstructionPrev);
+		std::swap(_layers[l]._hiddenFeedBackActivations, _layers[l]._hiddenFeedBackActivationsPrev);
+		std::swap(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedForwardPrev);
+
+		std::swap(_layers[l]._hiddenStatesFeedBackPrevPrev, _layers[l]._hiddenStatesFeedBackPrev);
+		std::swap(_layers[l]._hiddenStatesFeedBackPrev, _layers[l]._hiddenStatesFeedBack);
+	}
+
+	std::swap(_inputField, _inputFieldPrev);
+}
+
+void HTFECPU::clearMemory() {
+	// ------------------------------------------------------------------------------
+	// -------------------------------- Clear Memory --------------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = 0; l < _layers.size(); l++) {
+		std::fill(_layers[l]._hiddenStatesFeedBackPrevPrev.begin(), _layers[l]._hiddenStatesFeedBackPrevPrev.end(), 0.0f);
+		std::fill(_layers[l]._hiddenStatesFeedBackPrev.begin(), _layers[l]._hiddenStatesFeedBackPrev.end(), 0.0f);
+		std::fill(_layers[l]._hiddenStatesFeedBack.begin(), _layers[l]._hiddenStatesFeedBack.end(), 0.0f);
+	}
+}
\ No newline at end of file
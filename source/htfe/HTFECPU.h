@@ -0,0 +1,130 @@
+#pragma once
+
+#include "LayerDesc.h"
+
+#include "../system/ThreadPool.h"
+
+#include <vector>
+
+namespace htfe {
+	// Host copy of a layer. Fields are stored column major (index = y + x * height) so that the inner dy loop of every receptive field is contiguous,
+	// weights are stored per unit with the same dx-major weight index as the OpenCL kernels
+	struct LayerCPU {
+		std::vector<float> _hiddenFeedForwardActivations;
+		std::vector<float> _hiddenFeedForwardSums;
+		std::vector<float> _hiddenFeedBackActivations;
+		std::vector<float> _hiddenFeedBackActivationsPrev;
+
+		std::vector<float> _hiddenStatesFeedForward;
+		std::vector<float> _hiddenStatesFeedForwardPrev;
+
+		std::vector<float> _hiddenStatesFeedBack;
+		std::vector<float> _hiddenStatesFeedBackPrev;
+		std::vector<float> _hiddenStatesFeedBackPrevPrev;
+
+		std::vector<float> _feedForwardWeights;
+		std::vector<float> _reconstructionWeights;
+		std::vector<float> _visibleBiases;
+		std::vector<float> _hiddenBiases;
+		std::vector<float> _lateralWeights;
+		std::vector<float> _feedBackWeights;
+
+		std::vector<float> _visibleReconstruction;
+		std::vector<float> _visibleReconstructionPrev;
+	};
+
+	// Multithreaded host implementation of HTFE that does not need an OpenCL runtime.
+	// Mirrors the kernels in htfe.cl, so it can be used in place of HTFE where no device is available
+	class HTFECPU {
+	private:
+		int _inputWidth, _inputHeight;
+
+		std::vector<LayerDesc> _layerDescs;
+		std::vector<LayerCPU> _layers;
+
+		std::vector<float> _input;
+		std::vector<float> _prediction;
+
+		std::vector<float> _inputField;
+		std::vector<float> _inputFieldPrev;
+
+		unsigned int _seed;
+
+		sys::ThreadPool _pool;
+
+		void parallelFor(int count, const std::function<void(int, int)> &func);
+
+		void inhibit(const std::vector<float> &activations, std::vector<float> &states, const LayerDesc &desc);
+
+	public:
+		HTFECPU()
+			: _inputWidth(0), _inputHeight(0), _seed(0)
+		{}
+
+		// numThreads <= 0 uses all hardware threads. Seeded from std::random_device, getSeed returns the seed drawn
+		void createRandom(int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight, int numThreads = 0);
+
+		// Draws every weight and bias from the same Philox streams as HTFE::createRandom, so one seed gives the same model on both backends
+		void createRandom(int inputWidth, int inputHeight, const std::vector<LayerDesc> &layerDescs, float minInitWeight, float maxInitWeight, int numThreads, unsigned int seed);
+
+		void activate();
+		void learn();
+		void stepEnd();
+
+		int getInputWidth() const {
+			return _inputWidth;
+		}
+
+		int getInputHeight() const {
+			return _inputHeight;
+		}
+
+		const std::vector<LayerDesc> &getLayerDescs() const {
+			return _layerDescs;
+		}
+
+		const std::vector<LayerCPU> &getLayers() const {
+			return _layers;
+		}
+
+		// Seed of the last createRandom
+		unsigned int getSeed() const {
+			return _seed;
+		}
+
+		void setInput(int i, float value) {
+			_input[i] = value;
+		}
+
+		void setInput(int x, int y, float value) {
+			setInput(x + y * _inputWidth, value);
+		}
+
+		float getPrediction(int i) const {
+			return _prediction[i];
+		}
+
+		float getPrediction(int x, int y) const {
+			return getPrediction(x + y * _inputWidth);
+		}
+
+		// Contiguous input and prediction of getInputSize() values, for bulk access such as the Python buffer bindings
+		float* getInputData() {
+			return _input.data();
+		}
+
+		const float* getPredictionData() const {
+			return _prediction.data();
+		}
+
+		int getInputSize() const {
+			return _inputWidth * _inputHeight;
+		}
+
+		int getNumThreads() const {
+			return _pool.getNumThreads();
+		}
+
+		void clearMemory();
+	};
+}
\ No newline at end of file
@@ -0,0 +1,450 @@
+#include "HTFEFrozen.h"
+
+#include "StateFormat.h"
+#include "Tiling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace htfe;
+
+namespace {
+	// Copies fp32 weights into a new buffer of weightType with the convertWeights kernel of a program built for that type.
+	// Returns the scale the kernels multiply the stored weights with, int8 uses a symmetric per tensor scale that maps the largest magnitude to 127
+	float convertWeights(sys::ComputeSystem &cs, cl::Kernel &convertWeightsKernel, WeightType weightType, const cl::Buffer &source, cl::Buffer &destination) {
+		size_t numWeights = source.getInfo<CL_MEM_SIZE>() / sizeof(float);
+
+		float scale = 1.0f;
+
+		if (weightType == _int8) {
+			std::vector<float> weights(numWeights);
+
+			cs.getQueue().enqueueReadBuffer(source, CL_TRUE, 0, numWeights * sizeof(float), weights.data());
+
+			float maxAbs = 0.0f;
+
+			for (int i = 0; i < numWeights; i++)
+				maxAbs = std::max(maxAbs, std::abs(weights[i]));
+
+			if (maxAbs > 0.0f)
+				scale = maxAbs / 127.0f;
+		}
+
+		destination = cl::Buffer(cs.getContext(), CL_MEM_READ_ONLY, numWeights * weightTypeSize(weightType));
+
+		convertWeightsKernel.setArg(0, source);
+		convertWeightsKernel.setArg(1, destination);
+		convertWeightsKernel.setArg(2, 1.0f / scale);
+
+		cs.getQueue().enqueueNDRangeKernel(convertWeightsKernel, cl::NullRange, cl::NDRange(numWeights));
+
+		return scale;
+	}
+}
+
+bool HTFEFrozen::create(sys::ComputeSystem &cs, sys::ComputeProgram &program, const HTFE &source) {
+	const std::vector<Layer> &sourceLayers = source.getLayers();
+
+	// A source spread over several devices may still be running on the other queues
+	if (cs.getNumDevices() > 1)
+		cs.finish();
+
+	_weightType = htfe::getWeightType(program);
+
+	bool convert = _weightType != source.getWeightType();
+
+	if (convert && source.getWeightType() != _float32) {
+#ifdef SYS_DEBUG
+		std::cerr << "HTFEFrozen can only convert float32 weights!" << std::endl;
+#endif
+		return false;
+	}
+
+	cl::Kernel convertWeightsKernel;
+
+	if (convert)
+		convertWeightsKernel = cl::Kernel(program.getProgram(), "convertWeights");
+
+	_inputWidth = source.getInputWidth();
+	_inputHeight = source.getInputHeight();
+
+	_layerDescs = source.getLayerDescs();
+
+	_layers.clear();
+	_layers.resize(_layerDescs.size());
+
+	_constants.clear();
+	_constants.resize(_layerDescs.size());
+
+	_input.clear();
+	_input.resize(_inputWidth * _inputHeight, 0.0f);
+
+	_prediction.clear();
+	_prediction.resize(_inputWidth * _inputHeight, 0.0f);
+
+	_inputImage = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), _inputWidth, _inputHeight);
+
+	_layerHiddenFeedForwardActivateKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedForwardActivate");
+	_layerHiddenFeedBackActivateKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedBackActivate");
+	_layerHiddenInhibitKernel = cl::Kernel(program.getProgram(), "layerHiddenInhibit");
+	_layerHiddenFeedForwardActivateInhibitKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedForwardActivateInhibit");
+	_layerHiddenFeedBackActivateInhibitKernel = cl::Kernel(program.getProgram(), "layerHiddenFeedBackActivateInhibit");
+	_layerVisibleReconstructKernel = cl::Kernel(program.getProgram(), "layerVisibleReconstruct");
+	_layerVisibleReconstructTiledKernel = cl::Kernel(program.getProgram(), "layerVisibleReconstructTiled");
+
+	// Tile sizes of the source fit its own programs and devices, these kernels always run on the first device
+	cl_ulong localMemSize = cs.getDevice().getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+	size_t feedForwardWorkGroupSize = _layerHiddenFeedForwardActivateInhibitKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(cs.getDevice());
+	size_t feedBackWorkGroupSize = _layerHiddenFeedBackActivateInhibitKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(cs.getDevice());
+	size_t reconstructWorkGroupSize = _layerVisibleReconstructTiledKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(cs.getDevice());
+
+	size_t fusedWorkGroupSize = std::min(feedForwardWorkGroupSize, feedBackWorkGroupSize);
+
+	int prevWidth = _inputWidth;
+	int prevHeight = _inputHeight;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		_layers[l]._hiddenFeedForwardActivations = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
+
+		// The top layer has no feed back, its feed back activations are its feed forward activations
+		if (l == _layers.size() - 1)
+			_layers[l]._hiddenFeedBackActivations = _layers[l]._hiddenFeedForwardActivations;
+		else
+			_layers[l]._hiddenFeedBackActivations = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_RG, CL_FLOAT), _layerDescs[l]._width, _layerDescs[l]._height);
+
+		_layers[l]._hiddenStatesFeedForward = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+
+		_layers[l]._hiddenStatesFeedBack = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+		_layers[l]._hiddenStatesFeedBackPrev = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, stateImageFormat(), _layerDescs[l]._width, _layerDescs[l]._height);
+
+		_layers[l]._visibleReconstruction = cl::Image2D(cs.getContext(), CL_MEM_READ_WRITE, cl::ImageFormat(CL_R, CL_FLOAT), prevWidth, prevHeight);
+
+		_layers[l]._visibleBiases = sourceLayers[l]._visibleBiases;
+		_layers[l]._hiddenBiases = sourceLayers[l]._hiddenBiases;
+
+		if (convert) {
+			_layers[l]._weightScales._x = convertWeights(cs, convertWeightsKernel, _weightType, sourceLayers[l]._feedForwardWeights, _layers[l]._feedForwardWeights);
+			_layers[l]._weightScales._y = convertWeights(cs, convertWeightsKernel, _weightType, sourceLayers[l]._lateralWeights, _layers[l]._lateralWeights);
+			_layers[l]._weightScales._z = convertWeights(cs, convertWeightsKernel, _weightType, sourceLayers[l]._feedBackWeights, _layers[l]._feedBackWeights);
+			_layers[l]._weightScales._w = convertWeights(cs, convertWeightsKernel, _weightType, sourceLayers[l]._reconstructionWeights, _layers[l]._reconstructionWeights);
+		}
+		else {
+			_layers[l]._feedForwardWeights = sourceLayers[l]._feedForwardWeights;
+			_layers[l]._reconstructionWeights = sourceLayers[l]._reconstructionWeights;
+			_layers[l]._lateralWeights = sourceLayers[l]._lateralWeights;
+			_layers[l]._feedBackWeights = sourceLayers[l]._feedBackWeights;
+
+			_layers[l]._weightScales._x = _layers[l]._weightScales._y = _layers[l]._weightScales._z = _layers[l]._weightScales._w = 1.0f;
+		}
+
+		Int2 inputSize;
+		inputSize._x = prevWidth;
+		inputSize._y = prevHeight;
+
+		chooseTileSizes(_layerDescs[l], l < _layers.size() - 1 ? &_layerDescs[l + 1] : nullptr, inputSize, fusedWorkGroupSize, reconstructWorkGroupSize, localMemSize,
+			_layers[l]._fusedTileSize, _layers[l]._reconstructTileSize);
+
+		// Recurrent state, the only image activate reads from the previous step
+		{
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = _layerDescs[l]._width;
+			region[1] = _layerDescs[l]._height;
+			region[2] = 1;
+
+			cs.getQueue().enqueueCopyImage(sourceLayers[l]._hiddenStatesFeedBackPrev, _layers[l]._hiddenStatesFeedBackPrev, origin, origin, region);
+		}
+
+		LayerConstants &constants = _constants[l];
+
+		constants._layerSize._x = _layerDescs[l]._width;
+		constants._layerSize._y = _layerDescs[l]._height;
+
+		constants._layerSizeMinusOne._x = _layerDescs[l]._width - 1;
+		constants._layerSizeMinusOne._y = _layerDescs[l]._height - 1;
+
+		constants._layerSizeMinusOneInv._x = 1.0f / (_layerDescs[l]._width - 1);
+		constants._layerSizeMinusOneInv._y = 1.0f / (_layerDescs[l]._height - 1);
+
+		constants._inputSize._x = prevWidth;
+		constants._inputSize._y = prevHeight;
+
+		constants._inputSizeMinusOne._x = prevWidth - 1;
+		constants._inputSizeMinusOne._y = prevHeight - 1;
+
+		constants._inputSizeMinusOneInv._x = 1.0f / (prevWidth - 1);
+		constants._inputSizeMinusOneInv._y = 1.0f / (prevHeight - 1);
+
+		if (l == _layers.size() - 1) {
+			constants._nextSize._x = constants._nextSize._y = 1;
+			constants._nextSizeMinusOne._x = constants._nextSizeMinusOne._y = 0;
+		}
+		else {
+			constants._nextSize._x = _layerDescs[l + 1]._width;
+			constants._nextSize._y = _layerDescs[l + 1]._height;
+			constants._nextSizeMinusOne._x = _layerDescs[l + 1]._width - 1;
+			constants._nextSizeMinusOne._y = _layerDescs[l + 1]._height - 1;
+		}
+
+		constants._localActivity = std::round(_layerDescs[l]._sparsity * std::pow(2 * _layerDescs[l]._inhibitionRadius + 1, 2));
+
+		constants._haloTileSize = _layers[l]._fusedTileSize + 2 * _layerDescs[l]._inhibitionRadius;
+
+		constants._inputPatchSize = patchSize(constants._haloTileSize, constants._layerSize, constants._inputSize, _layerDescs[l]._receptiveFieldRadius);
+		constants._statesPatchSize._x = constants._statesPatchSize._y = constants._haloTileSize + 2 * _layerDescs[l]._lateralConnectionRadius;
+		constants._nextPatchSize = patchSize(constants._haloTileSize, constants._layerSize, constants._nextSize, _layerDescs[l]._feedBackConnectionRadius);
+		constants._hiddenPatchSize = patchSize(_layers[l]._reconstructTileSize, constants._inputSize, constants._layerSize, _layerDescs[l]._reconstructionRadius);
+
+		prevWidth = _layerDescs[l]._width;
+		prevHeight = _layerDescs[l]._height;
+	}
+
+	return true;
+}
+
+void HTFEFrozen::activate(sys::ComputeSystem &cs) {
+	{
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = _inputWidth;
+		region[1] = _inputHeight;
+		region[2] = 1;
+
+		cs.getQueue().enqueueWriteImage(_inputImage, CL_TRUE, origin, region, 0, 0, _input.data());
+	}
+
+	// ------------------------------------------------------------------------------
+	// ------------------------------------ Go up -----------------------------------
+	// ------------------------------------------------------------------------------
+
+	cl::Image2D* pPrevLayer = &_inputImage;
+
+	for (int l = 0; l < _layers.size(); l++) {
+		const LayerConstants &constants = _constants[l];
+
+		int index = 0;
+
+		if (_layers[l]._fusedTileSize > 0) {
+			int tileSize = _layers[l]._fusedTileSize;
+
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, *pPrevLayer);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layers[l]._feedForwardWeights);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layers[l]._lateralWeights);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layers[l]._hiddenBiases);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedForward);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, cl::Local(constants._haloTileSize * constants._haloTileSize * sizeof(float)));
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, cl::Local(patchArea(constants._inputPatchSize) * sizeof(float)));
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, cl::Local(patchArea(constants._statesPatchSize) * sizeof(float)));
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, cl::Local(patchArea(constants._statesPatchSize) * sizeof(int)));
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, constants._inputPatchSize);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, constants._statesPatchSize);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, constants._layerSize);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, constants._layerSizeMinusOneInv);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, constants._inputSize);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, constants._inputSizeMinusOne);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, constants._localActivity);
+			_layerHiddenFeedForwardActivateInhibitKernel.setArg(index++, _layers[l]._weightScales);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedForwardActivateInhibitKernel, cl::NullRange,
+				cl::NDRange(roundUp(_layerDescs[l]._width, tileSize), roundUp(_layerDescs[l]._height, tileSize)), cl::NDRange(tileSize, tileSize));
+		}
+		else {
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, *pPrevLayer);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._feedForwardWeights);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._lateralWeights);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenBiases);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, constants._layerSize);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, constants._layerSizeMinusOneInv);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, constants._inputSize);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, constants._inputSizeMinusOne);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layerDescs[l]._receptiveFieldRadius);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layerDescs[l]._lateralConnectionRadius);
+			_layerHiddenFeedForwardActivateKernel.setArg(index++, _layers[l]._weightScales);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedForwardActivateKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
+
+			index = 0;
+
+			// The states prev argument is not read by the kernel
+			_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+			_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
+			_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedForward);
+			_layerHiddenInhibitKernel.setArg(index++, constants._layerSize);
+			_layerHiddenInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+			_layerHiddenInhibitKernel.setArg(index++, constants._localActivity);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerHiddenInhibitKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
+		}
+
+		pPrevLayer = &_layers[l]._hiddenStatesFeedForward;
+	}
+
+	// ------------------------------------------------------------------------------
+	// -------------------------------- Go back down --------------------------------
+	// ------------------------------------------------------------------------------
+
+	for (int l = _layers.size() - 1; l >= 0; l--) {
+		const LayerConstants &constants = _constants[l];
+
+		int index = 0;
+
+		if (l == _layers.size() - 1) {
+			cl::size_t<3> origin;
+			origin[0] = 0;
+			origin[1] = 0;
+			origin[2] = 0;
+
+			cl::size_t<3> region;
+			region[0] = _layerDescs[l]._width;
+			region[1] = _layerDescs[l]._height;
+			region[2] = 1;
+
+			// Feed back activations alias the feed forward ones, only the states need a copy since they rotate
+			cs.getQueue().enqueueCopyImage(_layers[l]._hiddenStatesFeedForward, _layers[l]._hiddenStatesFeedBack, origin, origin, region);
+		}
+		else if (_layers[l]._fusedTileSize > 0) {
+			int tileSize = _layers[l]._fusedTileSize;
+
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layers[l + 1]._hiddenFeedBackActivations);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layers[l]._feedBackWeights);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, cl::Local(constants._haloTileSize * constants._haloTileSize * sizeof(float)));
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, cl::Local(patchArea(constants._nextPatchSize) * sizeof(float)));
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, constants._nextPatchSize);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, constants._layerSize);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, constants._layerSizeMinusOneInv);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, constants._nextSize);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, constants._nextSizeMinusOne);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layerDescs[l]._feedBackConnectionRadius);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, constants._localActivity);
+			_layerHiddenFeedBackActivateInhibitKernel.setArg(index++, _layers[l]._weightScales);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedBackActivateInhibitKernel, cl::NullRange,
+				cl::NDRange(roundUp(_layerDescs[l]._width, tileSize), roundUp(_layerDescs[l]._height, tileSize)), cl::NDRange(tileSize, tileSize));
+		}
+		else {
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._hiddenFeedForwardActivations);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l + 1]._hiddenFeedBackActivations);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._feedBackWeights);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, constants._layerSize);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, constants._layerSizeMinusOneInv);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, constants._nextSize);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, constants._nextSizeMinusOne);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layerDescs[l]._feedBackConnectionRadius);
+			_layerHiddenFeedBackActivateKernel.setArg(index++, _layers[l]._weightScales);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerHiddenFeedBackActivateKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
+
+			index = 0;
+
+			_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenFeedBackActivations);
+			_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBackPrev);
+			_layerHiddenInhibitKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
+			_layerHiddenInhibitKernel.setArg(index++, constants._layerSize);
+			_layerHiddenInhibitKernel.setArg(index++, _layerDescs[l]._inhibitionRadius);
+			_layerHiddenInhibitKernel.setArg(index++, constants._localActivity);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerHiddenInhibitKernel, cl::NullRange, cl::NDRange(_layerDescs[l]._width, _layerDescs[l]._height));
+		}
+
+		// --------------------- Make Predictions (Reconstruction) ---------------------
+
+		index = 0;
+
+		if (_layers[l]._reconstructTileSize > 0) {
+			int tileSize = _layers[l]._reconstructTileSize;
+
+			_layerVisibleReconstructTiledKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
+			_layerVisibleReconstructTiledKernel.setArg(index++, _layers[l]._reconstructionWeights);
+			_layerVisibleReconstructTiledKernel.setArg(index++, _layers[l]._visibleBiases);
+			_layerVisibleReconstructTiledKernel.setArg(index++, _layers[l]._visibleReconstruction);
+			_layerVisibleReconstructTiledKernel.setArg(index++, cl::Local(patchArea(constants._hiddenPatchSize) * sizeof(float)));
+			_layerVisibleReconstructTiledKernel.setArg(index++, cl::Local(patchArea(constants._hiddenPatchSize) * sizeof(int)));
+			_layerVisibleReconstructTiledKernel.setArg(index++, constants._hiddenPatchSize);
+			_layerVisibleReconstructTiledKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
+			_layerVisibleReconstructTiledKernel.setArg(index++, constants._inputSizeMinusOne);
+			_layerVisibleReconstructTiledKernel.setArg(index++, constants._inputSizeMinusOneInv);
+			_layerVisibleReconstructTiledKernel.setArg(index++, constants._layerSize);
+			_layerVisibleReconstructTiledKernel.setArg(index++, constants._layerSizeMinusOne);
+			_layerVisibleReconstructTiledKernel.setArg(index++, constants._layerSizeMinusOneInv);
+			_layerVisibleReconstructTiledKernel.setArg(index++, _layers[l]._weightScales);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerVisibleReconstructTiledKernel, cl::NullRange,
+				cl::NDRange(roundUp(constants._inputSize._x, tileSize), roundUp(constants._inputSize._y, tileSize)), cl::NDRange(tileSize, tileSize));
+		}
+		else {
+			_layerVisibleReconstructKernel.setArg(index++, _layers[l]._hiddenStatesFeedBack);
+			_layerVisibleReconstructKernel.setArg(index++, _layers[l]._reconstructionWeights);
+			_layerVisibleReconstructKernel.setArg(index++, _layers[l]._visibleBiases);
+			_layerVisibleReconstructKernel.setArg(index++, _layers[l]._visibleReconstruction);
+			_layerVisibleReconstructKernel.setArg(index++, _layerDescs[l]._reconstructionRadius);
+			_layerVisibleReconstructKernel.setArg(index++, constants._inputSizeMinusOne);
+			_layerVisibleReconstructKernel.setArg(index++, constants._inputSizeMinusOneInv);
+			_layerVisibleReconstructKernel.setArg(index++, constants._layerSize);
+			_layerVisibleReconstructKernel.setArg(index++, constants._layerSizeMinusOne);
+			_layerVisibleReconstructKernel.setArg(index++, constants._layerSizeMinusOneInv);
+			_layerVisibleReconstructKernel.setArg(index++, _layers[l]._weightScales);
+
+			cs.getQueue().enqueueNDRangeKernel(_layerVisibleReconstructKernel, cl::NullRange, cl::NDRange(constants._inputSize._x, constants._inputSize._y));
+		}
+	}
+
+	{
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = _inputWidth;
+		region[1] = _inputHeight;
+		region[2] = 1;
+
+		cs.getQueue().enqueueReadImage(_layers.front()._visibleReconstruction, CL_TRUE, origin, region, 0, 0, _prediction.data());
+	}
+}
+
+void HTFEFrozen::stepEnd() {
+	for (int l = 0; l < _layers.size(); l++)
+		std::swap(_layers[l]._hiddenStatesFeedBack, _layers[l]._hiddenStatesFeedBackPrev);
+}
+
+void HTFEFrozen::clearMemory(sys::ComputeSystem &cs) {
+	cl_uint4 clear = { 0, 0, 0, 0 };
+
+	for (int l = 0; l < _layers.size(); l++) {
+		cl::size_t<3> origin;
+		origin[0] = 0;
+		origin[1] = 0;
+		origin[2] = 0;
+
+		cl::size_t<3> region;
+		region[0] = _layerDescs[l]._width;
+		region[1] = _layerDescs[l]._height;
+		region[2] = 1;
+
+		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedBack, clear, origin, region);
+		cs.getQueue().enqueueFillImage(_layers[l]._hiddenStatesFeedBackPrev, clear, origin, region);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "HTFE.h"
+#include "KernelTypes.h"
+
+namespace htfe {
+	// Only what activate reads. Weights are shared with the source HTFE unless they were converted to another weight type
+	struct LayerFrozen {
+		cl::Image2D _hiddenFeedForwardActivations;
+		cl::Image2D _hiddenFeedBackActivations;
+
+		cl::Image2D _hiddenStatesFeedForward;
+
+		cl::Image2D _hiddenStatesFeedBack;
+		cl::Image2D _hiddenStatesFeedBackPrev;
+
+		cl::Image2D _visibleReconstruction;
+
+		cl::Buffer _feedForwardWeights;
+		cl::Buffer _reconstructionWeights;
+		cl::Buffer _visibleBiases;
+		cl::Buffer _hiddenBiases;
+		cl::Buffer _lateralWeights;
+		cl::Buffer _feedBackWeights;
+
+		// Feed forward, lateral, feed back and reconstruction weight scales, 1 unless the weights are int8
+		Float4 _weightScales;
+
+		int _fusedTileSize;
+		int _reconstructTileSize;
+	};
+
+	// Inference only copy of a trained HTFE. It allocates only the state activate needs, stepEnd rotates a single image per layer
+	// and all per layer kernel constants are computed once in create. Weights of the same type are not copied, so learning on the source is visible here
+	class HTFEFrozen {
+	private:
+		// Kernel arguments that only depend on the layer descs
+		struct LayerConstants {
+			Int2 _layerSize;
+			Int2 _layerSizeMinusOne;
+			Float2 _layerSizeMinusOneInv;
+
+			Int2 _inputSize;
+			Int2 _inputSizeMinusOne;
+			Float2 _inputSizeMinusOneInv;
+
+			Int2 _nextSize;
+			Int2 _nextSizeMinusOne;
+
+			float _localActivity;
+
+			int _haloTileSize;
+
+			Int2 _inputPatchSize;
+			Int2 _statesPatchSize;
+			Int2 _nextPatchSize;
+			Int2 _hiddenPatchSize;
+		};
+
+		int _inputWidth, _inputHeight;
+
+		WeightType _weightType;
+
+		std::vector<LayerDesc> _layerDescs;
+		std::vector<LayerFrozen> _layers;
+		std::vector<LayerConstants> _constants;
+
+		cl::Kernel _layerHiddenFeedForwardActivateKernel;
+		cl::Kernel _layerHiddenFeedBackActivateKernel;
+		cl::Kernel _layerHiddenInhibitKernel;
+		cl::Kernel _layerHiddenFeedForwardActivateInhibitKernel;
+		cl::Kernel _layerHiddenFeedBackActivateInhibitKernel;
+		cl::Kernel _layerVisibleReconstructKernel;
+		cl::Kernel _layerVisibleReconstructTiledKernel;
+
+		std::vector<float> _input;
+		std::vector<float> _prediction;
+
+		cl::Image2D _inputImage;
+
+	public:
+		HTFEFrozen()
+			: _inputWidth(0), _inputHeight(0), _weightType(_float32)
+		{}
+
+		// Shares the weights of source and copies its recurrent state, so it continues where the source was after its last stepEnd.
+		// If program is built for another weight type, float32 source weights are converted once instead (fp16, or int8 with a scale per weight tensor)
+		bool create(sys::ComputeSystem &cs, sys::ComputeProgram &program, const HTFE &source);
+
+		void activate(sys::ComputeSystem &cs);
+		void stepEnd();
+
+		int getInputWidth() const {
+			return _inputWidth;
+		}
+
+		int getInputHeight() const {
+			return _inputHeight;
+		}
+
+		WeightType getWeightType() const {
+			return _weightType;
+		}
+
+		const std::vector<LayerDesc> &getLayerDescs() const {
+			return _layerDescs;
+		}
+
+		const std::vector<LayerFrozen> &getLayers() const {
+			return _layers;
+		}
+
+		void setInput(int i, float value) {
+			_input[i] = value;
+		}
+
+		void setInput(int x, int y, float value) {
+			setInput(x + y * _inputWidth, value);
+		}
+
+		float getPrediction(int i) const {
+			return _prediction[i];
+		}
+
+		float getPrediction(int x, int y) const {
+			return getPrediction(x + y * _inputWidth);
+		}
+
+		// Contiguous input and prediction of getInputSize() values, for bulk access such as the Python buffer bindings
+		float* getInputData() {
+			return _input.data();
+		}
+
+		const float* getPredictionData() const {
+			return _prediction.data();
+		}
+
+		int getInputSize() const {
+			return _inputWidth * _inputHeight;
+		}
+
+		void clearMemory(sys::ComputeSystem &cs);
+	};
+}
\ No newline at end of file
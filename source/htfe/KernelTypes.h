@@ -0,0 +1,20 @@
+#pragma once
+
+// Host side layouts of the OpenCL vector types passed as kernel arguments
+namespace htfe {
+	struct Uint2 {
+		unsigned int _x, _y;
+	};
+
+	struct Float2 {
+		float _x, _y;
+	};
+
+	struct Float4 {
+		float _x, _y, _z, _w;
+	};
+
+	struct Int2 {
+		int _x, _y;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+namespace htfe {
+	struct LayerDesc {
+		int _width, _height;
+
+		int _receptiveFieldRadius;
+		int _reconstructionRadius;
+		int _lateralConnectionRadius;
+		int _inhibitionRadius;
+		int _feedBackConnectionRadius;
+
+		float _sparsity;
+
+		float _dutyCycleDecay;
+		float _feedForwardAlpha;
+		float _lateralAlpha;
+		float _feedBackAlpha;
+		float _hiddenBiasAlpha;
+		float _reconstructionAlpha;
+		float _gamma;
+		float _lateralScalar;
+		float _feedBackScalar;
+		float _weightDecay;
+
+		LayerDesc()
+			: _width(16), _height(16), _receptiveFieldRadius(5), _reconstructionRadius(8), _lateralConnectionRadius(7), _inhibitionRadius(4), _feedBackConnectionRadius(6),
+			_sparsity(1.01f / 81.0f), _dutyCycleDecay(0.01f),
+			_feedForwardAlpha(0.05f), _lateralAlpha(0.05f), _feedBackAlpha(0.05f), _hiddenBiasAlpha(0.05f), _reconstructionAlpha(0.05f),
+			_gamma(0.0f), _lateralScalar(0.1f), _feedBackScalar(0.1f), _weightDecay(0.001f)
+		{}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <CL/cl.hpp>
+
+#include <cstddef>
+
+namespace htfe {
+	// Hidden states are binary, so their images hold a byte per unit instead of a float.
+	// read_imagef of CL_UNORM_INT8 returns exactly 0.0 or 1.0 and write_imagef of 1.0 stores 255, so the kernels read and write them as before
+	inline cl::ImageFormat stateImageFormat() {
+		return cl::ImageFormat(CL_R, CL_UNORM_INT8);
+	}
+
+	// Bytes per state texel, as stored in checkpoints
+	const size_t stateTexelSize = 1;
+}
\ No newline at end of file
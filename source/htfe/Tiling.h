@@ -0,0 +1,90 @@
+#pragma once
+
+#include "KernelTypes.h"
+#include "LayerDesc.h"
+
+#include <algorithm>
+#include <cstddef>
+
+// Launch geometry of the tiled kernels in htfe.cl
+namespace htfe {
+	// Edge of the local memory window that holds the radius gathers of units consecutive units of a layer of size, projected onto a layer of targetSize
+	inline int patchExtent(int units, int size, int targetSize, int radius) {
+		float ratio = size > 1 ? static_cast<float>(targetSize - 1) / (size - 1) : 0.0f;
+
+		// Two extra texels cover the float rounding of the projection
+		return static_cast<int>((units - 1) * ratio) + 3 + 2 * radius;
+	}
+
+	inline Int2 patchSize(int units, const Int2 &size, const Int2 &targetSize, int radius) {
+		Int2 patch;
+		patch._x = patchExtent(units, size._x, targetSize._x, radius);
+		patch._y = patchExtent(units, size._y, targetSize._y, radius);
+
+		return patch;
+	}
+
+	inline size_t patchArea(const Int2 &patch) {
+		return static_cast<size_t>(patch._x) * patch._y;
+	}
+
+	inline size_t roundUp(int size, int multiple) {
+		return (size + multiple - 1) / multiple * multiple;
+	}
+
+	// Ints of the active list counts the tiled kernels keep in local memory, HTFE_MAX_GROUP_SIZE in htfe.cl
+	const size_t compactCountsSize = 256;
+
+	// Chooses the largest square work groups of the fused hidden kernels and the tiled reconstruction whose tiles and patches fit in
+	// localMemSize bytes, for the work group limits of the program the layer runs with on its device. 0 selects the per texel kernels.
+	// pNextDesc is null for the top layer
+	inline void chooseTileSizes(const LayerDesc &desc, const LayerDesc* pNextDesc, const Int2 &inputSize,
+		size_t fusedWorkGroupSize, size_t reconstructWorkGroupSize, size_t localMemSize, int &fusedTileSize, int &reconstructTileSize)
+	{
+		Int2 layerSize;
+		layerSize._x = desc._width;
+		layerSize._y = desc._height;
+
+		fusedTileSize = 0;
+
+		for (int tileSize = 16; tileSize >= 8; tileSize /= 2) {
+			int haloTileSize = tileSize + 2 * desc._inhibitionRadius;
+
+			size_t haloTileArea = haloTileSize * haloTileSize;
+
+			Int2 statesPatchSize;
+			statesPatchSize._x = statesPatchSize._y = haloTileSize + 2 * desc._lateralConnectionRadius;
+
+			// The states patch is followed by its active list, an int per texel, and the active list counts
+			size_t feedForwardLocalSize = haloTileArea + patchArea(patchSize(haloTileSize, layerSize, inputSize, desc._receptiveFieldRadius)) + 2 * patchArea(statesPatchSize) + compactCountsSize;
+			size_t feedBackLocalSize = 0;
+
+			if (pNextDesc != nullptr) {
+				Int2 nextSize;
+				nextSize._x = pNextDesc->_width;
+				nextSize._y = pNextDesc->_height;
+
+				feedBackLocalSize = haloTileArea + patchArea(patchSize(haloTileSize, layerSize, nextSize, desc._feedBackConnectionRadius));
+			}
+
+			// Halo activations are recomputed by every neighbouring group, past 4x the tile area that costs more than the saved launch
+			if (tileSize * tileSize <= fusedWorkGroupSize && std::max(feedForwardLocalSize, feedBackLocalSize) * sizeof(float) <= localMemSize && haloTileArea <= 4 * tileSize * tileSize) {
+				fusedTileSize = tileSize;
+
+				break;
+			}
+		}
+
+		reconstructTileSize = 0;
+
+		for (int tileSize = 16; tileSize >= 8; tileSize /= 2) {
+			size_t reconstructLocalSize = 2 * patchArea(patchSize(tileSize, inputSize, layerSize, desc._reconstructionRadius)) + compactCountsSize;
+
+			if (tileSize * tileSize <= reconstructWorkGroupSize && reconstructLocalSize * sizeof(float) <= localMemSize) {
+				reconstructTileSize = tileSize;
+
+				break;
+			}
+		}
+	}
+}
\ No newline at end of file
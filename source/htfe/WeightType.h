@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../system/ComputeProgram.h"
+
+#include <string>
+#include <cstddef>
+
+namespace htfe {
+	// Storage of the feed forward, lateral, feed back and reconstruction weights, selected when htfe.cl is built.
+	// _float16 can still learn, _int8 is inference only (HTFEFrozen)
+	enum WeightType {
+		_float32, _float16, _int8
+	};
+
+	// Build options of htfe.cl for a weight type
+	inline std::string weightTypeOptions(WeightType type) {
+		switch (type) {
+		case _float16:
+			return "-D HTFE_WEIGHTS_HALF";
+		case _int8:
+			return "-D HTFE_WEIGHTS_INT8";
+		default:
+			return "";
+		}
+	}
+
+	inline WeightType getWeightType(const sys::ComputeProgram &program) {
+		if (program.getOptions().find("HTFE_WEIGHTS_HALF") != std::string::npos)
+			return _float16;
+
+		if (program.getOptions().find("HTFE_WEIGHTS_INT8") != std::string::npos)
+			return _int8;
+
+		return _float32;
+	}
+
+	inline size_t weightTypeSize(WeightType type) {
+		switch (type) {
+		case _float16:
+			return 2;
+		case _int8:
+			return 1;
+		default:
+			return 4;
+		}
+	}
+}
\ No newline at end of file
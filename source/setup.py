@@ -4,6 +4,6 @@ from distutils.core import setup, Extension
 clIncludeDir = "C:/Program Files (x86)/AMD APP SDK/3.0-0-Beta/include/"
 clLibDir = "C:/Program Files (x86)/AMD APP SDK/3.0-0-Beta/lib/x86_64/"
 
-extension_mod = Extension(name="_htfe", sources=["HTFE.i", "system/ComputeSystem.cpp", "system/ComputeProgram.cpp", "htfe/HTFE.cpp"], swig_opts=["-c++"], language=["c++"], include_dirs=[clIncludeDir, "./"], library_dirs=[clLibDir], libraries=["OpenCL"])
+extension_mod = Extension(name="_htfe", sources=["HTFE.i", "system/ComputeSystem.cpp", "system/ComputeProgram.cpp", "system/MappedFile.cpp", "system/Profiler.cpp", "system/DeviceArena.cpp", "htfe/HTFE.cpp", "system/ThreadPool.cpp", "htfe/HTFECPU.cpp", "htfe/HTFEBatch.cpp", "htfe/HTFEFrozen.cpp"], swig_opts=["-c++"], language=["c++"], include_dirs=[clIncludeDir, "./"], library_dirs=[clLibDir], libraries=["OpenCL"])
 
 setup(name = "htfe", version="1.0", ext_modules=[extension_mod], package_data={"htfe": ["../resources/*.cl"]})
\ No newline at end of file
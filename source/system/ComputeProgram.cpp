@@ -1,38 +1,171 @@
-#include "ComputeProgram.h"
-
-#include <fstream>
-#include <iostream>
-
-using namespace sys;
-
-bool ComputeProgram::loadFromFile(const std::string &name, ComputeSystem &cs) {
-	std::ifstream fromFile(name);
-
-	if (!fromFile.is_open()) {
-#ifdef SYS_DEBUG
-		std::cerr << "Could not open file " << name << "!" << std::endl;
-#endif
-		return false;
-	}
-
-	std::string source = "";
-
-	while (!fromFile.eof() && fromFile.good()) {
-		std::string line; 
-
-		std::getline(fromFile, line);
-
-		source += line + "\n";
-	}
-
-	_program = cl::Program(cs.getContext(), source);
-
-	if (_program.build(std::vector<cl::Device>(1, cs.getDevice())) != CL_SUCCESS) {
-#ifdef SYS_DEBUG
-		std::cerr << "Error building: " << _program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(cs.getDevice()) << std::endl;
-#endif
-		return false;
-	}
-
-	return true;
+#include "ComputeProgram.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+using namespace sys;
+
+namespace {
+	// 64 bit FNV-1a, folds each string and a separator so ("ab", "c") and ("a", "bc") differ
+	std::uint64_t hashStrings(const std::vector<std::string> &strings) {
+		std::uint64_t hash = 14695981039346656037ull;
+
+		for (size_t i = 0; i < strings.size(); i++) {
+			for (size_t j = 0; j < strings[i].size(); j++) {
+				hash ^= static_cast<unsigned char>(strings[i][j]);
+				hash *= 1099511628211ull;
+			}
+
+			hash ^= 0xff;
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+}
+
+bool ComputeProgram::loadFromFile(const std::string &name, ComputeSystem &cs, const std::string &options, const std::string &cacheDirectory) {
+	std::ifstream fromFile(name, std::ios::binary);
+
+	if (!fromFile.is_open()) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not open file " << name << "!" << std::endl;
+#endif
+		return false;
+	}
+
+	std::ostringstream sourceStream;
+	sourceStream << fromFile.rdbuf();
+
+	_source = sourceStream.str();
+
+	return build(cs, options, cacheDirectory);
+}
+
+bool ComputeProgram::createVariant(ComputeSystem &cs, const ComputeProgram &program, const std::string &options) {
+	_source = program._source;
+
+	return build(cs, program._options + " " + options, program._cacheDirectory);
+}
+
+bool ComputeProgram::build(ComputeSystem &cs, const std::string &options, const std::string &cacheDirectory) {
+	_options = options;
+	_cacheDirectory = cacheDirectory;
+
+	std::string cacheName;
+
+	// Binaries are cached for single device contexts only
+	if (!_cacheDirectory.empty() && cs.getNumDevices() == 1) {
+		std::vector<std::string> key;
+		key.push_back(cs.getPlatform().getInfo<CL_PLATFORM_NAME>());
+		key.push_back(cs.getDevice().getInfo<CL_DEVICE_NAME>());
+		key.push_back(cs.getDevice().getInfo<CL_DEVICE_VERSION>());
+		key.push_back(cs.getDevice().getInfo<CL_DRIVER_VERSION>());
+		key.push_back(_options);
+		key.push_back(_source);
+
+		std::ostringstream cacheNameStream;
+		cacheNameStream << _cacheDirectory << "/program_" << std::hex << std::setw(16) << std::setfill('0') << hashStrings(key) << ".bin";
+
+		cacheName = cacheNameStream.str();
+
+		if (buildFromBinary(cacheName, cs))
+			return true;
+	}
+
+	_program = cl::Program(cs.getContext(), _source);
+
+	if (_program.build(cs.getDevices(), _options.c_str()) != CL_SUCCESS) {
+#ifdef SYS_DEBUG
+		std::cerr << "Error building: " << _program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(cs.getDevice()) << std::endl;
+#endif
+		return false;
+	}
+
+	if (!cacheName.empty())
+		saveBinary(cacheName);
+
+	return true;
+}
+
+bool ComputeProgram::buildFromBinary(const std::string &cacheName, ComputeSystem &cs) {
+	std::ifstream fromFile(cacheName, std::ios::binary);
+
+	if (!fromFile.is_open())
+		return false;
+
+	std::ostringstream binaryStream;
+	binaryStream << fromFile.rdbuf();
+
+	std::string binary = binaryStream.str();
+
+	if (binary.empty())
+		return false;
+
+	std::vector<cl::Device> devices(1, cs.getDevice());
+
+	cl::Program::Binaries binaries(1, std::make_pair(static_cast<const void*>(binary.data()), binary.size()));
+
+	std::vector<cl_int> binaryStatus;
+	cl_int error = CL_SUCCESS;
+
+	_program = cl::Program(cs.getContext(), devices, binaries, &binaryStatus, &error);
+
+	if (error != CL_SUCCESS || binaryStatus.empty() || binaryStatus.front() != CL_SUCCESS || _program.build(devices, _options.c_str()) != CL_SUCCESS) {
+#ifdef SYS_DEBUG
+		std::cerr << "Cached binary " << cacheName << " was rejected, building from source" << std::endl;
+#endif
+		_program = cl::Program();
+
+		return false;
+	}
+
+	return true;
+}
+
+void ComputeProgram::saveBinary(const std::string &cacheName) {
+	std::vector<size_t> binarySizes = _program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+
+	if (binarySizes.empty() || binarySizes.front() == 0)
+		return;
+
+	std::vector<char> binary(binarySizes.front());
+	std::vector<char*> binaryPointers(1, binary.data());
+
+	if (_program.getInfo(CL_PROGRAM_BINARIES, &binaryPointers) != CL_SUCCESS)
+		return;
+
+	// Written under a temporary name and renamed, so concurrently starting processes never read a partial binary
+	std::random_device device;
+
+	std::string tempName = cacheName + "." + std::to_string(device()) + ".tmp";
+
+	{
+		std::ofstream toFile(tempName, std::ios::binary);
+
+		if (!toFile.is_open()) {
+#ifdef SYS_DEBUG
+			std::cerr << "Could not write program cache " << tempName << "!" << std::endl;
+#endif
+			return;
+		}
+
+		toFile.write(binary.data(), binary.size());
+
+		if (!toFile.good()) {
+			toFile.close();
+
+			std::remove(tempName.c_str());
+
+			return;
+		}
+	}
+
+	if (std::rename(tempName.c_str(), cacheName.c_str()) != 0)
+		std::remove(tempName.c_str());
 }
\ No newline at end of file
@@ -1,19 +1,37 @@
-#pragma once
-
-#include "ComputeSystem.h"
-
-#include <assert.h>
-
-namespace sys {
-	class ComputeProgram {
-	private:
-		cl::Program _program;
-
-	public:
-		bool loadFromFile(const std::string &name, ComputeSystem &cs);
-
-		cl::Program &getProgram() {
-			return _program;
-		}
-	};
+#pragma once
+
+#include "ComputeSystem.h"
+
+#include <assert.h>
+
+namespace sys {
+	class ComputeProgram {
+	private:
+		cl::Program _program;
+
+		std::string _source;
+		std::string _options;
+		std::string _cacheDirectory;
+
+		bool build(ComputeSystem &cs, const std::string &options, const std::string &cacheDirectory);
+		bool buildFromBinary(const std::string &cacheName, ComputeSystem &cs);
+		void saveBinary(const std::string &cacheName);
+
+	public:
+		// options are passed to the OpenCL compiler, e.g. "-D HTFE_WEIGHTS_HALF".
+		// With a cacheDirectory the built binary is stored there, keyed by device, driver, options and source, and reused by later loads.
+		// A missing or rejected binary falls back to building from source
+		bool loadFromFile(const std::string &name, ComputeSystem &cs, const std::string &options = "", const std::string &cacheDirectory = "");
+
+		// Builds the source of program again with options appended to its own, cached in the same directory
+		bool createVariant(ComputeSystem &cs, const ComputeProgram &program, const std::string &options);
+
+		cl::Program &getProgram() {
+			return _program;
+		}
+
+		const std::string &getOptions() const {
+			return _options;
+		}
+	};
 }
\ No newline at end of file
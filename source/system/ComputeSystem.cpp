@@ -1,94 +1,183 @@
-#include "ComputeSystem.h"
-
-#include <iostream>
-
-using namespace sys;
-
-bool ComputeSystem::create(DeviceType type, bool createFromGLContext) {
-	if (type == _none) {
-#ifdef SYS_DEBUG
-		std::cout << "No OpenCL context created." << std::endl;
-#endif
-		return true;
-	}
-
-	std::vector<cl::Platform> allPlatforms;
-	cl::Platform::get(&allPlatforms);
-
-	if (allPlatforms.empty()) {
-#ifdef SYS_DEBUG
-		std::cout << "No platforms found. Check your OpenCL installation." << std::endl;
-#endif
-		return false;
-	}
-
-	_platform = allPlatforms.front();
-
-#ifdef SYS_DEBUG
-	std::cout << "Using platform: " << _platform.getInfo<CL_PLATFORM_NAME>() << std::endl;
-#endif
-
-	std::vector<cl::Device> allDevices;
-
-	switch (type) {
-	case _cpu:
-		_platform.getDevices(CL_DEVICE_TYPE_CPU, &allDevices);
-		break;
-	case _gpu:
-		_platform.getDevices(CL_DEVICE_TYPE_GPU, &allDevices);
-		break;
-	case _all:
-		_platform.getDevices(CL_DEVICE_TYPE_ALL, &allDevices);
-		break;
-	}
-
-	if (allDevices.empty()) {
-#ifdef SYS_DEBUG
-		std::cout << "No devices found. Check your OpenCL installation." << std::endl;
-#endif
-		return false;
-	}
-
-	_device = allDevices.front();
-
-#ifdef SYS_DEBUG
-	std::cout << "Using device: " << _device.getInfo<CL_DEVICE_NAME>() << std::endl;
-#endif
-	
-#if(SYS_ALLOW_CL_GL_CONTEXT)
-	if (createFromGLContext) {
-#if defined (__APPLE__) || defined(MACOSX)
-		CGLContextObj kCGLContext = CGLGetCurrentContext();
-		CGLShareGroupObj kCGLShareGroup = CGLGetShareGroup(kCGLContext);
-		cl_context_properties props[] = {
-			CL_CONTEXT_PROPERTY_USE_CGL_SHAREGROUP_APPLE, (cl_context_properties)kCGLShareGroup,
-			0
-		};
-#else
-#if defined WIN32
-		cl_context_properties props[] = {
-			CL_GL_CONTEXT_KHR, (cl_context_properties)wglGetCurrentContext(),
-			CL_WGL_HDC_KHR, (cl_context_properties)wglGetCurrentDC(),
-			CL_CONTEXT_PLATFORM, (cl_context_properties)static_cast<cl_platform_id>(_platform()),
-			0
-		};
-#else
-		cl_context_properties props[] = {
-			CL_GL_CONTEXT_KHR, (cl_context_properties)glXGetCurrentContext(),
-			CL_GLX_DISPLAY_KHR, (cl_context_properties)glXGetCurrentDisplay(),
-			CL_CONTEXT_PLATFORM, (cl_context_properties)static_cast<cl_platform_id>(_platform()),
-			0
-		};
-#endif
-#endif
-
-		_context = cl::Context(_device, props);
-	}
-	else
-#endif
-		_context = _device;
-
-	_queue = cl::CommandQueue(_context, _device);
-
-	return true;
+#include "ComputeSystem.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace sys;
+
+bool ComputeSystem::create(DeviceType type, bool createFromGLContext) {
+	if (type == _none) {
+#ifdef SYS_DEBUG
+		std::cout << "No OpenCL context created." << std::endl;
+#endif
+		return true;
+	}
+
+	std::vector<cl::Device> allDevices;
+
+	if (!findDevices(type, allDevices))
+		return false;
+
+	_device = allDevices.front();
+
+#ifdef SYS_DEBUG
+	std::cout << "Using device: " << _device.getInfo<CL_DEVICE_NAME>() << std::endl;
+#endif
+	
+#if(SYS_ALLOW_CL_GL_CONTEXT)
+	if (createFromGLContext) {
+#if defined (__APPLE__) || defined(MACOSX)
+		CGLContextObj kCGLContext = CGLGetCurrentContext();
+		CGLShareGroupObj kCGLShareGroup = CGLGetShareGroup(kCGLContext);
+		cl_context_properties props[] = {
+			CL_CONTEXT_PROPERTY_USE_CGL_SHAREGROUP_APPLE, (cl_context_properties)kCGLShareGroup,
+			0
+		};
+#else
+#if defined WIN32
+		cl_context_properties props[] = {
+			CL_GL_CONTEXT_KHR, (cl_context_properties)wglGetCurrentContext(),
+			CL_WGL_HDC_KHR, (cl_context_properties)wglGetCurrentDC(),
+			CL_CONTEXT_PLATFORM, (cl_context_properties)static_cast<cl_platform_id>(_platform()),
+			0
+		};
+#else
+		cl_context_properties props[] = {
+			CL_GL_CONTEXT_KHR, (cl_context_properties)glXGetCurrentContext(),
+			CL_GLX_DISPLAY_KHR, (cl_context_properties)glXGetCurrentDisplay(),
+			CL_CONTEXT_PLATFORM, (cl_context_properties)static_cast<cl_platform_id>(_platform()),
+			0
+		};
+#endif
+#endif
+
+		_context = cl::Context(_device, props);
+	}
+	else
+#endif
+		_context = _device;
+
+	createQueues(std::vector<cl::Device>(1, _device));
+
+	return true;
+}
+
+bool ComputeSystem::createMultiDevice(DeviceType type, int maxDevices) {
+	std::vector<cl::Device> allDevices;
+
+	if (type == _none || !findDevices(type, allDevices))
+		return false;
+
+	if (allDevices.size() > maxDevices)
+		allDevices.resize(maxDevices);
+
+#ifdef SYS_DEBUG
+	for (int i = 0; i < allDevices.size(); i++)
+		std::cout << "Using device " << i << ": " << allDevices[i].getInfo<CL_DEVICE_NAME>() << std::endl;
+#endif
+
+	_context = cl::Context(allDevices);
+
+	createQueues(allDevices);
+
+	return true;
+}
+
+bool ComputeSystem::createSubDevices(DeviceType type, int numSubDevices) {
+	std::vector<cl::Device> allDevices;
+
+	if (type == _none || !findDevices(type, allDevices))
+		return false;
+
+	cl_uint computeUnits = allDevices.front().getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+
+	cl_device_partition_property properties[] = {
+		CL_DEVICE_PARTITION_EQUALLY, static_cast<cl_device_partition_property>(std::max<cl_uint>(1, computeUnits / numSubDevices)),
+		0
+	};
+
+	std::vector<cl::Device> subDevices;
+
+	if (allDevices.front().createSubDevices(properties, &subDevices) != CL_SUCCESS || subDevices.empty()) {
+#ifdef SYS_DEBUG
+		std::cout << "Could not create sub devices of " << allDevices.front().getInfo<CL_DEVICE_NAME>() << std::endl;
+#endif
+		return false;
+	}
+
+	if (subDevices.size() > numSubDevices)
+		subDevices.resize(numSubDevices);
+
+#ifdef SYS_DEBUG
+	std::cout << "Using " << subDevices.size() << " sub devices of " << allDevices.front().getInfo<CL_DEVICE_NAME>() << std::endl;
+#endif
+
+	_context = cl::Context(subDevices);
+
+	createQueues(subDevices);
+
+	return true;
+}
+
+void ComputeSystem::finish() {
+	for (int i = 0; i < _queues.size(); i++)
+		_queues[i].finish();
+}
+
+bool ComputeSystem::findDevices(DeviceType type, std::vector<cl::Device> &devices) {
+	std::vector<cl::Platform> allPlatforms;
+	cl::Platform::get(&allPlatforms);
+
+	if (allPlatforms.empty()) {
+#ifdef SYS_DEBUG
+		std::cout << "No platforms found. Check your OpenCL installation." << std::endl;
+#endif
+		return false;
+	}
+
+	cl_device_type deviceType = CL_DEVICE_TYPE_ALL;
+
+	switch (type) {
+	case _cpu:
+		deviceType = CL_DEVICE_TYPE_CPU;
+		break;
+	case _gpu:
+		deviceType = CL_DEVICE_TYPE_GPU;
+		break;
+	case _all:
+	default:
+		break;
+	}
+
+	for (int p = 0; p < allPlatforms.size(); p++) {
+		devices.clear();
+
+		allPlatforms[p].getDevices(deviceType, &devices);
+
+		if (!devices.empty()) {
+			_platform = allPlatforms[p];
+
+#ifdef SYS_DEBUG
+			std::cout << "Using platform: " << _platform.getInfo<CL_PLATFORM_NAME>() << std::endl;
+#endif
+			return true;
+		}
+	}
+
+#ifdef SYS_DEBUG
+	std::cout << "No devices found. Check your OpenCL installation." << std::endl;
+#endif
+
+	return false;
+}
+
+void ComputeSystem::createQueues(const std::vector<cl::Device> &devices) {
+	_devices = devices;
+	_queues.clear();
+
+	for (int i = 0; i < _devices.size(); i++)
+		_queues.push_back(cl::CommandQueue(_context, _devices[i], _profiling ? CL_QUEUE_PROFILING_ENABLE : 0));
+
+	_device = _devices.front();
+	_queue = _queues.front();
 }
\ No newline at end of file
@@ -1,40 +1,92 @@
-#pragma once
-
-#include "Uncopyable.h"
-
-#include <CL/cl.hpp>
-
-#define SYS_ALLOW_CL_GL_CONTEXT 0
-
-namespace sys {
-	enum DeviceType {
-		_cpu, _gpu, _all, _none
-	};
-
-	class ComputeSystem {
-	private:
-		cl::Platform _platform;
-		cl::Device _device;
-		cl::Context _context;
-		cl::CommandQueue _queue;
-
-	public:
-		bool create(DeviceType type, bool createFromGLContext = false);
-
-		cl::Platform &getPlatform() {
-			return _platform;
-		}
-
-		cl::Device &getDevice() {
-			return _device;
-		}
-
-		cl::Context &getContext() {
-			return _context;
-		}
-
-		cl::CommandQueue &getQueue() {
-			return _queue;
-		}
-	};
+#pragma once
+
+#include "Uncopyable.h"
+
+#include <CL/cl.hpp>
+
+#include <vector>
+
+#define SYS_ALLOW_CL_GL_CONTEXT 0
+
+namespace sys {
+	enum DeviceType {
+		_cpu, _gpu, _all, _none
+	};
+
+	class ComputeSystem {
+	private:
+		cl::Platform _platform;
+		cl::Device _device;
+		cl::Context _context;
+		cl::CommandQueue _queue;
+
+		// Every device of the context with an in order queue each, element 0 is _device and _queue
+		std::vector<cl::Device> _devices;
+		std::vector<cl::CommandQueue> _queues;
+
+		bool _profiling;
+
+		// Selects the first platform with devices of type
+		bool findDevices(DeviceType type, std::vector<cl::Device> &devices);
+
+		void createQueues(const std::vector<cl::Device> &devices);
+
+	public:
+		ComputeSystem()
+			: _profiling(false)
+		{}
+
+		// Creates the queues with CL_QUEUE_PROFILING_ENABLE, needed by a Profiler. Applies to the next create
+		void setProfiling(bool profiling) {
+			_profiling = profiling;
+		}
+
+		bool getProfiling() const {
+			return _profiling;
+		}
+
+		bool create(DeviceType type, bool createFromGLContext = false);
+
+		// Up to maxDevices devices of type in one context, so memory objects can be used by all of them
+		bool createMultiDevice(DeviceType type, int maxDevices);
+
+		// Splits the first device of type into numSubDevices equal sub devices with clCreateSubDevices, one queue each.
+		// Multi device code can then run on a single CPU
+		bool createSubDevices(DeviceType type, int numSubDevices);
+
+		// Waits for all queues
+		void finish();
+
+		cl::Platform &getPlatform() {
+			return _platform;
+		}
+
+		cl::Device &getDevice() {
+			return _device;
+		}
+
+		cl::Device &getDevice(int index) {
+			return _devices[index];
+		}
+
+		const std::vector<cl::Device> &getDevices() const {
+			return _devices;
+		}
+
+		int getNumDevices() const {
+			return _devices.size();
+		}
+
+		cl::Context &getContext() {
+			return _context;
+		}
+
+		cl::CommandQueue &getQueue() {
+			return _queue;
+		}
+
+		cl::CommandQueue &getQueue(int index) {
+			return _queues[index];
+		}
+	};
 }
\ No newline at end of file
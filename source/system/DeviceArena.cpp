@@ -0,0 +1,62 @@
+#include "DeviceArena.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace sys;
+
+const size_t DeviceArena::defaultAlignment;
+
+size_t DeviceArena::getDeviceAlignment(const cl::Device &device) {
+	// Reported in bits
+	cl_uint baseAddressAlignBits = device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>();
+
+	return std::max(static_cast<size_t>(baseAddressAlignBits / 8), defaultAlignment);
+}
+
+void DeviceArena::reset(size_t alignment) {
+	_buffer = cl::Buffer();
+
+	_size = 0;
+	_alignment = alignment;
+}
+
+ArenaRange DeviceArena::reserve(size_t size) {
+	ArenaRange range;
+	range._offset = (_size + _alignment - 1) / _alignment * _alignment;
+	range._size = size;
+
+	_size = range._offset + size;
+
+	return range;
+}
+
+bool DeviceArena::allocate(ComputeSystem &cs) {
+	_buffer = cl::Buffer();
+
+	if (_size == 0)
+		return true;
+
+	cl_int error = CL_SUCCESS;
+
+	_buffer = cl::Buffer(cs.getContext(), CL_MEM_READ_WRITE, _size, nullptr, &error);
+
+	if (error != CL_SUCCESS) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not allocate an arena of " << _size << " bytes!" << std::endl;
+#endif
+		_buffer = cl::Buffer();
+
+		return false;
+	}
+
+	return true;
+}
+
+cl::Buffer DeviceArena::createView(const ArenaRange &range, cl_mem_flags flags) {
+	cl_buffer_region region;
+	region.origin = range._offset;
+	region.size = range._size;
+
+	return _buffer.createSubBuffer(flags, CL_BUFFER_CREATE_TYPE_REGION, &region);
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ComputeSystem.h"
+
+#include <CL/cl.hpp>
+
+namespace sys {
+	// Place of a suballocation in a DeviceArena
+	struct ArenaRange {
+		size_t _offset;
+		size_t _size;
+	};
+
+	// One device buffer holding many smaller ones as sub-buffers.
+	// Reserve every range first, then allocate once and create the views of the ranges
+	class DeviceArena {
+	private:
+		cl::Buffer _buffer;
+
+		size_t _size;
+		size_t _alignment;
+
+	public:
+		DeviceArena()
+			: _size(0), _alignment(defaultAlignment)
+		{}
+
+		// Coalescing alignment used when no device is known
+		static const size_t defaultAlignment = 256;
+
+		// Offset alignment that both sub-buffers of device and coalesced access accept
+		static size_t getDeviceAlignment(const cl::Device &device);
+
+		// Drops the buffer and all ranges
+		void reset(size_t alignment = defaultAlignment);
+
+		ArenaRange reserve(size_t size);
+
+		// Creates the buffer of all reserved ranges, nothing is allocated for an empty arena
+		bool allocate(ComputeSystem &cs);
+
+		// Sub-buffer of a reserved range, valid after allocate
+		cl::Buffer createView(const ArenaRange &range, cl_mem_flags flags = CL_MEM_READ_WRITE);
+
+		cl::Buffer &getBuffer() {
+			return _buffer;
+		}
+
+		const cl::Buffer &getBuffer() const {
+			return _buffer;
+		}
+
+		// Bytes reserved so far, including alignment padding
+		size_t getSize() const {
+			return _size;
+		}
+
+		size_t getAlignment() const {
+			return _alignment;
+		}
+	};
+}
\ No newline at end of file
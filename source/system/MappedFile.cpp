@@ -0,0 +1,111 @@
+#include "MappedFile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace sys;
+
+MappedFile::MappedFile()
+	: _pData(nullptr), _size(0),
+#ifdef _WIN32
+	_fileHandle(INVALID_HANDLE_VALUE), _mappingHandle(nullptr)
+#else
+	_fileDescriptor(-1)
+#endif
+{}
+
+bool MappedFile::open(const std::string &name) {
+	close();
+
+#ifdef _WIN32
+	_fileHandle = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	LARGE_INTEGER size;
+
+	if (_fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(_fileHandle, &size) || size.QuadPart == 0) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not open file " << name << "!" << std::endl;
+#endif
+		close();
+
+		return false;
+	}
+
+	_size = static_cast<size_t>(size.QuadPart);
+
+	_mappingHandle = CreateFileMappingA(_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (_mappingHandle != nullptr)
+		_pData = static_cast<const char*>(MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+	_fileDescriptor = ::open(name.c_str(), O_RDONLY);
+
+	struct stat info;
+
+	if (_fileDescriptor == -1 || fstat(_fileDescriptor, &info) != 0 || info.st_size == 0) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not open file " << name << "!" << std::endl;
+#endif
+		close();
+
+		return false;
+	}
+
+	_size = static_cast<size_t>(info.st_size);
+
+	void* pMapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fileDescriptor, 0);
+
+	if (pMapping != MAP_FAILED) {
+		_pData = static_cast<const char*>(pMapping);
+
+		madvise(pMapping, _size, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (_pData == nullptr) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not map file " << name << "!" << std::endl;
+#endif
+		close();
+
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (_pData != nullptr)
+		UnmapViewOfFile(_pData);
+
+	if (_mappingHandle != nullptr)
+		CloseHandle(_mappingHandle);
+
+	if (_fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(_fileHandle);
+
+	_mappingHandle = nullptr;
+	_fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (_pData != nullptr)
+		munmap(const_cast<char*>(_pData), _size);
+
+	if (_fileDescriptor != -1)
+		::close(_fileDescriptor);
+
+	_fileDescriptor = -1;
+#endif
+
+	_pData = nullptr;
+	_size = 0;
+}
\ No newline at end of file
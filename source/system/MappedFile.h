@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Uncopyable.h"
+
+#include <string>
+
+namespace sys {
+	// Read only memory mapping of a whole file
+	class MappedFile : public Uncopyable {
+	private:
+		const char* _pData;
+		size_t _size;
+
+#ifdef _WIN32
+		void* _fileHandle;
+		void* _mappingHandle;
+#else
+		int _fileDescriptor;
+#endif
+
+	public:
+		MappedFile();
+
+		~MappedFile() {
+			close();
+		}
+
+		bool open(const std::string &name);
+		void close();
+
+		const char* getData() const {
+			return _pData;
+		}
+
+		size_t getSize() const {
+			return _size;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+
+using namespace sys;
+
+cl::Event* Profiler::event(const std::string &phase, int layer, int device) {
+	Pending pending;
+	pending._phase = phase;
+	pending._layer = layer;
+	pending._device = device;
+
+	_pending.push_back(pending);
+
+	return &_pending.back()._event;
+}
+
+void Profiler::record(const cl::Event &event, const std::string &phase, int layer, int device) {
+	*this->event(phase, layer, device) = event;
+}
+
+void Profiler::collect() {
+	for (std::deque<Pending>::iterator it = _pending.begin(); it != _pending.end(); it++) {
+		if (it->_event() == nullptr)
+			continue;
+
+		it->_event.wait();
+
+		cl_int error = CL_SUCCESS;
+
+		ProfilerEntry entry;
+		entry._phase = it->_phase;
+		entry._layer = it->_layer;
+		entry._device = it->_device;
+		entry._queued = it->_event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(&error);
+
+		if (error == CL_SUCCESS)
+			entry._start = it->_event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&error);
+
+		if (error == CL_SUCCESS)
+			entry._end = it->_event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&error);
+
+		if (error != CL_SUCCESS) {
+#ifdef SYS_DEBUG
+			std::cerr << "No profiling info, create the ComputeSystem with setProfiling(true)!" << std::endl;
+#endif
+			break;
+		}
+
+		_entries.push_back(entry);
+	}
+
+	_pending.clear();
+}
+
+void Profiler::clear() {
+	_pending.clear();
+	_entries.clear();
+}
+
+std::vector<ProfilerStats> Profiler::getStats() const {
+	std::map<std::pair<std::string, int>, std::vector<double> > durations;
+
+	for (int i = 0; i < _entries.size(); i++)
+		durations[std::make_pair(_entries[i]._phase, _entries[i]._layer)].push_back((_entries[i]._end - _entries[i]._start) * 0.000001);
+
+	std::vector<ProfilerStats> stats;
+
+	for (std::map<std::pair<std::string, int>, std::vector<double> >::iterator it = durations.begin(); it != durations.end(); it++) {
+		std::vector<double> &ms = it->second;
+
+		std::sort(ms.begin(), ms.end());
+
+		ProfilerStats s;
+		s._phase = it->first.first;
+		s._layer = it->first.second;
+		s._count = ms.size();
+		s._totalMs = 0.0;
+		s._minMs = ms.front();
+		s._maxMs = ms.back();
+		s._p50Ms = ms[(ms.size() - 1) * 50 / 100];
+		s._p99Ms = ms[(ms.size() - 1) * 99 / 100];
+
+		for (int i = 0; i < ms.size(); i++) {
+			s._totalMs += ms[i];
+
+			int bucket = 0;
+
+			for (double us = ms[i] * 1000.0; us >= 1.0; us *= 0.5)
+				bucket++;
+
+			if (bucket >= s._histogram.size())
+				s._histogram.resize(bucket + 1, 0);
+
+			s._histogram[bucket]++;
+		}
+
+		stats.push_back(s);
+	}
+
+	return stats;
+}
+
+bool Profiler::writeChromeTrace(const std::string &name) const {
+	std::ofstream toFile(name);
+
+	if (!toFile.is_open()) {
+#ifdef SYS_DEBUG
+		std::cerr << "Could not open file " << name << "!" << std::endl;
+#endif
+		return false;
+	}
+
+	cl_ulong origin = 0;
+
+	for (int i = 0; i < _entries.size(); i++)
+		if (i == 0 || _entries[i]._start < origin)
+			origin = _entries[i]._start;
+
+	// Microseconds with nanosecond resolution, never in exponent notation
+	toFile << std::fixed << std::setprecision(3);
+
+	toFile << "{\"traceEvents\":[";
+
+	std::set<std::pair<int, int> > threads;
+
+	bool first = true;
+
+	for (int i = 0; i < _entries.size(); i++) {
+		const ProfilerEntry &entry = _entries[i];
+
+		// Layer -1 are the host transfers of the input and prediction
+		if (threads.insert(std::make_pair(entry._device, entry._layer)).second) {
+			toFile << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << entry._device << ",\"tid\":" << entry._layer
+				<< ",\"args\":{\"name\":\"" << (entry._layer < 0 ? std::string("host transfers") : "layer " + std::to_string(entry._layer)) << "\"}}";
+
+			first = false;
+		}
+
+		toFile << (first ? "" : ",") << "\n{\"name\":\"" << entry._phase << "\",\"cat\":\"htfe\",\"ph\":\"X\",\"pid\":" << entry._device << ",\"tid\":" << entry._layer
+			<< ",\"ts\":" << (entry._start - origin) * 0.001 << ",\"dur\":" << (entry._end - entry._start) * 0.001
+			<< ",\"args\":{\"queuedUs\":" << (entry._start - std::min(entry._queued, entry._start)) * 0.001 << "}}";
+
+		first = false;
+	}
+
+	toFile << "\n]}\n";
+
+	return toFile.good();
+}
\ No newline at end of file
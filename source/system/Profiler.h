@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Uncopyable.h"
+
+#include <CL/cl.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace sys {
+	// One profiled command, times in device nanoseconds
+	struct ProfilerEntry {
+		std::string _phase;
+		int _layer;
+		int _device;
+
+		cl_ulong _queued;
+		cl_ulong _start;
+		cl_ulong _end;
+	};
+
+	// Aggregated durations of every command of a phase and layer
+	struct ProfilerStats {
+		std::string _phase;
+		int _layer;
+
+		int _count;
+
+		double _totalMs;
+		double _minMs;
+		double _maxMs;
+		double _p50Ms;
+		double _p99Ms;
+
+		// _histogram[b] counts commands of [2^(b - 1), 2^b) microseconds, _histogram[0] those below 1 microsecond
+		std::vector<int> _histogram;
+
+		double getMeanMs() const {
+			return _count > 0 ? _totalMs / _count : 0.0;
+		}
+	};
+
+	// Collects the device timestamps of enqueued commands, labelled by phase and layer.
+	// The queues must be created with ComputeSystem::setProfiling(true)
+	class Profiler : public Uncopyable {
+	private:
+		struct Pending {
+			cl::Event _event;
+
+			std::string _phase;
+			int _layer;
+			int _device;
+		};
+
+		std::deque<Pending> _pending;
+
+		std::vector<ProfilerEntry> _entries;
+
+	public:
+		// Event to pass to one enqueue, valid until the next collect
+		cl::Event* event(const std::string &phase, int layer, int device);
+
+		// Records a command whose event the caller keeps for itself
+		void record(const cl::Event &event, const std::string &phase, int layer, int device);
+
+		// Waits for every recorded command and moves its timestamps into the entries.
+		// Call it regularly on long runs, each pending event holds driver resources
+		void collect();
+
+		void clear();
+
+		const std::vector<ProfilerEntry> &getEntries() const {
+			return _entries;
+		}
+
+		// Stats of the collected entries per phase and layer
+		std::vector<ProfilerStats> getStats() const;
+
+		// Chrome trace event JSON of the collected entries, one process per device and one thread per layer.
+		// Open it in chrome://tracing or Perfetto
+		bool writeChromeTrace(const std::string &name) const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace sys;
+
+void ThreadPool::create(int numThreads) {
+	destroy();
+
+	if (numThreads <= 0)
+		numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	_quit = false;
+
+	for (int t = 1; t < numThreads; t++)
+		_workers.push_back(std::thread(&ThreadPool::workerLoop, this, _generation));
+}
+
+void ThreadPool::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_quit = true;
+	}
+
+	_workReady.notify_all();
+
+	for (int t = 0; t < _workers.size(); t++)
+		_workers[t].join();
+
+	_workers.clear();
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)> &func) {
+	grain = std::max(1, grain);
+
+	if (_workers.empty() || count <= grain) {
+		func(0, count);
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_pTask = &func;
+		_count = count;
+		_grain = grain;
+		_next = 0;
+		_busyWorkers = static_cast<int>(_workers.size());
+		_generation++;
+	}
+
+	_workReady.notify_all();
+
+	runTiles();
+
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	_workDone.wait(lock, [this] { return _busyWorkers == 0; });
+
+	_pTask = nullptr;
+}
+
+void ThreadPool::workerLoop(unsigned int generation) {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+
+			_workReady.wait(lock, [this, generation] { return _quit || _generation != generation; });
+
+			if (_quit)
+				return;
+
+			generation = _generation;
+		}
+
+		runTiles();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (--_busyWorkers == 0)
+				_workDone.notify_one();
+		}
+	}
+}
+
+void ThreadPool::runTiles() {
+	while (true) {
+		int begin = _next.fetch_add(_grain);
+
+		if (begin >= _count)
+			break;
+
+		(*_pTask)(begin, std::min(begin + _grain, _count));
+	}
+}
\ No newline at end of file
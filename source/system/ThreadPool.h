@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Uncopyable.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace sys {
+	// Fixed set of worker threads that split an index range into tiles, the calling thread takes tiles as well
+	class ThreadPool : public Uncopyable {
+	private:
+		std::vector<std::thread> _workers;
+
+		std::mutex _mutex;
+		std::condition_variable _workReady;
+		std::condition_variable _workDone;
+
+		const std::function<void(int, int)>* _pTask;
+		int _count;
+		int _grain;
+		std::atomic<int> _next;
+
+		int _busyWorkers;
+		unsigned int _generation;
+		bool _quit;
+
+		// generation is the one current at create, read there so a task posted before the thread starts is not skipped
+		void workerLoop(unsigned int generation);
+		void runTiles();
+
+	public:
+		ThreadPool()
+			: _pTask(nullptr), _count(0), _grain(1), _next(0), _busyWorkers(0), _generation(0), _quit(false)
+		{}
+
+		~ThreadPool() {
+			destroy();
+		}
+
+		// numThreads <= 0 uses all hardware threads
+		void create(int numThreads);
+		void destroy();
+
+		// Calls func(begin, end) for tiles of at most grain indices covering [0, count), returns when all tiles are done
+		void parallelFor(int count, int grain, const std::function<void(int, int)> &func);
+
+		int getNumThreads() const {
+			return static_cast<int>(_workers.size()) + 1;
+		}
+	};
+}
\ No newline at end of file
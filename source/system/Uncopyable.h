@@ -1,13 +1,13 @@
-#pragma once
-
-// Inherit from this class to make the class uncopyable
-namespace sys {
-	class Uncopyable {
-	protected:
-		Uncopyable() {}
-		virtual ~Uncopyable() {}
-	private:
-		Uncopyable(const Uncopyable &);
-		Uncopyable &operator=(const Uncopyable &);
-	};
+#pragma once
+
+// Inherit from this class to make the class uncopyable
+namespace sys {
+	class Uncopyable {
+	protected:
+		Uncopyable() {}
+		virtual ~Uncopyable() {}
+	private:
+		Uncopyable(const Uncopyable &);
+		Uncopyable &operator=(const Uncopyable &);
+	};
 }
\ No newline at end of file